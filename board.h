@@ -15,7 +15,7 @@
 class board
 {
     private:
-        std::map<chess_vars::player_color, std::vector<piece*>> all_pieces;
+        position_state *pieces; // Where the pieces are created: the game's own state
         std::map<position, piece*> *occupied_spaces;
 
         
@@ -25,7 +25,7 @@ class board
     public:
         // Only parametrised constructor is provided
         //board() = default;
-        board(std::map<position, piece*> *piece_ptr): occupied_spaces{piece_ptr} {}
+        board(position_state &board_state): pieces{&board_state}, occupied_spaces{board_state.get_locations()} {}
         
         // Default layout of chess board
         void initialise_board();
@@ -47,29 +47,24 @@ class board
 
 void board::initialise_board()
 {
+    // The pieces of each color are listed by the compact board the moves are generated on (see chess::generate_moves)
     // Initialise top and bottom pawns
     for (int i{1}; i<=8; i++){
-        pawn *w_pawn = new pawn {chess_vars::white,chess_vars::pawn, position(i,2)};
-        pawn *b_pawn = new pawn{chess_vars::black,chess_vars::pawn,position(i,7)};
-        all_pieces[chess_vars::white].push_back(w_pawn);    
-        all_pieces[chess_vars::black].push_back(b_pawn);    
-        
+        pieces->create<pawn>(chess_vars::white,chess_vars::pawn, position(i,2));
+        pieces->create<pawn>(chess_vars::black,chess_vars::pawn,position(i,7));
     }
     // Initialise other pieces
     chess_vars::player_color current_color{chess_vars::white};
-    std::vector<piece*> back_rank_pieces;
     int rank{1};
     for (int c{}; c<2; c++){
-        rook *rook_l = new rook (current_color,chess_vars::rook,position(1,rank));
-        knight *knight_l = new knight {current_color,chess_vars::knight,position(2,rank)};
-        bishop *bishop_l = new bishop {current_color,chess_vars::bishop,position(3,rank)};
-        queen *the_queen = new queen {current_color,chess_vars::queen,position(4,rank)};
-        king *the_king = new king {current_color,chess_vars::king,position(5,rank)};
-        bishop *bishop_r = new bishop {current_color,chess_vars::bishop,position(6,rank)};
-        knight *knight_r = new knight {current_color,chess_vars::knight,position(7,rank)};
-        rook *rook_r = new rook {current_color,chess_vars::rook,position(8,rank)};
-        back_rank_pieces = {rook_l, knight_l, bishop_l, the_queen, the_king, bishop_r, rook_r,knight_r};
-        all_pieces[current_color].insert( all_pieces[current_color].end(), back_rank_pieces.begin(), back_rank_pieces.end());
+        pieces->create<rook>(current_color,chess_vars::rook,position(1,rank));
+        pieces->create<knight>(current_color,chess_vars::knight,position(2,rank));
+        pieces->create<bishop>(current_color,chess_vars::bishop,position(3,rank));
+        pieces->create<queen>(current_color,chess_vars::queen,position(4,rank));
+        king *the_king = pieces->create<king>(current_color,chess_vars::king,position(5,rank));
+        pieces->create<bishop>(current_color,chess_vars::bishop,position(6,rank));
+        pieces->create<knight>(current_color,chess_vars::knight,position(7,rank));
+        pieces->create<rook>(current_color,chess_vars::rook,position(8,rank));
         kings[current_color] = the_king;
 
         current_color = chess_vars::black;
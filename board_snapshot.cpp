@@ -0,0 +1,101 @@
+// Board snapshots, part of the C++ Chess Project.
+
+#include <algorithm>
+
+#include "board_snapshot.h"
+#include "opening_book.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+board_snapshot::board_snapshot(const compact_board &board)
+{
+    for (int sq{}; sq<64; sq+=2){
+        squares[sq/2] = static_cast<uint8_t>(board.at(sq) | (board.at(sq+1) << 4));
+    }
+    position_key = polyglot_key(board);
+    fullmove_number = static_cast<uint16_t>(board.fullmoves());
+    state = static_cast<uint8_t>(board.castling_rights() | (board.side_to_move()==chess_vars::white ? 0x10 : 0));
+    ep_square = static_cast<int8_t>(board.en_passant_square());
+    halfmove_clock = static_cast<uint8_t>(std::min(board.halfmoves(), 255));
+}
+
+compact_board board_snapshot::board() const
+{
+    compact_board board;
+    for (int pair{}; pair<32; pair++){
+        if (squares[pair]==0) continue; // Half the board or more is empty
+        if (squares[pair] & 0x0F) board.set(2*pair, squares[pair] & 0x0F);
+        if (squares[pair] >> 4) board.set(2*pair + 1, static_cast<uint8_t>(squares[pair] >> 4));
+    }
+    board.set_side_to_move(side_to_move());
+    board.set_castling_rights(state & 0x0F);
+    board.set_en_passant_square(ep_square);
+    board.set_halfmoves(halfmove_clock);
+    board.set_fullmoves(fullmove_number);
+    return board;
+}
+
+variation::variation(const compact_board &start)
+    : last{std::make_shared<const link>(board_snapshot(start), compact_move(), 0, nullptr)}
+{
+}
+
+variation::variation(const compact_board &start, const std::vector<compact_move> &moves)
+    : variation(start)
+{
+    compact_board board {start};
+    for (auto &m : moves){
+        board.make_move(m);
+        last = std::make_shared<const link>(board_snapshot(board), m, last->length + 1, last);
+    }
+}
+
+// Left to the shared pointers, each link would free the one before it from its own destructor: one stack frame per move,
+// which a long enough variation overflows. Instead the first link freed on a thread frees the ones before it in a loop,
+// the others only handing it the link before them. Whichever thread drops the last reference to a link frees it, so
+// this holds however many threads share the history, with no reference count to read.
+variation::link::~link()
+{
+    thread_local bool freeing {false};
+    thread_local std::shared_ptr<const link> next; // Link before the one being freed, which may be freed next
+    next = std::move(previous);
+    if (freeing) return;
+    freeing = true;
+    while (next){
+        std::shared_ptr<const link> released {std::move(next)};
+        released.reset(); // If that was the last reference, the destructor of the link hands over the one before it
+    }
+    freeing = false;
+}
+
+variation variation::play(const compact_move &m) const
+{
+    compact_board board {last->position.board()};
+    board.make_move(m);
+    return variation(std::make_shared<const link>(board_snapshot(board), m, last->length + 1, last));
+}
+
+variation variation::back() const
+{
+    return last->previous ? variation(last->previous) : *this;
+}
+
+std::vector<compact_move> variation::moves() const
+{
+    std::vector<compact_move> list;
+    list.reserve(last->length);
+    for (const link *at {last.get()}; at->previous; at = at->previous.get()) list.push_back(at->move);
+    std::reverse(list.begin(), list.end());
+    return list;
+}
+
+std::vector<uint64_t> variation::keys() const
+{
+    std::vector<uint64_t> list;
+    list.reserve(last->length);
+    for (const link *at {last->previous.get()}; at; at = at->previous.get()) list.push_back(at->position.key());
+    std::reverse(list.begin(), list.end());
+    return list;
+}
@@ -0,0 +1,101 @@
+// Board snapshots, part of the C++ Chess Project.
+// Immutable positions, to branch off a game and explore variations ("what if") without touching it:
+// - board_snapshot packs a compact_board into 48 bytes: two squares to a byte, the state and the key of the position
+// - a variation is a chain of snapshots, each pointing back to the one it was played from. Playing a move adds a link
+//   and leaves the variation it was played from as it was, so a branch shares every position before it (structural
+//   sharing) and copying a variation only copies a pointer. However long, a chain is freed in a loop by whichever thread
+//   drops the last reference to it.
+// Nothing is ever changed once made: any number of threads may explore variations off the same history without locks.
+
+#include <vector>
+#include <memory>
+
+#include "compact_board.h"
+#include "opening_book.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+class board_snapshot
+{
+    private:
+        uint8_t squares[32]{}; // Piece codes, two squares to a byte: the lower square in the low half
+        uint64_t position_key{};
+        uint16_t fullmove_number{1};
+        uint8_t state{}; // Castling rights (bits 0-3), white to move (bit 4)
+        int8_t ep_square{-1};
+        uint8_t halfmove_clock{}; // At most 255, like that of compact_board
+    public:
+        board_snapshot() = default;
+        explicit board_snapshot(const compact_board &board);
+        // The position to play on
+        compact_board board() const;
+
+        uint8_t at(int square) const
+        {
+            return static_cast<uint8_t>((squares[square/2] >> (4*(square%2))) & 0x0F);
+        }
+        chess_vars::player_color side_to_move() const
+        {
+            return (state & 0x10) ? chess_vars::white : chess_vars::black;
+        }
+        int halfmoves() const
+        {
+            return halfmove_clock;
+        }
+        uint64_t key() const
+        {
+            return position_key;
+        }
+};
+
+class variation
+{
+    private:
+        struct link
+        {
+            board_snapshot position;
+            compact_move move; // Move which led to the position, none at the start
+            size_t length{};   // Moves from the start
+            std::shared_ptr<const link> previous;
+
+            link(const board_snapshot &position_, const compact_move &move_, size_t length_, std::shared_ptr<const link> previous_)
+                : position{position_}, move{move_}, length{length_}, previous{std::move(previous_)} {}
+            ~link();
+        };
+        std::shared_ptr<const link> last;
+
+        explicit variation(std::shared_ptr<const link> last_) : last{std::move(last_)} {}
+    public:
+        variation() = default; // No position: empty()
+        explicit variation(const compact_board &start);
+        // The start, then moves legal from it
+        variation(const compact_board &start, const std::vector<compact_move> &moves);
+
+        // Both leave this variation as it is. The move must be legal in the current position.
+        variation play(const compact_move &m) const;
+        // One move back, or the same variation at its start
+        variation back() const;
+
+        bool empty() const
+        {
+            return !last;
+        }
+        const board_snapshot &position() const
+        {
+            return last->position;
+        }
+        compact_board board() const
+        {
+            return last->position.board();
+        }
+        size_t length() const
+        {
+            return last->length;
+        }
+        // Moves from the start, in order
+        std::vector<compact_move> moves() const;
+        // Keys of the positions before the current one, in order: the history a search from here needs for repetitions
+        std::vector<uint64_t> keys() const;
+};
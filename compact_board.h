@@ -0,0 +1,1099 @@
+// Compact board representation, part of the C++ Chess Project.
+// The interactive game tracks its pieces through maps of piece pointers (see pieces.h), but generates its moves here.
+// Modules which need to look ahead (tablebase probing,...) also work on this value type:
+// - one byte per square, holding the (color, type) code of the piece
+// - side to move, castling rights, en-passant square and clocks
+// It is cheap to copy, so moves may be explored by making them on a copy of the board. They may also be made and taken
+// back on the same board, keeping for each move the undo_record of what it overwrote (see move_stack.h).
+
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <vector>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <map>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "position.h"
+#include "pieces.h"
+#include "pieces.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Squares are numbered 0-63 from a1 to h8, file first: square = (x-1) + 8*(y-1).
+// This is the same ordering as operator< on position.
+int to_square(const position &pos)
+{
+    return (pos.x()-1) + 8*(pos.y()-1);
+}
+position to_position(int square)
+{
+    return position(square%8 + 1, square/8 + 1);
+}
+std::string square_name(int square)
+{
+    std::string name {static_cast<char>('a' + square%8)};
+    name += static_cast<char>('1' + square/8);
+    return name;
+}
+
+// Bitboards: one bit per square, in the same order
+// Lowest square of a non-empty bitboard
+int lowest_square(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long square;
+    _BitScanForward64(&square, bits);
+    return static_cast<int>(square);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+int square_count(uint64_t bits)
+{
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(bits));
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+// A piece code packs the type in the low 3 bits (type+1, so that 0 is an empty square) and the color in bit 3.
+const uint8_t no_piece {0};
+constexpr uint8_t piece_code(chess_vars::player_color color, chess_vars::piece_type type)
+{
+    return static_cast<uint8_t>((type + 1) | (color << 3));
+}
+chess_vars::piece_type code_type(uint8_t code)
+{
+    return static_cast<chess_vars::piece_type>((code & 7) - 1);
+}
+chess_vars::player_color code_color(uint8_t code)
+{
+    return static_cast<chess_vars::player_color>(code >> 3);
+}
+
+// Castling rights bits
+const uint8_t white_k_castle {1}, white_q_castle {2}, black_k_castle {4}, black_q_castle {8};
+
+// Castling rights lost when a piece moves from or to one of these squares
+uint8_t castling_mask(int square)
+{
+    switch (square)
+    {
+    case 0:  return white_q_castle;
+    case 4:  return white_k_castle | white_q_castle;
+    case 7:  return white_k_castle;
+    case 56: return black_q_castle;
+    case 60: return black_k_castle | black_q_castle;
+    case 63: return black_k_castle;
+    default: return 0;
+    }
+}
+
+const size_t max_fen_length {100}; // Longest FEN written, with room to spare
+
+// Move flags
+const uint8_t quiet_move {0}, capture_move {1}, en_passant_move {2}, castle_move {4}, double_push_move {8};
+
+struct compact_move
+{
+    uint8_t from{};
+    uint8_t to{};
+    uint8_t promotion{chess_vars::nancy_rothwell}; // Piece type the pawn promotes to, nancy_rothwell if not a promotion
+    uint8_t flags{quiet_move};
+
+    bool is_capture() const
+    {
+        return flags & (capture_move | en_passant_move);
+    }
+    bool is_promotion() const
+    {
+        return promotion!=chess_vars::nancy_rothwell;
+    }
+    bool operator==(const compact_move &other) const
+    {
+        return from==other.from && to==other.to && promotion==other.promotion;
+    }
+};
+
+// What a move overwrites, and so what is needed to take it back: the rest is worked out from the move itself
+struct undo_record
+{
+    compact_move move;
+    uint8_t captured{no_piece}; // Code of the piece taken, en-passant included
+    uint8_t castling{};
+    int8_t ep_square{-1};
+    uint8_t halfmove_clock{};
+};
+
+// Coordinate notation (e.g. e2e4, e7e8q), mostly for output and troubleshooting
+std::string move_to_string(const compact_move &m)
+{
+    std::string text {square_name(m.from) + square_name(m.to)};
+    if (m.is_promotion()){
+        text += static_cast<char>(tolower(piece_to_char(static_cast<chess_vars::piece_type>(m.promotion))));
+    }
+    return text;
+}
+
+// What the opponent's pieces do to the side to move, from a single walk of each of their rays (see compact_board::threats):
+// the squares they attack and defend, the pieces giving check and how to stop it, and the pieces pinned against the king.
+// Legal moves are read from it, instead of making each move on a copy of the board to see if the king is left in check.
+struct threat_map
+{
+    uint64_t attacked{}; // Empty squares and squares of the side to move, attacked through its king (it cannot step back along a ray)
+    uint64_t defended{}; // Opponent's pieces covered by another of theirs: the king may not take them
+    uint64_t checkers{};
+    uint64_t check_blocks{}; // Against a single check: the checker and the squares between it and the king
+    uint64_t pinned{};
+    uint8_t pin_square[8]{};
+    uint64_t pin_ray[8]{}; // Squares a pinned piece may still move to: between its king and the pinning piece, which it may take
+    int pins{};
+};
+
+class compact_board
+{
+    private:
+        uint8_t squares[64]{};
+        chess_vars::player_color to_move{chess_vars::white};
+        uint8_t castling{};
+        int8_t ep_square{-1}; // Square behind a pawn which just double-jumped, -1 if none
+        uint8_t halfmove_clock{}; // Stops at 255: past the fifty-move rule only its being over 100 matters
+        uint16_t fullmove_number{1};
+        uint8_t king_square[2]{};
+        // Squares of the pieces of each color and type, kept in step with the squares: the generators walk the pieces
+        // of the side to move through these instead of scanning the board
+        uint64_t piece_sets[2][6]{};
+
+        void place(int square, uint8_t code)
+        {
+            squares[square] = code;
+            piece_sets[code >> 3][(code & 7) - 1] |= uint64_t{1} << square;
+        }
+        void lift(int square)
+        {
+            piece_sets[squares[square] >> 3][(squares[square] & 7) - 1] &= ~(uint64_t{1} << square);
+            squares[square] = no_piece;
+        }
+
+        // Generators for one side to move (see side_constants)
+        template<chess_vars::player_color by> bool attacked_by(int square) const;
+        template<chess_vars::player_color us> void add_pawn_moves(std::vector<compact_move> &moves, int from, bool captures_only) const;
+        template<chess_vars::player_color us> void add_piece_moves(std::vector<compact_move> &moves, int from, bool captures_only) const;
+        template<chess_vars::player_color us> void add_castling_moves(std::vector<compact_move> &moves) const;
+        template<chess_vars::player_color us> void add_moves_from(std::vector<compact_move> &moves, int from, bool captures_only) const;
+        template<chess_vars::player_color us> void pseudo_legal_moves(std::vector<compact_move> &moves, bool captures_only) const;
+        template<chess_vars::player_color us> bool leaves_king_safe(const compact_move &m) const;
+        template<chess_vars::player_color us> void threats(threat_map &map) const;
+        template<chess_vars::player_color us> bool keeps_king_safe(const compact_move &m, const threat_map &map) const;
+        template<chess_vars::player_color us> void legal_moves(std::vector<compact_move> &moves, bool captures_only) const;
+        template<chess_vars::player_color us> bool any_legal_move() const;
+        template<chess_vars::player_color us> void play(const compact_move &m);
+        template<chess_vars::player_color us> void take_back(const undo_record &undo);
+    public:
+        compact_board() = default;
+
+        static compact_board from_occupied(const position_state &pieces, chess_vars::player_color player);
+        static compact_board starting_position();
+        static bool from_fen(std::string_view fen, compact_board &board);
+        std::string to_fen() const;
+
+        uint8_t at(int square) const
+        {
+            return squares[square];
+        }
+        void set(int square, uint8_t code);
+        chess_vars::player_color side_to_move() const
+        {
+            return to_move;
+        }
+        void set_side_to_move(chess_vars::player_color player)
+        {
+            to_move = player;
+        }
+        uint8_t castling_rights() const
+        {
+            return castling;
+        }
+        void set_castling_rights(uint8_t rights)
+        {
+            castling = rights;
+        }
+        int en_passant_square() const
+        {
+            return ep_square;
+        }
+        void set_en_passant_square(int square)
+        {
+            ep_square = static_cast<int8_t>(square);
+        }
+        int halfmoves() const
+        {
+            return halfmove_clock;
+        }
+        void set_halfmoves(int count)
+        {
+            halfmove_clock = static_cast<uint8_t>(std::clamp(count, 0, 255));
+        }
+        int fullmoves() const
+        {
+            return fullmove_number;
+        }
+        void set_fullmoves(int count)
+        {
+            fullmove_number = static_cast<uint16_t>(count);
+        }
+        int king_location(chess_vars::player_color player) const
+        {
+            return king_square[player];
+        }
+        int piece_total() const;
+        bool playable_pieces() const;
+        uint8_t possible_castling() const;
+        bool possible_en_passant(int square) const;
+        bool insufficient_material() const;
+        // Draw by rule, ongoing if there is none, when the position occurred repetitions times before with the same side to move
+        chess_vars::game_outcome draw_by_rule(int repetitions, bool claim_draws) const;
+        int count(chess_vars::player_color player, chess_vars::piece_type type) const
+        {
+            return square_count(piece_sets[player][type]);
+        }
+        uint64_t pieces(chess_vars::player_color player, chess_vars::piece_type type) const
+        {
+            return piece_sets[player][type];
+        }
+
+        bool is_attacked(int square, chess_vars::player_color by) const;
+        bool in_check() const
+        {
+            return is_attacked(king_square[to_move], switch_player(to_move));
+        }
+        void generate_pseudo_legal(std::vector<compact_move> &moves, bool captures_only=false) const;
+        void generate_pseudo_legal(std::vector<compact_move> &moves, chess_vars::piece_type type) const;
+        void generate_pseudo_legal_from(int square, std::vector<compact_move> &moves) const;
+        void generate_legal(std::vector<compact_move> &moves, bool captures_only=false) const;
+        bool is_legal(const compact_move &m) const;
+        // The filter of generate_legal, for callers walking pseudo-legal moves of their own (e.g. square by square):
+        // the threats are found once per position, then each move is read against them
+        void find_threats(threat_map &map) const;
+        bool is_legal(const compact_move &m, const threat_map &map) const;
+        bool has_legal_move() const;
+        void make_move(const compact_move &m);
+        // Same, filling in what unmake_move needs to restore the board as it was, in constant time
+        void make_move(const compact_move &m, undo_record &undo);
+        void unmake_move(const undo_record &undo);
+};
+
+void compact_board::set(int square, uint8_t code)
+{
+    if (squares[square]!=no_piece) lift(square);
+    if (code==no_piece) return;
+    place(square, code);
+    if (code_type(code)==chess_vars::king){
+        king_square[code_color(code)] = static_cast<uint8_t>(square);
+    }
+}
+
+// Build a compact copy of the interactive game. Castling rights are deduced from the kings and rooks which have not moved yet.
+compact_board compact_board::from_occupied(const position_state &pieces, chess_vars::player_color player)
+{
+    compact_board board;
+    const std::map<position, piece*> &occupied {pieces.occupied_squares};
+    for (auto iter=occupied.begin(); iter!=occupied.end(); ++iter){
+        if (!iter->first.is_valid()) continue;
+        board.set(to_square(iter->first), piece_code(iter->second->get_owner(), iter->second->get_abbrev()));
+    }
+    board.to_move = player;
+
+    // Castling: king on e1/e8 and rook in the corner, both unmoved
+    auto unmoved = [&occupied](position pos, chess_vars::player_color color, chess_vars::piece_type type){
+        auto iter {occupied.find(pos)};
+        return iter!=occupied.end() && iter->second->get_owner()==color && iter->second->get_abbrev()==type && iter->second->check_if_moved()==0;
+    };
+    if (unmoved(position(5,1), chess_vars::white, chess_vars::king)){
+        if (unmoved(position(8,1), chess_vars::white, chess_vars::rook)) board.castling |= white_k_castle;
+        if (unmoved(position(1,1), chess_vars::white, chess_vars::rook)) board.castling |= white_q_castle;
+    }
+    if (unmoved(position(5,8), chess_vars::black, chess_vars::king)){
+        if (unmoved(position(8,8), chess_vars::black, chess_vars::rook)) board.castling |= black_k_castle;
+        if (unmoved(position(1,8), chess_vars::black, chess_vars::rook)) board.castling |= black_q_castle;
+    }
+
+    // En-passant: the pawn which just double-jumped belongs to the opponent
+    if (pieces.en_passant_available() && pieces.en_passant_pawn().is_valid()){
+        position weak_pawn {pieces.en_passant_pawn()};
+        int direction { player==chess_vars::white ? 1 : -1 };
+        board.ep_square = static_cast<int8_t>(to_square(position(weak_pawn.x(), weak_pawn.y() + direction)));
+    }
+    return board;
+}
+
+// Standard initial setup, white to move with all castling rights
+compact_board compact_board::starting_position()
+{
+    compact_board board;
+    const chess_vars::piece_type back_rank[8] { chess_vars::rook, chess_vars::knight, chess_vars::bishop, chess_vars::queen,
+                                                chess_vars::king, chess_vars::bishop, chess_vars::knight, chess_vars::rook };
+    for (int file{}; file<8; file++){
+        board.set(file, piece_code(chess_vars::white, back_rank[file]));
+        board.set(8 + file, piece_code(chess_vars::white, chess_vars::pawn));
+        board.set(48 + file, piece_code(chess_vars::black, chess_vars::pawn));
+        board.set(56 + file, piece_code(chess_vars::black, back_rank[file]));
+    }
+    board.castling = white_k_castle | white_q_castle | black_k_castle | black_q_castle;
+    return board;
+}
+
+// Next space-separated field of a FEN, or an empty view at the end
+std::string_view next_fen_field(std::string_view &text)
+{
+    size_t start {text.find_first_not_of(" \t\r\n")};
+    if (start==std::string_view::npos){
+        text = std::string_view();
+        return text;
+    }
+    text.remove_prefix(start);
+    size_t end {std::min(text.find_first_of(" \t\r\n"), text.size())};
+    std::string_view field {text.substr(0, end)};
+    text.remove_prefix(end);
+    return field;
+}
+
+// Read a position in Forsyth-Edwards Notation, in one pass over the text. The clocks may be left out.
+// Returns false (board unchanged) if the placement, side to move, castling or en-passant fields are malformed, or the pieces
+// are not playable_pieces().
+// Castling rights without their king and rook, and en-passant squares without a pawn to take, are dropped.
+bool compact_board::from_fen(std::string_view fen, compact_board &board)
+{
+    std::string_view placement {next_fen_field(fen)}, side {next_fen_field(fen)}, rights {next_fen_field(fen)}, ep {next_fen_field(fen)};
+    std::string_view halfmoves {next_fen_field(fen)}, fullmoves {next_fen_field(fen)};
+    if (ep.empty()) return false;
+
+    compact_board parsed;
+    int rank{7}, file{0};
+    for (char c : placement){
+        if (c=='/'){
+            if (file!=8 || --rank<0) return false;
+            file = 0;
+        } else if (c>='1' && c<='8'){
+            file += c - '0';
+        } else if (std::string_view{"prnbqkPRNBQK"}.find(c)!=std::string_view::npos && file<8){
+            chess_vars::player_color color { std::isupper(static_cast<unsigned char>(c)) ? chess_vars::white : chess_vars::black };
+            chess_vars::piece_type type {char_to_piece(static_cast<char>(std::toupper(static_cast<unsigned char>(c))))};
+            parsed.set(file + 8*rank, piece_code(color, type));
+            file++;
+        } else {
+            return false;
+        }
+        if (file>8) return false;
+    }
+    if (rank!=0 || file!=8 || !parsed.playable_pieces()) return false;
+
+    if (side!="w" && side!="b") return false;
+    parsed.to_move = side=="w" ? chess_vars::white : chess_vars::black;
+
+    if (rights!="-"){
+        for (char c : rights){
+            switch (c){
+                case 'K': parsed.castling |= white_k_castle; break;
+                case 'Q': parsed.castling |= white_q_castle; break;
+                case 'k': parsed.castling |= black_k_castle; break;
+                case 'q': parsed.castling |= black_q_castle; break;
+                default: return false;
+            }
+        }
+    }
+    parsed.castling = parsed.possible_castling();
+
+    if (ep!="-"){
+        if (ep.size()!=2 || ep[0]<'a' || ep[0]>'h' || (ep[1]!='3' && ep[1]!='6')) return false;
+        int square {(ep[0] - 'a') + 8*(ep[1] - '1')};
+        if (parsed.possible_en_passant(square)){
+            parsed.ep_square = static_cast<int8_t>(square);
+        }
+    }
+
+    // Clocks: digits only, kept within the range of the fields
+    auto read_number = [](std::string_view digits, int fallback, int low, int high){
+        if (digits.empty()) return fallback;
+        int value{};
+        for (char c : digits){
+            if (c<'0' || c>'9') return fallback;
+            value = std::min(value*10 + (c - '0'), high);
+        }
+        return std::max(value, low);
+    };
+    parsed.halfmove_clock = static_cast<uint8_t>(read_number(halfmoves, 0, 0, 255));
+    parsed.fullmove_number = static_cast<uint16_t>(read_number(fullmoves, 1, 1, 65535));
+    board = parsed;
+    return true;
+}
+
+// Write the position in Forsyth-Edwards Notation
+std::string compact_board::to_fen() const
+{
+    char text[max_fen_length];
+    char *out {text};
+    for (int rank{7}; rank>=0; rank--){
+        int empty{};
+        for (int file{}; file<8; file++){
+            uint8_t code {squares[file + 8*rank]};
+            if (code==no_piece){
+                empty++;
+                continue;
+            }
+            if (empty>0) *out++ = static_cast<char>('0' + empty);
+            empty = 0;
+            char letter {piece_to_char(code_type(code))};
+            *out++ = code_color(code)==chess_vars::white ? letter : static_cast<char>(std::tolower(static_cast<unsigned char>(letter)));
+        }
+        if (empty>0) *out++ = static_cast<char>('0' + empty);
+        if (rank>0) *out++ = '/';
+    }
+    *out++ = ' ';
+    *out++ = to_move==chess_vars::white ? 'w' : 'b';
+    *out++ = ' ';
+    if (castling==0) *out++ = '-';
+    if (castling & white_k_castle) *out++ = 'K';
+    if (castling & white_q_castle) *out++ = 'Q';
+    if (castling & black_k_castle) *out++ = 'k';
+    if (castling & black_q_castle) *out++ = 'q';
+    *out++ = ' ';
+    if (ep_square<0){
+        *out++ = '-';
+    } else {
+        *out++ = static_cast<char>('a' + ep_square%8);
+        *out++ = static_cast<char>('1' + ep_square/8);
+    }
+    out += std::snprintf(out, text + max_fen_length - out, " %d %d", halfmove_clock, fullmove_number);
+    return std::string(text, out);
+}
+
+int compact_board::piece_total() const
+{
+    int total{};
+    for (auto &side : piece_sets){
+        for (uint64_t set : side) total += square_count(set);
+    }
+    return total;
+}
+
+// One king a side and no pawn on the first or last rank: the move generators rely on both, looking up the kings' squares
+// and the squares beside and in front of each pawn without a bounds check
+bool compact_board::playable_pieces() const
+{
+    const uint64_t end_ranks {0xFF000000000000FFULL};
+    return square_count(piece_sets[chess_vars::white][chess_vars::king])==1 && square_count(piece_sets[chess_vars::black][chess_vars::king])==1
+        && ((piece_sets[chess_vars::white][chess_vars::pawn] | piece_sets[chess_vars::black][chess_vars::pawn]) & end_ranks)==0;
+}
+
+// The castling rights held whose king and rook are both at home: the others could not be played
+uint8_t compact_board::possible_castling() const
+{
+    uint8_t rights {castling};
+    for (int sq : {0, 7, 56, 63}){
+        chess_vars::player_color color {sq<8 ? chess_vars::white : chess_vars::black};
+        if (squares[sq]!=piece_code(color, chess_vars::rook) || squares[sq<8 ? 4 : 60]!=piece_code(color, chess_vars::king)){
+            rights &= ~castling_mask(sq);
+        }
+    }
+    return rights;
+}
+
+// An en-passant square is only possible on the side to move's sixth rank, empty, with an opponent's pawn in front of it
+// which may just have double-jumped
+bool compact_board::possible_en_passant(int square) const
+{
+    bool white {to_move==chess_vars::white};
+    if (square<0 || square>63 || square/8!=(white ? 5 : 2) || squares[square]!=no_piece) return false;
+    int pawn_square {white ? square-8 : square+8}, start_square {white ? square+8 : square-8};
+    return squares[pawn_square]==piece_code(switch_player(to_move), chess_vars::pawn) && squares[start_square]==no_piece;
+}
+
+// Neither side can mate by any series of legal moves (a dead position), from the material alone:
+// kings only, one knight or bishop, or bishops all on squares of one color
+bool compact_board::insufficient_material() const
+{
+    for (auto &side : piece_sets){
+        if (side[chess_vars::pawn] | side[chess_vars::rook] | side[chess_vars::queen]) return false;
+    }
+    uint64_t knights {piece_sets[0][chess_vars::knight] | piece_sets[1][chess_vars::knight]};
+    uint64_t bishops {piece_sets[0][chess_vars::bishop] | piece_sets[1][chess_vars::bishop]};
+    if (square_count(knights | bishops)<=1) return true;
+    const uint64_t light_squares {0x55AA55AA55AA55AAULL};
+    return knights==0 && ((bishops & light_squares)==0 || (bishops & ~light_squares)==0);
+}
+
+// A dead position (not enough material to mate), a fivefold repetition and seventy-five moves without a capture or a
+// pawn move end the game by themselves. A threefold repetition and fifty such moves only do when claimed: the game
+// claims them for the players, except when replaying a recorded game, which went on because nobody claimed.
+chess_vars::game_outcome compact_board::draw_by_rule(int repetitions, bool claim_draws) const
+{
+    if (insufficient_material()){
+        return chess_vars::draw_by_material;
+    }
+    if (repetitions>=(claim_draws ? 2 : 4)){
+        return chess_vars::draw_by_repetition;
+    }
+    if (halfmove_clock>=(claim_draws ? 100 : 150)){
+        return chess_vars::draw_by_move_rule;
+    }
+    return chess_vars::ongoing;
+}
+
+// Steps as (file, rank) increments
+const int knight_steps[8][2] { {1,2}, {1,-2}, {-1,2}, {-1,-2}, {2,1}, {2,-1}, {-2,1}, {-2,-1} };
+const int king_steps[8][2] { {1,1}, {1,-1}, {-1,-1}, {-1,1}, {1,0}, {-1,0}, {0,1}, {0,-1} };
+const int straight_steps[4][2] { {1,0}, {-1,0}, {0,1}, {0,-1} };
+const int diagonal_steps[4][2] { {1,1}, {1,-1}, {-1,-1}, {-1,1} };
+
+// Returns the square reached by a step, or -1 if it leaves the board
+inline int step_square(int square, const int step[2])
+{
+    int x {square%8 + step[0]}, y {square/8 + step[1]};
+    if (x<0 || x>7 || y<0 || y>7){
+        return -1;
+    }
+    return x + 8*y;
+}
+
+// Everything which depends on the side to move, as compile-time constants: the generators below are templated on the
+// side, so a pawn's direction, its ranks and the castling squares need no branch. Squares are counted from white's side.
+template<chess_vars::player_color us>
+struct side_constants
+{
+    static constexpr chess_vars::player_color them {us==chess_vars::white ? chess_vars::black : chess_vars::white};
+    static constexpr int forward {us==chess_vars::white ? 8 : -8}; // One rank towards the opponent
+    static constexpr int start_rank {us==chess_vars::white ? 1 : 6};
+    static constexpr int last_rank {us==chess_vars::white ? 7 : 0};
+    static constexpr int back {us==chess_vars::white ? 0 : 56}; // First square of the back rank
+    static constexpr uint8_t k_right {us==chess_vars::white ? white_k_castle : black_k_castle};
+    static constexpr uint8_t q_right {us==chess_vars::white ? white_q_castle : black_q_castle};
+    static constexpr uint8_t pawn {piece_code(us, chess_vars::pawn)};
+};
+
+template<chess_vars::player_color by>
+bool compact_board::attacked_by(int square) const
+{
+    // Pawns: look one rank back from the attacked square, towards the attacker
+    constexpr int pawn_rank { by==chess_vars::white ? -1 : 1 };
+    constexpr uint8_t pawn {piece_code(by, chess_vars::pawn)}, knight {piece_code(by, chess_vars::knight)}, king {piece_code(by, chess_vars::king)};
+    constexpr uint8_t rook {piece_code(by, chess_vars::rook)}, bishop {piece_code(by, chess_vars::bishop)}, queen {piece_code(by, chess_vars::queen)};
+    if (square/8!=(by==chess_vars::white ? 0 : 7)){
+        if (square%8>0 && squares[square + pawn_rank*8 - 1]==pawn) return true;
+        if (square%8<7 && squares[square + pawn_rank*8 + 1]==pawn) return true;
+    }
+    for (auto &step : knight_steps){
+        int from {step_square(square, step)};
+        if (from>=0 && squares[from]==knight) return true;
+    }
+    for (auto &step : king_steps){
+        int from {step_square(square, step)};
+        if (from>=0 && squares[from]==king) return true;
+    }
+    // Sliders: walk each line until the first piece
+    for (auto &step : straight_steps){
+        int from {step_square(square, step)};
+        while (from>=0 && squares[from]==no_piece) from = step_square(from, step);
+        if (from>=0 && (squares[from]==rook || squares[from]==queen)) return true;
+    }
+    for (auto &step : diagonal_steps){
+        int from {step_square(square, step)};
+        while (from>=0 && squares[from]==no_piece) from = step_square(from, step);
+        if (from>=0 && (squares[from]==bishop || squares[from]==queen)) return true;
+    }
+    return false;
+}
+
+bool compact_board::is_attacked(int square, chess_vars::player_color by) const
+{
+    return by==chess_vars::white ? attacked_by<chess_vars::white>(square) : attacked_by<chess_vars::black>(square);
+}
+
+template<chess_vars::player_color us>
+void compact_board::add_pawn_moves(std::vector<compact_move> &moves, int from, bool captures_only) const
+{
+    using side = side_constants<us>;
+    const chess_vars::piece_type promotions[4] { chess_vars::queen, chess_vars::rook, chess_vars::bishop, chess_vars::knight };
+
+    auto add = [&moves, &promotions](int from_, int to_, uint8_t flags){
+        if (to_/8==side::last_rank){
+            for (auto type : promotions){
+                moves.push_back(compact_move{static_cast<uint8_t>(from_), static_cast<uint8_t>(to_), static_cast<uint8_t>(type), flags});
+            }
+        } else {
+            moves.push_back(compact_move{static_cast<uint8_t>(from_), static_cast<uint8_t>(to_), chess_vars::nancy_rothwell, flags});
+        }
+    };
+
+    // Captures, including en-passant. A pawn never stands on its last rank, so only the files can run off the board.
+    for (int dx : {-1, 1}){
+        if ((dx<0 && from%8==0) || (dx>0 && from%8==7)) continue;
+        int to {from + side::forward + dx};
+        if (squares[to]!=no_piece && code_color(squares[to])==side::them){
+            add(from, to, capture_move);
+        } else if (to==ep_square){
+            add(from, to, en_passant_move);
+        }
+    }
+    // Pushes: promotions are kept with the captures as they change the material
+    int one_step {from + side::forward};
+    if (squares[one_step]==no_piece){
+        if (!captures_only || one_step/8==side::last_rank){
+            add(from, one_step, quiet_move);
+        }
+        int two_steps {from + 2*side::forward};
+        if (!captures_only && from/8==side::start_rank && squares[two_steps]==no_piece){
+            add(from, two_steps, double_push_move);
+        }
+    }
+}
+
+template<chess_vars::player_color us>
+void compact_board::add_piece_moves(std::vector<compact_move> &moves, int from, bool captures_only) const
+{
+    auto try_square = [this, &moves, from, captures_only](int to){
+        if (squares[to]==no_piece){
+            if (!captures_only) moves.push_back(compact_move{static_cast<uint8_t>(from), static_cast<uint8_t>(to), chess_vars::nancy_rothwell, quiet_move});
+            return true; // Empty: a slider may keep going
+        }
+        if (code_color(squares[to])!=us){
+            moves.push_back(compact_move{static_cast<uint8_t>(from), static_cast<uint8_t>(to), chess_vars::nancy_rothwell, capture_move});
+        }
+        return false;
+    };
+
+    switch (code_type(squares[from]))
+    {
+    case chess_vars::knight:
+        for (auto &step : knight_steps){
+            int to {step_square(from, step)};
+            if (to>=0) try_square(to);
+        }
+        break;
+    case chess_vars::king:
+        for (auto &step : king_steps){
+            int to {step_square(from, step)};
+            if (to>=0) try_square(to);
+        }
+        break;
+    case chess_vars::rook:
+    case chess_vars::bishop:
+    case chess_vars::queen:
+        {
+            chess_vars::piece_type type {code_type(squares[from])};
+            if (type!=chess_vars::bishop){
+                for (auto &step : straight_steps){
+                    int to {step_square(from, step)};
+                    while (to>=0 && try_square(to)) to = step_square(to, step);
+                }
+            }
+            if (type!=chess_vars::rook){
+                for (auto &step : diagonal_steps){
+                    int to {step_square(from, step)};
+                    while (to>=0 && try_square(to)) to = step_square(to, step);
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+template<chess_vars::player_color us>
+void compact_board::add_castling_moves(std::vector<compact_move> &moves) const
+{
+    // Same conditions as king::can_castle: rights still held, squares in between empty, king not passing through a threatened square
+    using side = side_constants<us>;
+    constexpr int back {side::back};
+    if (!(castling & (side::k_right | side::q_right)) || attacked_by<side::them>(back+4)){
+        return;
+    }
+    if ((castling & side::k_right) && squares[back+5]==no_piece && squares[back+6]==no_piece
+        && !attacked_by<side::them>(back+5) && !attacked_by<side::them>(back+6)){
+        moves.push_back(compact_move{static_cast<uint8_t>(back+4), static_cast<uint8_t>(back+6), chess_vars::nancy_rothwell, castle_move});
+    }
+    if ((castling & side::q_right) && squares[back+3]==no_piece && squares[back+2]==no_piece && squares[back+1]==no_piece
+        && !attacked_by<side::them>(back+3) && !attacked_by<side::them>(back+2)){
+        moves.push_back(compact_move{static_cast<uint8_t>(back+4), static_cast<uint8_t>(back+2), chess_vars::nancy_rothwell, castle_move});
+    }
+}
+
+// Moves of the pieces of one side standing on one square, pawns apart (castling is added separately)
+template<chess_vars::player_color us>
+void compact_board::add_moves_from(std::vector<compact_move> &moves, int from, bool captures_only) const
+{
+    if (squares[from]==side_constants<us>::pawn){
+        add_pawn_moves<us>(moves, from, captures_only);
+    } else {
+        add_piece_moves<us>(moves, from, captures_only);
+    }
+}
+
+template<chess_vars::player_color us>
+void compact_board::pseudo_legal_moves(std::vector<compact_move> &moves, bool captures_only) const
+{
+    for (uint64_t pawns {piece_sets[us][chess_vars::pawn]}; pawns!=0; pawns &= pawns - 1){
+        add_pawn_moves<us>(moves, lowest_square(pawns), captures_only);
+    }
+    for (int type {chess_vars::rook}; type<=chess_vars::king; type++){
+        for (uint64_t set {piece_sets[us][type]}; set!=0; set &= set - 1){
+            add_piece_moves<us>(moves, lowest_square(set), captures_only);
+        }
+    }
+    if (!captures_only){
+        add_castling_moves<us>(moves);
+    }
+}
+
+// The side to move is picked once here: everything below runs in the instantiation for that side
+void compact_board::generate_pseudo_legal(std::vector<compact_move> &moves, bool captures_only) const
+{
+    if (to_move==chess_vars::white){
+        pseudo_legal_moves<chess_vars::white>(moves, captures_only);
+    } else {
+        pseudo_legal_moves<chess_vars::black>(moves, captures_only);
+    }
+}
+
+// A pseudo-legal move is legal if it does not leave the mover's king threatened
+// Pseudo-legal moves of the pieces of one type only (castling with the king)
+void compact_board::generate_pseudo_legal(std::vector<compact_move> &moves, chess_vars::piece_type type) const
+{
+    for (uint64_t set {piece_sets[to_move][type]}; set!=0; set &= set - 1){
+        generate_pseudo_legal_from(lowest_square(set), moves);
+    }
+}
+
+// Pseudo-legal moves of the piece of the side to move on one square (castling with the king)
+void compact_board::generate_pseudo_legal_from(int square, std::vector<compact_move> &moves) const
+{
+    if (squares[square]==no_piece || code_color(squares[square])!=to_move) return;
+    bool white {to_move==chess_vars::white};
+    if (white){
+        add_moves_from<chess_vars::white>(moves, square, false);
+    } else {
+        add_moves_from<chess_vars::black>(moves, square, false);
+    }
+    if (square==king_square[to_move]){
+        if (white){
+            add_castling_moves<chess_vars::white>(moves);
+        } else {
+            add_castling_moves<chess_vars::black>(moves);
+        }
+    }
+}
+
+template<chess_vars::player_color us>
+bool compact_board::leaves_king_safe(const compact_move &m) const
+{
+    compact_board after {*this};
+    after.play<us>(m);
+    return !after.attacked_by<side_constants<us>::them>(after.king_square[us]);
+}
+
+bool compact_board::is_legal(const compact_move &m) const
+{
+    return to_move==chess_vars::white ? leaves_king_safe<chess_vars::white>(m) : leaves_king_safe<chess_vars::black>(m);
+}
+
+void compact_board::find_threats(threat_map &map) const
+{
+    if (to_move==chess_vars::white){
+        threats<chess_vars::white>(map);
+    } else {
+        threats<chess_vars::black>(map);
+    }
+}
+
+bool compact_board::is_legal(const compact_move &m, const threat_map &map) const
+{
+    return to_move==chess_vars::white ? keeps_king_safe<chess_vars::white>(m, map) : keeps_king_safe<chess_vars::black>(m, map);
+}
+
+// One pass over the opponent's pieces. Each ray of a slider is walked once, past the first piece of the side to move
+// to see if it is pinned, and one square past the king so that the king cannot step back along the ray.
+template<chess_vars::player_color us>
+void compact_board::threats(threat_map &map) const
+{
+    constexpr chess_vars::player_color them {side_constants<us>::them};
+    const int king {king_square[us]};
+    auto bit = [](int square){ return uint64_t{1} << square; };
+    // A square reached by a pawn, knight or king of theirs
+    auto hit = [&](int from, int to){
+        if (squares[to]!=no_piece && code_color(squares[to])==them){
+            map.defended |= bit(to);
+            return;
+        }
+        map.attacked |= bit(to);
+        if (to==king){
+            map.checkers |= bit(from);
+            map.check_blocks |= bit(from);
+        }
+    };
+    auto walk = [&](int from, const int step[2]){
+        uint64_t ray{}; // Empty squares walked so far
+        int to {step_square(from, step)};
+        while (to>=0 && squares[to]==no_piece){
+            ray |= bit(to);
+            to = step_square(to, step);
+        }
+        if (to<0) {
+            map.attacked |= ray;
+            return;
+        }
+        if (code_color(squares[to])==them){
+            map.attacked |= ray;
+            map.defended |= bit(to);
+            return;
+        }
+        map.attacked |= ray | bit(to);
+        int beyond {step_square(to, step)};
+        if (to==king){
+            map.checkers |= bit(from);
+            map.check_blocks |= ray | bit(from);
+            if (beyond>=0){
+                if (squares[beyond]==no_piece) map.attacked |= bit(beyond);
+                else if (code_color(squares[beyond])==them) map.defended |= bit(beyond);
+            }
+            return;
+        }
+        // A piece of the side to move: pinned if the king stands behind it
+        uint64_t behind{};
+        while (beyond>=0 && squares[beyond]==no_piece){
+            behind |= bit(beyond);
+            beyond = step_square(beyond, step);
+        }
+        if (beyond==king){
+            map.pinned |= bit(to);
+            map.pin_square[map.pins] = static_cast<uint8_t>(to);
+            map.pin_ray[map.pins++] = ray | behind | bit(from);
+        }
+    };
+
+    for (uint64_t set {piece_sets[them][chess_vars::pawn]}; set!=0; set &= set - 1){
+        int from {lowest_square(set)};
+        for (int dx : {-1, 1}){
+            int step[2] {dx, side_constants<them>::forward/8};
+            int to {step_square(from, step)};
+            if (to>=0) hit(from, to);
+        }
+    }
+    for (uint64_t set {piece_sets[them][chess_vars::knight]}; set!=0; set &= set - 1){
+        int from {lowest_square(set)};
+        for (auto &step : knight_steps){
+            int to {step_square(from, step)};
+            if (to>=0) hit(from, to);
+        }
+    }
+    {
+        int from {king_square[them]};
+        for (auto &step : king_steps){
+            int to {step_square(from, step)};
+            if (to>=0) hit(from, to);
+        }
+    }
+    for (uint64_t set {piece_sets[them][chess_vars::rook] | piece_sets[them][chess_vars::queen]}; set!=0; set &= set - 1){
+        for (auto &step : straight_steps) walk(lowest_square(set), step);
+    }
+    for (uint64_t set {piece_sets[them][chess_vars::bishop] | piece_sets[them][chess_vars::queen]}; set!=0; set &= set - 1){
+        for (auto &step : diagonal_steps) walk(lowest_square(set), step);
+    }
+}
+
+// Whether a pseudo-legal move leaves the king safe, read from the threats. En-passant, which takes a piece off a second
+// square, is still tried on a copy of the board.
+template<chess_vars::player_color us>
+bool compact_board::keeps_king_safe(const compact_move &m, const threat_map &map) const
+{
+    uint64_t to {uint64_t{1} << m.to};
+    if (m.from==king_square[us]){
+        // Castling was checked square by square when it was generated
+        return (m.flags & castle_move) || !((map.attacked | map.defended) & to);
+    }
+    if (m.flags & en_passant_move){
+        return leaves_king_safe<us>(m);
+    }
+    if (map.checkers!=0){
+        // Only the king can answer a double check
+        if ((map.checkers & (map.checkers - 1)) || !(map.check_blocks & to)) return false;
+    }
+    if (map.pinned & (uint64_t{1} << m.from)){
+        for (int p{}; p<map.pins; p++){
+            if (map.pin_square[p]==m.from) return (map.pin_ray[p] & to)!=0;
+        }
+    }
+    return true;
+}
+
+template<chess_vars::player_color us>
+void compact_board::legal_moves(std::vector<compact_move> &moves, bool captures_only) const
+{
+    threat_map map;
+    threats<us>(map);
+    std::vector<compact_move> candidates;
+    pseudo_legal_moves<us>(candidates, captures_only);
+    for (auto &m : candidates){
+        if (keeps_king_safe<us>(m, map)) moves.push_back(m);
+    }
+}
+
+void compact_board::generate_legal(std::vector<compact_move> &moves, bool captures_only) const
+{
+    if (to_move==chess_vars::white){
+        legal_moves<chess_vars::white>(moves, captures_only);
+    } else {
+        legal_moves<chess_vars::black>(moves, captures_only);
+    }
+}
+
+template<chess_vars::player_color us>
+bool compact_board::any_legal_move() const
+{
+    threat_map map;
+    threats<us>(map);
+    std::vector<compact_move> candidates;
+    pseudo_legal_moves<us>(candidates, false);
+    for (auto &m : candidates){
+        if (keeps_king_safe<us>(m, map)) return true;
+    }
+    return false;
+}
+
+bool compact_board::has_legal_move() const
+{
+    return to_move==chess_vars::white ? any_legal_move<chess_vars::white>() : any_legal_move<chess_vars::black>();
+}
+
+template<chess_vars::player_color us>
+void compact_board::play(const compact_move &m)
+{
+    uint8_t moving {squares[m.from]};
+    bool pawn_move {moving==side_constants<us>::pawn};
+
+    if (pawn_move || squares[m.to]!=no_piece || (m.flags & en_passant_move)){
+        halfmove_clock = 0;
+    } else if (halfmove_clock<255){
+        halfmove_clock++;
+    }
+
+    if (m.flags & en_passant_move){
+        lift(m.to - side_constants<us>::forward);
+    }
+    if (m.flags & castle_move){
+        // Rook jumps over the king: h-file rook to f-file, a-file rook to d-file
+        int rook_from { m.to > m.from ? m.from+3 : m.from-4 };
+        int rook_to { m.to > m.from ? m.from+1 : m.from-1 };
+        place(rook_to, squares[rook_from]);
+        lift(rook_from);
+    }
+
+    if (squares[m.to]!=no_piece) lift(m.to);
+    lift(m.from);
+    place(m.to, m.is_promotion() ? piece_code(us, static_cast<chess_vars::piece_type>(m.promotion)) : moving);
+    if (code_type(moving)==chess_vars::king){
+        king_square[us] = m.to;
+    }
+
+    castling &= ~(castling_mask(m.from) | castling_mask(m.to));
+    ep_square = (m.flags & double_push_move) ? static_cast<int8_t>((m.from + m.to)/2) : -1;
+
+    if (us==chess_vars::black){
+        fullmove_number++;
+    }
+    to_move = side_constants<us>::them;
+}
+
+// Apply a move generated for this board. No legality checks are made here.
+void compact_board::make_move(const compact_move &m)
+{
+    if (to_move==chess_vars::white){
+        play<chess_vars::white>(m);
+    } else {
+        play<chess_vars::black>(m);
+    }
+}
+
+void compact_board::make_move(const compact_move &m, undo_record &undo)
+{
+    undo.move = m;
+    undo.captured = (m.flags & en_passant_move) ? piece_code(switch_player(to_move), chess_vars::pawn) : squares[m.to];
+    undo.castling = castling;
+    undo.ep_square = ep_square;
+    undo.halfmove_clock = halfmove_clock;
+    make_move(m);
+}
+
+// The reverse of play: us is the side which made the move
+template<chess_vars::player_color us>
+void compact_board::take_back(const undo_record &undo)
+{
+    using side = side_constants<us>;
+    const compact_move &m {undo.move};
+    uint8_t moved { m.is_promotion() ? side::pawn : squares[m.to] };
+    lift(m.to);
+    place(m.from, moved);
+    if (code_type(moved)==chess_vars::king){
+        king_square[us] = m.from;
+    }
+    if (undo.captured!=no_piece){
+        place((m.flags & en_passant_move) ? m.to - side::forward : m.to, undo.captured);
+    }
+    if (m.flags & castle_move){
+        int rook_from { m.to > m.from ? m.from+3 : m.from-4 };
+        int rook_to { m.to > m.from ? m.from+1 : m.from-1 };
+        place(rook_from, squares[rook_to]);
+        lift(rook_to);
+    }
+
+    castling = undo.castling;
+    ep_square = undo.ep_square;
+    halfmove_clock = undo.halfmove_clock;
+    if (us==chess_vars::black){
+        fullmove_number--;
+    }
+    to_move = us;
+}
+
+// Take back the last move made on this board, with the record filled in when it was made
+void compact_board::unmake_move(const undo_record &undo)
+{
+    if (to_move==chess_vars::black){
+        take_back<chess_vars::white>(undo);
+    } else {
+        take_back<chess_vars::black>(undo);
+    }
+}
+
+// Number of positions reached after depth plies (perft): the usual check of a move generator against published counts,
+// and a benchmark of it. The moves are made and taken back on one board, which checks unmake_move as well.
+uint64_t perft_on(compact_board &board, int depth)
+{
+    if (depth<=0) return 1;
+    std::vector<compact_move> moves;
+    board.generate_legal(moves);
+    if (depth==1) return moves.size();
+    uint64_t nodes{};
+    undo_record undo;
+    for (auto &m : moves){
+        board.make_move(m, undo);
+        nodes += perft_on(board, depth-1);
+        board.unmake_move(undo);
+    }
+    return nodes;
+}
+
+uint64_t perft(const compact_board &board, int depth)
+{
+    compact_board scratch {board};
+    return perft_on(scratch, depth);
+}
@@ -0,0 +1,528 @@
+// Search engine, part of the C++ Chess Project.
+// Negamax alpha-beta with:
+// - iterative deepening, the transposition table move searched first at every node
+// - captures ordered by most valuable victim / least valuable attacker, then killer moves
+// - check extension and a quiescence search over captures and promotions
+// Evaluation: material and piece-square tables, from the point of view of the side to move.
+
+#include <algorithm>
+
+#include "engine.h"
+#include "compact_board.h"
+#include "opening_book.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Evaluation %%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+// Indexed by chess_vars::piece_type: pawn, rook, knight, bishop, queen, king
+const int piece_value[6] {100, 500, 320, 330, 900, 0};
+
+// Piece-square tables for white, a1 first (i.e. rank 1 on the first line). Black uses the mirrored square.
+const int square_bonus[6][64] {
+    { // Pawn
+        0,  0,  0,  0,  0,  0,  0,  0,
+        5, 10, 10,-20,-20, 10, 10,  5,
+        5, -5,-10,  0,  0,-10, -5,  5,
+        0,  0,  0, 20, 20,  0,  0,  0,
+        5,  5, 10, 25, 25, 10,  5,  5,
+       10, 10, 20, 30, 30, 20, 10, 10,
+       50, 50, 50, 50, 50, 50, 50, 50,
+        0,  0,  0,  0,  0,  0,  0,  0 },
+    { // Rook
+        0,  0,  0,  5,  5,  0,  0,  0,
+       -5,  0,  0,  0,  0,  0,  0, -5,
+       -5,  0,  0,  0,  0,  0,  0, -5,
+       -5,  0,  0,  0,  0,  0,  0, -5,
+       -5,  0,  0,  0,  0,  0,  0, -5,
+       -5,  0,  0,  0,  0,  0,  0, -5,
+        5, 10, 10, 10, 10, 10, 10,  5,
+        0,  0,  0,  0,  0,  0,  0,  0 },
+    { // Knight
+      -50,-40,-30,-30,-30,-30,-40,-50,
+      -40,-20,  0,  5,  5,  0,-20,-40,
+      -30,  5, 10, 15, 15, 10,  5,-30,
+      -30,  0, 15, 20, 20, 15,  0,-30,
+      -30,  5, 15, 20, 20, 15,  5,-30,
+      -30,  0, 10, 15, 15, 10,  0,-30,
+      -40,-20,  0,  0,  0,  0,-20,-40,
+      -50,-40,-30,-30,-30,-30,-40,-50 },
+    { // Bishop
+      -20,-10,-10,-10,-10,-10,-10,-20,
+      -10,  5,  0,  0,  0,  0,  5,-10,
+      -10, 10, 10, 10, 10, 10, 10,-10,
+      -10,  0, 10, 10, 10, 10,  0,-10,
+      -10,  5,  5, 10, 10,  5,  5,-10,
+      -10,  0,  5, 10, 10,  5,  0,-10,
+      -10,  0,  0,  0,  0,  0,  0,-10,
+      -20,-10,-10,-10,-10,-10,-10,-20 },
+    { // Queen
+      -20,-10,-10, -5, -5,-10,-10,-20,
+      -10,  0,  5,  0,  0,  0,  0,-10,
+      -10,  5,  5,  5,  5,  5,  0,-10,
+        0,  0,  5,  5,  5,  5,  0, -5,
+       -5,  0,  5,  5,  5,  5,  0, -5,
+      -10,  0,  5,  5,  5,  5,  0,-10,
+      -10,  0,  0,  0,  0,  0,  0,-10,
+      -20,-10,-10, -5, -5,-10,-10,-20 },
+    { // King, while there is material left: stay behind the pawns
+       20, 30, 10,  0,  0, 10, 30, 20,
+       20, 20,  0,  0,  0,  0, 20, 20,
+      -10,-20,-20,-20,-20,-20,-20,-10,
+      -20,-30,-30,-40,-40,-30,-30,-20,
+      -30,-40,-40,-50,-50,-40,-40,-30,
+      -30,-40,-40,-50,-50,-40,-40,-30,
+      -30,-40,-40,-50,-50,-40,-40,-30,
+      -30,-40,-40,-50,-50,-40,-40,-30 }
+};
+// King in the endgame: go to the centre
+const int king_endgame_bonus[64] {
+    -50,-30,-30,-30,-30,-30,-30,-50,
+    -30,-30,  0,  0,  0,  0,-30,-30,
+    -30,-10, 20, 30, 30, 20,-10,-30,
+    -30,-10, 30, 40, 40, 30,-10,-30,
+    -30,-10, 30, 40, 40, 30,-10,-30,
+    -30,-10, 20, 30, 30, 20,-10,-30,
+    -30,-20,-10,  0,  0,-10,-20,-30,
+    -50,-40,-30,-20,-20,-30,-40,-50 };
+
+int evaluate(const compact_board &board)
+{
+    int score[2]{}, pieces_material{};
+    for (int sq{}; sq<64; sq++){
+        uint8_t code {board.at(sq)};
+        if (code==no_piece) continue;
+        chess_vars::piece_type type {code_type(code)};
+        chess_vars::player_color color {code_color(code)};
+        int relative { color==chess_vars::white ? sq : sq^56 };
+        score[color] += piece_value[type];
+        if (type!=chess_vars::king) score[color] += square_bonus[type][relative];
+        if (type!=chess_vars::pawn) pieces_material += piece_value[type];
+    }
+    // Kings: blend between the middlegame and endgame tables as the pieces come off
+    const int opening_material {2*(2*320 + 2*330 + 2*500 + 900)};
+    int phase {std::min(pieces_material, opening_material)};
+    for (int color{}; color<2; color++){
+        int sq {board.king_location(static_cast<chess_vars::player_color>(color))};
+        int relative { color==chess_vars::white ? sq : sq^56 };
+        score[color] += (square_bonus[chess_vars::king][relative]*phase + king_endgame_bonus[relative]*(opening_material - phase)) / opening_material;
+    }
+    chess_vars::player_color player {board.side_to_move()};
+    return score[player] - score[switch_player(player)];
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Transposition table %%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+const uint8_t bound_exact {0}, bound_lower {1}, bound_upper {2};
+
+// Number of slots: largest power of two fitting in the requested size
+void engine::set_hash_size(size_t megabytes)
+{
+    stop();
+    size_t slots {1024};
+    while (slots*2*sizeof(tt_slot) <= megabytes*1024*1024) slots *= 2;
+    table.reset(new tt_slot[slots]);
+    table_size = slots;
+}
+
+void engine::clear_hash()
+{
+    stop();
+    for (size_t i{}; i<table_size; i++){
+        table[i].check.store(0, std::memory_order_relaxed);
+        table[i].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Packing: move (from, to, promotion, flags) in the low 32 bits, then score, depth + 1 (0 for an empty slot) and bound
+uint64_t pack_entry(const tt_entry &entry)
+{
+    return static_cast<uint64_t>(entry.move.from) | static_cast<uint64_t>(entry.move.to) << 8
+         | static_cast<uint64_t>(entry.move.promotion) << 16 | static_cast<uint64_t>(entry.move.flags) << 24
+         | static_cast<uint64_t>(static_cast<uint16_t>(entry.score)) << 32
+         | static_cast<uint64_t>(static_cast<uint8_t>(entry.depth + 1)) << 48 | static_cast<uint64_t>(entry.bound) << 56;
+}
+
+tt_entry unpack_entry(uint64_t data)
+{
+    tt_entry entry;
+    entry.move.from = data & 0xFF;
+    entry.move.to = (data >> 8) & 0xFF;
+    entry.move.promotion = (data >> 16) & 0xFF;
+    entry.move.flags = (data >> 24) & 0xFF;
+    entry.score = static_cast<int16_t>((data >> 32) & 0xFFFF);
+    entry.depth = static_cast<int8_t>(((data >> 48) & 0xFF) - 1);
+    entry.bound = (data >> 56) & 0xFF;
+    return entry;
+}
+
+bool engine::probe(uint64_t key, tt_entry &entry) const
+{
+    const tt_slot &slot {table[key & (table_size-1)]};
+    uint64_t data {slot.data.load(std::memory_order_relaxed)};
+    if ((slot.check.load(std::memory_order_relaxed) ^ data)!=key || data==0) return false;
+    entry = unpack_entry(data);
+    return true;
+}
+
+// Mate scores are stored relative to the node, so that they stay valid wherever the position is found again
+void engine::store(uint64_t key, int depth, int score, uint8_t bound, const compact_move &m, int ply)
+{
+    tt_slot &slot {table[key & (table_size-1)]};
+    tt_entry entry;
+    if (probe(key, entry) && entry.depth>depth && bound!=bound_exact) return;
+    if (score > mate_score - max_search_depth) score += ply;
+    if (score < -mate_score + max_search_depth) score -= ply;
+    entry.move = m;
+    entry.score = static_cast<int16_t>(score);
+    entry.depth = static_cast<int8_t>(depth);
+    entry.bound = bound;
+    uint64_t data {pack_entry(entry)};
+    slot.check.store(key ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Search %%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+int64_t steady_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t engine::elapsed_ms() const
+{
+    return steady_ms() - start_ms.load();
+}
+
+// Checked at every node: the stop flags are relaxed atomic loads, the clock and the node total are only read every 1024 nodes
+bool search_thread::out_of_time()
+{
+    if (aborted) return true;
+    if (owner.stop_requested.load(std::memory_order_relaxed) || (helper && owner.helpers_stop.load(std::memory_order_relaxed))){
+        aborted = true;
+    } else if ((node_count & 1023)==0){
+        uint64_t total {owner.total_nodes.fetch_add(node_count - published_nodes, std::memory_order_relaxed) + node_count - published_nodes};
+        published_nodes = node_count;
+        int64_t deadline {owner.deadline_ms.load(std::memory_order_relaxed)};
+        aborted = (deadline>0 && owner.elapsed_ms()>=deadline) || (owner.node_limit>0 && total>=owner.node_limit);
+    }
+    return aborted;
+}
+
+void search_thread::order_moves(const compact_board &board, std::vector<compact_move> &moves, const compact_move &tt_move, int ply) const
+{
+    std::vector<std::pair<int, compact_move>> scored;
+    scored.reserve(moves.size());
+    for (auto &m : moves){
+        int score{};
+        if (m==tt_move){
+            score = 1000000;
+        } else if (m.is_capture()){
+            int victim { (m.flags & en_passant_move) ? piece_value[chess_vars::pawn] : piece_value[code_type(board.at(m.to))] };
+            score = 100000 + 10*victim - piece_value[code_type(board.at(m.from))]/10;
+        } else if (m.is_promotion()){
+            score = 90000 + piece_value[m.promotion];
+        } else if (m==killers[ply][0] || m==killers[ply][1]){
+            score = 80000;
+        }
+        scored.push_back({score, m});
+    }
+    std::stable_sort(scored.begin(), scored.end(), [](const std::pair<int, compact_move> &a, const std::pair<int, compact_move> &b){
+        return a.first > b.first;
+    });
+    for (size_t i{}; i<moves.size(); i++) moves[i] = scored[i].second;
+}
+
+// Only captures (and promotions) until the position is quiet. The side to move may also stand pat.
+int search_thread::quiescence(compact_board &board, int alpha, int beta, int ply)
+{
+    node_count++;
+    if (out_of_time()) return 0;
+    int stand_pat {evaluate(board)};
+    if (stand_pat>=beta || ply>=max_search_depth) return stand_pat;
+    alpha = std::max(alpha, stand_pat);
+
+    std::vector<compact_move> moves;
+    board.generate_pseudo_legal(moves, true);
+    order_moves(board, moves, compact_move(), ply);
+    chess_vars::player_color player {board.side_to_move()};
+    undo_record undo;
+    for (auto &m : moves){
+        board.make_move(m, undo);
+        if (board.is_attacked(board.king_location(player), board.side_to_move())){
+            board.unmake_move(undo);
+            continue;
+        }
+        int score {-quiescence(board, -beta, -alpha, ply+1)};
+        board.unmake_move(undo);
+        if (aborted) return 0;
+        if (score>=beta) return score;
+        alpha = std::max(alpha, score);
+    }
+    return alpha;
+}
+
+// The moves are made and taken back on the one board, which is as it was on return
+int search_thread::alpha_beta(compact_board &board, int depth, int alpha, int beta, int ply)
+{
+    uint64_t key {polyglot_key(board)};
+    if (ply>0){
+        if (board.halfmoves()>=100 || board.insufficient_material()) return 0;
+        // Repetition of a position of the game or of the current line: scored as a draw
+        int halfmoves {board.halfmoves()};
+        for (int i {static_cast<int>(path.size())-2}; i>=0 && halfmoves>=2; i-=2, halfmoves-=2){
+            if (path[i]==key) return 0;
+        }
+    }
+    bool in_check {board.in_check()};
+    if (in_check) depth++;
+    if (depth<=0 || ply>=max_search_depth) return quiescence(board, alpha, beta, ply);
+
+    node_count++;
+    if (out_of_time()) return 0;
+
+    compact_move tt_move;
+    tt_entry entry;
+    if (owner.probe(key, entry)){
+        tt_move = entry.move;
+        int score {entry.score};
+        if (score > mate_score - max_search_depth) score -= ply;
+        if (score < -mate_score + max_search_depth) score += ply;
+        if (ply>0 && entry.depth>=depth){
+            if (entry.bound==bound_exact) return score;
+            if (entry.bound==bound_lower && score>=beta) return score;
+            if (entry.bound==bound_upper && score<=alpha) return score;
+        }
+    }
+
+    std::vector<compact_move> moves;
+    board.generate_pseudo_legal(moves);
+    order_moves(board, moves, tt_move, ply);
+
+    int original_alpha {alpha}, best {-infinite_score}, legal_moves{};
+    compact_move best_move;
+    chess_vars::player_color player {board.side_to_move()};
+    path.push_back(key);
+    undo_record undo;
+    for (auto &m : moves){
+        if (ply==0 && std::find(excluded_root.begin(), excluded_root.end(), m)!=excluded_root.end()) continue;
+        board.make_move(m, undo);
+        if (board.is_attacked(board.king_location(player), board.side_to_move())){
+            board.unmake_move(undo);
+            continue;
+        }
+        legal_moves++;
+        int score {-alpha_beta(board, depth-1, -beta, -alpha, ply+1)};
+        board.unmake_move(undo);
+        if (aborted) break;
+        if (score>best){
+            best = score;
+            best_move = m;
+            if (ply==0) root_best = m;
+        }
+        if (score>alpha) alpha = score;
+        if (alpha>=beta){
+            if (!m.is_capture() && !m.is_promotion() && !(m==killers[ply][0])){
+                killers[ply][1] = killers[ply][0];
+                killers[ply][0] = m;
+            }
+            break;
+        }
+    }
+    path.pop_back();
+    if (aborted) return 0;
+
+    if (legal_moves==0){
+        return in_check ? -mate_score + ply : 0;
+    }
+    uint8_t bound { best<=original_alpha ? bound_upper : (best>=beta ? bound_lower : bound_exact) };
+    if (ply>0 || excluded_root.empty()){ // A root searched without some of its moves would store a wrong score
+        owner.store(key, depth, best, bound, best_move, ply);
+    }
+    return best;
+}
+
+// Follow the transposition table moves from the best move, as long as they are legal
+std::vector<compact_move> search_thread::principal_variation(const compact_board &board, const compact_move &first)
+{
+    std::vector<compact_move> pv {first};
+    compact_board current {board};
+    current.make_move(first);
+    while (pv.size()<static_cast<size_t>(max_search_depth)){
+        tt_entry entry;
+        if (!owner.probe(polyglot_key(current), entry) || entry.depth<0) break;
+        std::vector<compact_move> legal;
+        current.generate_legal(legal);
+        if (std::find(legal.begin(), legal.end(), entry.move)==legal.end()) break;
+        pv.push_back(entry.move);
+        current.make_move(entry.move);
+        if (pv.size()>static_cast<size_t>(last_depth)) break;
+    }
+    return pv;
+}
+
+// Iterative deepening from depth 1. The result of an interrupted iteration is dropped.
+// Helper threads start one depth further every other thread, so that they do not all search the same tree in step.
+search_result search_thread::run(const compact_board &board, const search_limits &limits,
+                                 const std::function<void(const search_result&)> &on_iteration)
+{
+    search_result result;
+    path = owner.game_history;
+
+    std::vector<compact_move> legal;
+    board.generate_legal(legal);
+    if (legal.empty()) return result;
+    // Something to play even if the first iteration is interrupted
+    result.best = legal.front();
+    result.pv = {legal.front()};
+
+    int max_depth { limits.depth>0 ? std::min(limits.depth, max_search_depth) : max_search_depth };
+    size_t lines_wanted { std::min(legal.size(), static_cast<size_t>(std::max(limits.multi_pv, 1))) };
+    bool infinite { limits.depth==0 && limits.movetime_ms==0 && limits.nodes==0 };
+    compact_board root {board}; // Searched by making and taking back moves
+    for (int depth{1 + index%2}; depth<=max_depth; depth++){
+        last_depth = depth;
+        // Multi-PV: each line is searched with the first moves of the better lines excluded at the root
+        std::vector<search_line> lines;
+        excluded_root.clear();
+        while (lines.size()<lines_wanted){
+            root_best = compact_move();
+            int line_score {alpha_beta(root, depth, -infinite_score, infinite_score, 0)};
+            if (aborted) break;
+            lines.push_back({line_score, principal_variation(board, root_best)});
+            excluded_root.push_back(root_best);
+        }
+        excluded_root.clear();
+        if (aborted) break;
+        std::stable_sort(lines.begin(), lines.end(), [](const search_line &a, const search_line &b){ return a.score > b.score; });
+        int score {lines.front().score};
+
+        result.best = lines.front().pv.front();
+        result.score = score;
+        result.depth = depth;
+        result.nodes = owner.total_nodes.load() + node_count - published_nodes;
+        result.seconds = owner.elapsed_ms()/1000.0;
+        result.pv = lines.front().pv;
+        result.lines = lines;
+        result.found = true;
+        if (!helper){
+            {
+                std::lock_guard<std::mutex> lock(owner.result_mutex);
+                owner.last_result = result;
+            }
+            if (on_iteration) on_iteration(result);
+        }
+
+        // A forced mate was found, or the next iteration would not have the time to finish
+        if (!infinite && std::abs(score) > mate_score - max_search_depth && mate_score - std::abs(score) <= depth) break;
+        int64_t deadline {owner.deadline_ms.load()};
+        if (deadline>0 && owner.elapsed_ms() > deadline/2) break;
+    }
+    owner.total_nodes += node_count - published_nodes;
+    published_nodes = node_count;
+    return result;
+}
+
+// The main thread searches with the limits and reports; the helpers run until it is done
+search_result engine::run(const compact_board &board, const search_limits &limits,
+                          const std::function<void(const search_result&)> &on_iteration)
+{
+    total_nodes = 0;
+    helpers_stop = false;
+    search_limits helper_limits {limits};
+    helper_limits.multi_pv = 1;
+    std::vector<std::thread> helpers;
+    for (unsigned t{1}; t<thread_count; t++){
+        helpers.emplace_back([this, &board, helper_limits, t]{
+            std::unique_ptr<search_thread> helper {new search_thread(*this, static_cast<int>(t))};
+            helper->run(board, helper_limits, nullptr);
+        });
+    }
+    std::unique_ptr<search_thread> main_thread {new search_thread(*this, 0)};
+    search_result result {main_thread->run(board, limits, on_iteration)};
+    helpers_stop = true;
+    for (auto &helper : helpers) helper.join();
+
+    result.nodes = total_nodes.load();
+    result.seconds = elapsed_ms()/1000.0;
+    std::lock_guard<std::mutex> lock(result_mutex);
+    if (!result.found) last_result = result;
+    last_result.nodes = result.nodes;
+    last_result.seconds = result.seconds;
+    return result;
+}
+
+search_result engine::think(const compact_board &board, const search_limits &limits,
+                            const std::function<void(const search_result&)> &on_iteration)
+{
+    stop();
+    start_ms = steady_ms();
+    deadline_ms = limits.movetime_ms;
+    node_limit = limits.nodes;
+    return run(board, limits, on_iteration);
+}
+
+void engine::start(const compact_board &board, const search_limits &limits,
+                   const std::function<void(const search_result&)> &on_iteration,
+                   const std::function<void(const search_result&)> &on_finish)
+{
+    stop();
+    start_ms = steady_ms();
+    deadline_ms = limits.movetime_ms;
+    node_limit = limits.nodes;
+    {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        last_result = search_result();
+    }
+    worker = std::thread([this, board, limits, on_iteration, on_finish]{
+        search_result result {run(board, limits, on_iteration)};
+        if (on_finish) on_finish(result);
+    });
+}
+
+// Safe cancel: the search sees the flag at its next node, then the thread is joined
+void engine::stop()
+{
+    stop_requested = true;
+    if (worker.joinable()) worker.join();
+    stop_requested = false;
+}
+
+search_result engine::wait()
+{
+    if (worker.joinable()) worker.join();
+    return current_result();
+}
+
+// Give a search without limits a total search time, counted from its start: a pondering search which ran longer stops at once
+void engine::set_movetime(int64_t movetime_ms)
+{
+    deadline_ms = std::max<int64_t>(movetime_ms, 1);
+}
+
+search_result engine::current_result()
+{
+    std::lock_guard<std::mutex> lock(result_mutex);
+    return last_result;
+}
+
+// Score for display, from the side to move: pawns (e.g. +0.35) or moves to mate (e.g. M3, -M2)
+std::string score_to_string(int score)
+{
+    std::stringstream text;
+    if (std::abs(score) > mate_score - max_search_depth){
+        int moves_to_mate { (mate_score - std::abs(score) + 1)/2 };
+        text<<(score<0 ? "-M" : "M")<<moves_to_mate;
+    } else {
+        text<<(score<0 ? "-" : "+")<<std::abs(score)/100<<"."<<(std::abs(score)%100<10 ? "0" : "")<<std::abs(score)%100;
+    }
+    return text.str();
+}
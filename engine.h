@@ -0,0 +1,166 @@
+// Search engine, part of the C++ Chess Project.
+// Plays the computer's moves:
+// - iterative deepening alpha-beta search with quiescence, making and taking back moves on one compact_board
+// - transposition table shared by consecutive searches, so it stays warm between moves
+// - searches can run on a background thread (pondering) and be cancelled safely at any time
+// - extra threads search the same position and share what they find through the transposition table
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+#include "compact_board.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+const int mate_score {32000};   // Score of a mate at the root, minus one per ply
+const int infinite_score {32500};
+const int max_search_depth {64};
+
+// When to stop searching. Zero means no limit; a search without any limit runs until stopped.
+struct search_limits
+{
+    int depth{0};
+    int64_t movetime_ms{0};
+    uint64_t nodes{0};
+    int multi_pv{1}; // Number of best lines to report
+};
+
+struct search_line
+{
+    int score{};
+    std::vector<compact_move> pv;
+};
+
+// Outcome of the last completed iteration
+struct search_result
+{
+    compact_move best;
+    int score{};  // Centipawns for the side to move, or mate_score - plies to mate
+    int depth{};
+    uint64_t nodes{};
+    double seconds{};
+    std::vector<compact_move> pv; // Principal variation: best move, expected reply,...
+    std::vector<search_line> lines; // Multi-PV: best lines, best first (lines[0] is the principal variation)
+    bool found{false};
+
+    uint64_t nodes_per_second() const
+    {
+        return seconds>0 ? static_cast<uint64_t>(nodes/seconds) : nodes;
+    }
+};
+
+// Transposition table entry, as read from the table
+struct tt_entry
+{
+    compact_move move;
+    int16_t score{};
+    int8_t depth{-1};
+    uint8_t bound{};
+};
+
+// Table slot: the entry packed in 64 bits, and the position key xor-ed with it.
+// Threads share the table without locks: a slot half written by two threads no longer matches its key and is ignored.
+struct tt_slot
+{
+    std::atomic<uint64_t> check{0};
+    std::atomic<uint64_t> data{0};
+};
+
+class engine;
+
+// State of one searching thread. All threads search the same position; only the main one reports.
+class search_thread
+{
+    private:
+        engine &owner;
+        int index; // 0 for the main thread, which reports; the helpers only fill the transposition table
+        bool helper;
+        std::vector<uint64_t> path; // Keys of the positions from the start of the game, for repetitions
+        std::vector<compact_move> excluded_root; // Multi-PV: root moves of the lines already found at this depth
+        compact_move killers[max_search_depth+1][2];
+        uint64_t node_count{0}, published_nodes{0};
+        bool aborted{false};
+        compact_move root_best;
+        int last_depth{0};
+
+        bool out_of_time();
+        void order_moves(const compact_board &board, std::vector<compact_move> &moves, const compact_move &tt_move, int ply) const;
+        int quiescence(compact_board &board, int alpha, int beta, int ply);
+        int alpha_beta(compact_board &board, int depth, int alpha, int beta, int ply);
+        std::vector<compact_move> principal_variation(const compact_board &board, const compact_move &first);
+    public:
+        search_thread(engine &owner_, int index_): owner{owner_}, index{index_}, helper{index_>0}{}
+        search_result run(const compact_board &board, const search_limits &limits,
+                          const std::function<void(const search_result&)> &on_iteration);
+};
+
+class engine
+{
+    friend class search_thread;
+    private:
+        std::unique_ptr<tt_slot[]> table;
+        size_t table_size{0};
+        unsigned thread_count{1};
+        std::vector<uint64_t> game_history; // Keys of the positions played before the root
+        std::atomic<bool> stop_requested{false};
+        std::atomic<bool> helpers_stop{false}; // Set when the main thread is done
+        std::atomic<int64_t> start_ms{0};
+        std::atomic<int64_t> deadline_ms{0}; // Milliseconds after the start of the search, 0 for none
+        std::atomic<uint64_t> total_nodes{0}; // Nodes of all threads, published every 1024 nodes
+        uint64_t node_limit{0};
+
+        std::thread worker;
+        std::mutex result_mutex;
+        search_result last_result;
+
+        bool probe(uint64_t key, tt_entry &entry) const;
+        void store(uint64_t key, int depth, int score, uint8_t bound, const compact_move &m, int ply);
+        search_result run(const compact_board &board, const search_limits &limits,
+                          const std::function<void(const search_result&)> &on_iteration);
+    public:
+        engine(size_t hash_mb=16){ set_hash_size(hash_mb); }
+        ~engine(){ stop(); }
+        engine(const engine&) = delete;
+        engine &operator=(const engine&) = delete;
+
+        void set_hash_size(size_t megabytes);
+        void clear_hash();
+        void set_threads(unsigned threads)
+        {
+            stop();
+            thread_count = threads>0 ? threads : 1;
+        }
+        void set_history(const std::vector<uint64_t> &keys)
+        {
+            game_history = keys;
+        }
+
+        // Search on the calling thread. on_iteration is called after each completed depth.
+        search_result think(const compact_board &board, const search_limits &limits,
+                            const std::function<void(const search_result&)> &on_iteration = nullptr);
+
+        // Background search: start() returns at once, stop() cancels and waits for the thread, wait() waits for the limits.
+        // on_finish is called from the search thread with the final result.
+        void start(const compact_board &board, const search_limits &limits,
+                   const std::function<void(const search_result&)> &on_iteration = nullptr,
+                   const std::function<void(const search_result&)> &on_finish = nullptr);
+        void stop();
+        search_result wait();
+        bool searching() const
+        {
+            return worker.joinable();
+        }
+        void set_movetime(int64_t movetime_ms);
+        int64_t elapsed_ms() const;
+        search_result current_result();
+};
+
+int evaluate(const compact_board &board);
+std::string score_to_string(int score);
@@ -7,12 +7,26 @@
 
 
 #include<fstream>
+#include <charconv>
 
 #include "pieces.h"
 #include "pieces.cpp"
 
 #include "board.h"
 #include "game.h"
+#include "tablebase.cpp"
+#include "opening_book.cpp"
+#include "opening_tree.cpp"
+#include "pgn_pipeline.cpp"
+#include "game_archive.cpp"
+#include "position_set.cpp"
+#include "move_journal.cpp"
+#include "move_stack.cpp"
+#include "board_snapshot.cpp"
+#include "game_server.cpp"
+#include "notation.cpp"
+#include "engine.cpp"
+#include "uci.cpp"
 #include "utils.cpp"
 
 #pragma once
@@ -21,6 +35,7 @@
 void chess::ask_game_option()
 {
     bool valid_option{false};
+    this->stop_pondering();
     is_ready_status = false;
     want_to_resume = false;
     initialisation_requested = false;
@@ -37,12 +52,8 @@ void chess::ask_game_option()
         current_option = chess_vars::p_v_p;
         break;
     case '2':
-        // Initialise one person and one computer player
+        // Initialise one person and one computer player: the computer takes the color the player does not choose
         current_option = chess_vars::p_v_computer;
-
-        // WARNING: Not currently cupported
-        std::cout<< "PvC not currently supported. Defaulting to PvP..."<<std::endl;
-        current_option = chess_vars::p_v_p;
         break;
     case '3':
         // Initialise two computer players
@@ -77,7 +88,7 @@ void chess::ask_game_option()
         catch(const ChessException& e) // If any chess exceptions occur during loading: default here
         {
             std::cerr << e.what() << '\n';
-            piece::reset_occupied_spaces();
+            board_state.reset_occupied_spaces();
             setup_type = chess_vars::default_board;    
             initialisation_requested = false;
             current_status = chess_vars::game_over;
@@ -97,7 +108,7 @@ void chess::ask_game_option()
         break;
     case 'r':
         // Reset loaded game options, etc.
-        piece::reset_occupied_spaces();
+        board_state.reset_occupied_spaces();
         setup_type = chess_vars::default_board;
         current_status = chess_vars::game_over;
         return;
@@ -130,6 +141,8 @@ void chess::ask_game_option()
         break;
     }
 
+    computer_color = switch_player(main_player);
+
     // Set variables to GO for new game
     std::cout<<"Chosen player color: "<<player_ans<<" "<<main_player<<std::endl;
     is_ready_status = true;
@@ -147,19 +160,243 @@ void chess::initialise_game()
         //TS: dummy var
         chess_board.load_board((*occupied),(*the_kings));// !! Need to also load the kings and main player
     } else {
-        piece::reset_occupied_spaces();
-        chess_board.initialise_board();
+        this->reset_board();
         chess_board.print_board();
-        the_kings = &chess_board.get_the_kings();
-        occupied = piece::get_locations();
     }
 
-    // Temporarily switch to opponent to generate threats
-    current_player = switch_player(current_player);
-    this -> generate_threats();
-    // Switch back to initial player to generate allowed moves
-    current_player = switch_player(current_player);    
     this -> generate_moves();
+    played_moves.reset(this->start_position());
+    this->start_autosave();
+}
+
+// Fresh pieces in the initial setup, white to move
+void chess::reset_board()
+{
+    board_state.reset_occupied_spaces();
+    board_state.set_legal_en_passant(false, position(0,0));
+    chess_board.initialise_board();
+    the_kings = &chess_board.get_the_kings();
+    occupied = board_state.get_locations();
+    current_player = chess_vars::white;
+    current_status = chess_vars::game_on;
+    outcome = chess_vars::ongoing;
+    move_history.clear();
+    halfmove_clock = 0;
+    fullmove_number = 1;
+}
+
+// Set up the pieces of a position in Forsyth-Edwards Notation, as a loaded board ready to be played from.
+// Returns false, leaving the current game untouched, if the FEN is malformed.
+bool chess::load_fen(std::string_view fen)
+{
+    compact_board loaded;
+    if (!compact_board::from_fen(fen, loaded)){
+        return false;
+    }
+    this->set_up_pieces(loaded);
+    // update_game_status hands the turn over once the board is initialised: start from the other player
+    current_player = switch_player(loaded.side_to_move());
+    current_status = chess_vars::game_on;
+    outcome = chess_vars::ongoing;
+    setup_type = chess_vars::loaded_board;
+    initialisation_requested = true;
+    is_ready_status = true;
+    move_history.clear();
+    return true;
+}
+
+// Replace the pieces on the board with those of a compact position, and take its clocks.
+void chess::set_up_pieces(const compact_board &loaded)
+{
+    board_state.reset_occupied_spaces();
+    occupied = board_state.get_locations();
+    std::map<chess_vars::player_color, king*> loaded_kings;
+    for (int sq{}; sq<64; sq++){
+        if (loaded.at(sq)==no_piece) continue;
+        chess_vars::player_color color {code_color(loaded.at(sq))};
+        piece *new_piece {piece_initialiser(board_state, color, code_type(loaded.at(sq)), to_position(sq))};
+        if (new_piece->get_abbrev()==chess_vars::king){
+            loaded_kings[color] = dynamic_cast<king*>(new_piece);
+        }
+    }
+    chess_board.load_board(*occupied, loaded_kings);
+    the_kings = &chess_board.get_the_kings();
+    this->take_position_state(loaded);
+}
+
+// Take the clocks of a compact position, and the castling rights and en-passant square it holds beyond its pieces.
+// Castling rights are carried by the moved flags of the kings and rooks, the en-passant square by the capture of the board state.
+void chess::take_position_state(const compact_board &loaded)
+{
+    // A king without rights, and a corner rook without its right, count as moved
+    const uint8_t rights[2][2] { {black_q_castle, black_k_castle}, {white_q_castle, white_k_castle} };
+    for (chess_vars::player_color color : {chess_vars::black, chess_vars::white}){
+        int back_rank {color==chess_vars::white ? 1 : 8};
+        king *the_king {(*the_kings).at(color)};
+        if (!(loaded.castling_rights() & (rights[color][0] | rights[color][1])) && !the_king->check_if_moved()){
+            the_king->set_moved(1);
+        }
+        for (int side{}; side<2; side++){
+            position corner {side==0 ? 1 : 8, back_rank};
+            if ((*occupied).count(corner) && !(loaded.castling_rights() & rights[color][side]) && !(*occupied).at(corner)->check_if_moved()){
+                (*occupied).at(corner)->set_moved(1);
+            }
+        }
+    }
+    if (loaded.en_passant_square()>=0){
+        int direction {loaded.side_to_move()==chess_vars::white ? -1 : 1};
+        position target {to_position(loaded.en_passant_square())};
+        board_state.set_legal_en_passant(true, position(target.x(), target.y() + direction));
+    } else {
+        board_state.set_legal_en_passant(false, position(0,0));
+    }
+    halfmove_clock = loaded.halfmoves();
+    fullmove_number = loaded.fullmoves();
+}
+
+// Take a move back on the pieces, as the move stack took it back on its compact board (restored, the position before it).
+// The piece goes back to its square, and the piece it took, or the pawn it promoted from, is made again from the pool.
+void chess::take_back_pieces(const undo_record &undo, const compact_board &restored)
+{
+    const compact_move &m {undo.move};
+    const std::pair<bool, piece*> nothing_taken {false, nullptr};
+    piece *moved {(*occupied).at(to_position(m.to))};
+    if (m.is_promotion()){
+        chess_vars::player_color color {moved->get_owner()};
+        (*occupied).erase(to_position(m.to));
+        board_state.release(moved);
+        piece_initialiser(board_state, color, chess_vars::pawn, to_position(m.from));
+    } else {
+        moved->unmove(to_position(m.from), nothing_taken);
+    }
+    if (m.flags & castle_move){
+        int back {m.from - 4};
+        bool king_side {m.to > m.from};
+        (*occupied).at(to_position(king_side ? back+5 : back+3))->unmove(to_position(king_side ? back+7 : back), nothing_taken);
+    }
+    if (undo.captured!=no_piece){
+        int square {m.to};
+        if (m.flags & en_passant_move) square += restored.side_to_move()==chess_vars::white ? -8 : 8;
+        piece_initialiser(board_state, code_color(undo.captured), code_type(undo.captured), to_position(square));
+    }
+    this->take_position_state(restored);
+}
+
+// Initial (or loaded) position of the game which is about to be played, with its clocks
+compact_board chess::start_position()
+{
+    // Loaded boards hand the turn over on their first status update: until then, current_player is the side which moved last
+    chess_vars::player_color to_move {setup_type==chess_vars::loaded_board ? switch_player(current_player) : current_player};
+    compact_board start {compact_board::from_occupied(board_state, to_move)};
+    start.set_halfmoves(halfmove_clock);
+    start.set_fullmoves(fullmove_number);
+    return start;
+}
+
+// Start the journal of the game which is about to be played, from its initial (or loaded) position
+void chess::start_autosave()
+{
+    if (autosave_path.empty()){
+        return;
+    }
+    autosave.start(autosave_path, played_moves.start());
+}
+
+// Take back the last move: against the computer, its reply as well, so that the player is to move again.
+// Returns false, changing nothing, if there are not enough moves to take back.
+bool chess::undo_last_move()
+{
+    size_t plies {current_option==chess_vars::p_v_computer ? 2u : 1u};
+    if (played_moves.moves_played()<plies){
+        return false;
+    }
+    this->stop_pondering();
+    for (size_t n{}; n<plies; n++){
+        undo_record taken_back {played_moves.last_undo()};
+        played_moves.undo();
+        this->take_back_pieces(taken_back, played_moves.current());
+        autosave.undo(played_moves.current());
+        if (!move_history.empty()) move_history.pop_back();
+    }
+    this->resume_from_stack();
+    return true;
+}
+
+// Play again the moves taken back by the last undo, as many as undo took back
+bool chess::redo_move()
+{
+    size_t plies {current_option==chess_vars::p_v_computer ? 2u : 1u};
+    if (played_moves.moves_undone()<plies){
+        return false;
+    }
+    this->stop_pondering();
+    for (size_t n{}; n<plies; n++){
+        compact_board before {played_moves.current()};
+        played_moves.redo();
+        // The same path as a move of the player, from the pieces of the position before it
+        current_player = before.side_to_move();
+        this->generate_moves();
+        this->play_move(played_moves.last_move());
+        move_history.push_back(move_to_san(before, played_moves.last_move(), true));
+        autosave.append(played_moves.last_move());
+    }
+    this->resume_from_stack();
+    return true;
+}
+
+// Carry on from the position the move stack is now at, its moves taken back or played again on the pieces
+void chess::resume_from_stack()
+{
+    const compact_board &position {played_moves.current()};
+    current_player = position.side_to_move();
+    current_status = chess_vars::game_on;
+    outcome = chess_vars::ongoing;
+    this->generate_moves();
+}
+
+// Keep the records of the game in step with a move just played on the pieces
+void chess::record_move(const compact_board &before, const compact_move &m)
+{
+    move_history.push_back(move_to_san(before, m, true));
+    played_moves.play(m);
+    autosave.append(m);
+}
+
+// The game so far as an immutable variation: branches explored off it, on any thread, leave the game untouched
+variation chess::snapshot()
+{
+    return variation(played_moves.start(), played_moves.moves());
+}
+
+// Pick up the game left in the journal by a crash, or by quitting before the end of the game.
+// The position after the recovered moves is loaded like a FEN, with those moves as its history.
+bool chess::recover_autosave()
+{
+    compact_board board;
+    std::vector<compact_move> moves;
+    if (autosave_path.empty() || !move_journal::recover(autosave_path, board, moves)){
+        return false;
+    }
+    std::vector<std::string> history;
+    for (auto &m : moves){
+        history.push_back(move_to_san(board, m, true));
+        board.make_move(m);
+    }
+    if (!this->load_fen(board.to_fen())){
+        return false;
+    }
+    move_history = history;
+    std::cout<<"Recovered the autosaved game ("<<moves.size()<<" moves since its last snapshot)"<<std::endl;
+    return true;
+}
+
+// Current position in Forsyth-Edwards Notation
+std::string chess::to_fen()
+{
+    compact_board current {compact_board::from_occupied(board_state, current_player)};
+    current.set_halfmoves(halfmove_clock);
+    current.set_fullmoves(fullmove_number);
+    return current.to_fen();
 }
 
 bool chess::over()
@@ -184,46 +421,51 @@ bool chess::want_initialisation()
 }
 
 // Generate moves for all the pieces owned by the current player
+// Allowed moves of the current player. They are generated on a compact copy of the board (see compact_board.h), which
+// dispatches on the one-byte piece codes with a switch: no virtual calls through the piece pointers, and no threats to
+// collect beforehand. The moves come out legal, so make_move does not need to try them for a revealed check.
+// Each piece is then handed its own moves, for can_move_to and the printouts (the pieces are a compatibility layer).
 void chess::generate_moves()
 {
-    //Options:
-    // 1: vector of all pieces. Con: will need to iterate through to find which one to delete upon capture
-    // 2: iterate through occupied spaces. Pro: no need to update yet another container. Con: need to check all the squares. EDIT: actually dont need to check positions, just iterate through keys 
+    compact_board current {compact_board::from_occupied(board_state, current_player)};
+    legal_moves.clear();
+    current.generate_legal(legal_moves);
+    is_checked[current_player] = current.in_check();
 
-    //Option 2:
     //First we delete the destinations entirely. 
     (*accessible_squares).clear();
     for (std::map<position, piece*>::iterator iter= (*occupied).begin(); iter!=(*occupied).end(); ++iter){
-        //TS: std::cout<<"--> Generating moves for "<<piece_to_char(iter->second->get_abbrev())<<std::endl;
-        piece* temp {iter->second};
-        if (temp->get_owner()!=current_player){
-            continue; // Don't generate moves for pieces which don't belong to me
+        if (iter->second->get_owner()==current_player){
+            iter->second->clear_allowed_moves();
         }
-        
-        (*temp).generate_allowed_moves();
-    } 
+    }
+    for (const compact_move &m : legal_moves){
+        // A promotion comes once for each piece the pawn may become: its square is allowed once
+        if (m.is_promotion() && m.promotion!=chess_vars::queen) continue;
+        (*occupied).at(to_position(m.from))->allow_move(to_position(m.to));
+    }
 }
 
 // If pawn promotion: require initialisation of a new dynamically allocated piece pointer
-piece *promote_piece(chess_vars::player_color color, position location, chess_vars::piece_type promotion_type)
+piece *promote_piece(position_state &board_state, chess_vars::player_color color, position location, chess_vars::piece_type promotion_type)
 {
     piece* new_piece;
     switch (promotion_type)
     {
     case chess_vars::queen:
-        new_piece = new queen(color, chess_vars::queen, location);  
+        new_piece = board_state.create<queen>(color, chess_vars::queen, location);  
         new_piece->set_moved(true);     
         return new_piece;
     case chess_vars::rook:
-        new_piece = new rook(color, chess_vars::rook, location);  
+        new_piece = board_state.create<rook>(color, chess_vars::rook, location);  
         new_piece->set_moved(true);     
         return new_piece;
     case chess_vars::bishop:
-        new_piece = new bishop(color, chess_vars::bishop, location);  
+        new_piece = board_state.create<bishop>(color, chess_vars::bishop, location);  
         new_piece->set_moved(true);     
         return new_piece;
     case chess_vars::knight:
-        new_piece = new knight(color, chess_vars::knight, location);  
+        new_piece = board_state.create<knight>(color, chess_vars::knight, location);  
         new_piece->set_moved(true);     
         return new_piece;
     // chess_vars::king:
@@ -231,379 +473,92 @@ piece *promote_piece(chess_vars::player_color color, position location, chess_va
     // chess_vars::nancy_rothwell:
     default: //Coding style: does it make sense to have pieces as well as default
         std::cerr<<"WARNING: tried to promote a pawn to a "<<piece_to_char(promotion_type)<<". Defaulting to a queen..."<<std::endl;
-        new_piece = new queen(color, chess_vars::queen, location);  
+        new_piece = board_state.create<queen>(color, chess_vars::queen, location);  
         new_piece->set_moved(true);     
         return new_piece;
     }
 }
 
-// Given a 2-length string: convert algebraic position to numerical coordinates
-position convert_to_pos(std::string request)
-{
-    if (request.length()!=2){
-        // Throw error: this is not meant to happen
-        return position(0,0);
-    }
-    std::vector<char> files{'a','b','c','d','e','f','g','h'};
-    std::vector<char> ranks{'1','2','3','4','5','6','7','8'};
-    position new_position;
-
-    if (is_in(files,request[0]) && is_in(ranks,request[1])){
-        int x_coord { get_index(files, request[0]) +1 };
-        int y_coord { get_index(ranks, request[1]) +1 };
-        new_position.set(x_coord,y_coord);
-        return new_position;
-    } else{
-        return position(0,0);
-    }
-}
-
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 //%%%%%%%%%%% MOVE INTERPRETATION %%%%%%%%%%%%%%%
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 
-// Hefty piece of code to interpret an algebraic request: e.g. translates 'axb' to chess language to capture pawn on file b with pawn on file a
-move_request interpret_move(std::string request)
+// Requests which are not moves, by their full name or their first letter (e.g. s or save), in any case
+chess_vars::request command_request(std::string_view request)
 {
-    // If request does not contain the letter b: can be lowered (else: confusion between bishop and file b) 
-    if (!char_in_str(request,'b') && !char_in_str(request, 'B')){
-        to_lower(request);
-    } // else : do nothing
-    
-    // Check if request was not actually a move: simple outcomes which require little interpretation
-    std::vector<std::string> non_move_requests {"save", "draw", "ignore draw","resign","quit","menu"}; //Not sure if quit should be left in there
-    move_request move;
-    bool non_move;
-    if ( request.length()>1){
-        non_move = is_in(non_move_requests, request); 
-    } else {
-        non_move = is_in_char(non_move_requests, request[0]);
-    }
-
-    // Process all non-moves here and exit function: no further translation required
-    if (non_move){
-        move.valid = true;
-        switch (request[0]) // Note: we have already checked that a move such as Re4 does not trigger the resignation.
-        {
-        case 's':
-            // Save game
-            move.type = chess_vars::save;
-            return move;
-            break;
-        case 'd':
-            // Offer a draw
-            move.type = chess_vars::offer_draw;
-            return move;
-            break;
-        case 'i':
-            // Ignore/rescing draw
-            move.type = chess_vars::remove_draw;
-            return move;
-            break;
-        case 'r':
-        case 'q':
-            // Resign the game
-            // Are you sure you want to resign?
-            move.type = chess_vars::resign;
-            return move;
-            break;
-        case 'm':
-            // Goto menu
-            // Save current game 
-            move.type = chess_vars::menu;
-            return move;
-            break;
-        default: // Should not be accessible
-            move.valid = false;
-            break;
+    struct command
+    {
+        std::string_view name;
+        chess_vars::request type;
+    };
+    static const command commands[] {{"save", chess_vars::save}, {"draw", chess_vars::offer_draw}, {"ignore draw", chess_vars::remove_draw},
+        {"resign", chess_vars::resign}, {"quit", chess_vars::resign}, {"menu", chess_vars::menu}, {"analyse", chess_vars::analyse},
+        {"undo", chess_vars::undo}, {"redo", chess_vars::redo}};
+    auto same_letter = [](char a, char b){ return tolower(static_cast<unsigned char>(a))==b; };
+    for (auto &c : commands){
+        if (request.size()==1 ? same_letter(request[0], c.name[0])
+                : request.size()==c.name.size() && std::equal(request.begin(), request.end(), c.name.begin(), same_letter)){
+            return c.type;
         }
     }
+    return chess_vars::invalid_request;
+}
 
-    std::vector<char> files{'a','b','c','d','e','f','g','h'};
-    std::vector<char> ranks{'1','2','3','4','5','6','7','8'};
-    std::vector<char> abbrevs{'R','N','B','K','Q','r','n','k','q'}; //Note: bishop must be provided in uppercase, else it will not be recognised
-    position new_position;
-    // Step 0: check for hanging characters (i.e. draw offer: "=")
-    // NOTE: draw offers not currently implemented: this will currently not affect the game
-    if (request.length()>2){
-        if (request.back()=='='){
-            request = request.substr(0, request.size()-1);    
-            move.draw_offer = true;
-        }
-    } 
-
-    // Assume move is invalid, and change if not
-    move.valid = false;
-    move.type = chess_vars::move;
-
-    // Check first for simple move request (2-move)
-    if (request.length()==2){
-        //First option: king castle
-        if (request == "oo"){
-            move.k_castle = true;
-            move.valid = true;
-            move.end = position(7,0);
-            return move;
-        } else { // Else: must be an unambiguous end-position
-            new_position = convert_to_pos(request);
-            if (!new_position.is_valid()){
-                std::cerr<<"At interpretation: single square was invalid!"<<std::endl;
-                return move;
-            }
-            move.pawn_move = true;
-            move.id = chess_vars::nancy_rothwell; // Non-specific move
-            move.end = new_position;
-        }
+// Request for a move of the current position: start and end squares, the rook of a castle, the piece of a promotion
+move_request request_for_move(const compact_move &m)
+{
+    move_request request;
+    request.valid = true;
+    request.type = chess_vars::move;
+    request.start = to_position(m.from);
+    request.end = to_position(m.to);
+    request.capture = m.is_capture();
+    if (m.flags & castle_move){
+        bool kingside {m.to > m.from};
+        request.k_castle = kingside;
+        request.q_castle = !kingside;
+        request.castle_end = position(kingside ? 6 : 4, request.start.y());
+    }
+    if (m.is_promotion()){
+        request.promotion = true;
+        request.id = static_cast<chess_vars::piece_type>(m.promotion);
+    }
+    return request;
+}
 
-    // Next: check if the move is invalid
-    } else if (request.length()<2){
-        std::cerr<<"At interpretation: move request was too short!"<<std::endl;
+// Interpret a player's request: a command, or a move in algebraic notation (see notation.h).
+// Moves are matched against the legal moves of the current position, so the request comes back complete and unambiguous.
+move_request chess::interpret_move(std::string_view request)
+{
+    move_request move;
+    chess_vars::request command {command_request(request)};
+    if (command!=chess_vars::invalid_request){
+        move.valid = true;
+        move.type = command;
         return move;
-    // Next: check moves of length 3 to 6 (longest conceivable move)
-    } else if (request.length()==3){
-        if (request == "o-o"){ // Kingside castle
-            move.k_castle = true;
-            move.valid = true;
-            move.end = position(7,0);
-            move.type = chess_vars::move;
-            return move;
-        } else if (request == "ooo"){ // Queenside castle
-            move.q_castle = true;
-            move.valid = true;
-            move.end = position(3,0);
-            move.type = chess_vars::move;
-            return move;
-        } else if (request[1] == 'x'){ // Pawn capture
-            if (!is_in(files,request[0]) || !is_in(files,request[2])){
-                std::cerr<<"At interpretation: did not recognise a valid pawn capture format."<<std::endl;
-                return move;
-            }
-            move.pawn_attack = true;
-            move.pawn_move = true;
-            int start { get_index(files, request[0]) +1};
-            int end { get_index(files, request[2]) +1};
-            move.start = position(start,0);
-            move.end = position(end,0);
-            move.id = chess_vars::pawn;
-        } else if (is_in(abbrevs, request[2])){ // Pawn promotion
-            if (request[2]=='k'){
-                std::cerr<<"At interpretation: Cannot promote a pawn to a king"<<std::endl;
-                move.valid = false;
-                return move;
-            }
-            new_position = convert_to_pos(request.substr(0,2));
-            if ( !new_position.is_valid() ||(new_position.y()!=8 && new_position.y()!=1)){ // Invalid promotion if pawn move not to 8th rank
-                std::cerr<<"At interpretation: Move to promote pawn was invalid or not to the last rank."<<std::endl;
-                return move;
-            }
-            move.pawn_move = true;
-            move.end = new_position;
-            move.start = position(move.end.x(), 0);
-            move.id = char_to_piece(request[2]);
-            move.promotion = true;
-        } else if (is_in(abbrevs, request[0])){ //Non-unique move: has a piece specifier (e.g. Q, B, K, R, N)
-            new_position = convert_to_pos(request.substr(1,2));
-            if (!new_position.is_valid()){
-                std::cerr<<"At interpretation: square with single identifier was not valid!"<<std::endl;
-                return move;
-            }   
-            move.end = new_position;
-            move.id = char_to_piece(request[0]);
-        } else { // No other moves supported
-            std::cerr<<"At interpretation: the 3-request was not recognised as a valid move!"<<std::endl;
-            return move;
-        } 
-    } else if (request.length()==4 ){ 
-        //TS Note: could include the request[0] check up here (streamline) 
-        if (request[1]=='x' && is_in(abbrevs, request[0])){ // Standard capture with a piece specifier
-            new_position = convert_to_pos(request.substr(2,2));
-            if (!new_position.is_valid()){
-                std::cerr<<"At interpretation: end square for standard capture was not recognised (4-request)."<<std::endl;
-                return move;
-            }
-            move.end = new_position;
-            move.capture = true;
-            move.id = char_to_piece(request[0]);
-        } else if (request[1]=='x' && is_in(files, request[0]) && is_in(files,request[2]) && is_in(files,request[3])){ // Pawn capture to a promotion
-            if (request[3]=='k'){ // Can't promote pawn to king
-                std::cerr<<"ERROR: cannot promote piece to king"<<std::endl;
-                move.valid = false;
-                return move;
-            }
-            move.pawn_attack = true;
-            move.pawn_move = true;
-            int start { get_index(files, request[0]) +1};
-            int end { get_index(files, request[2]) +1};
-            move.start = position(start,0);
-            move.end = position(end,0);
-            move.id = char_to_piece(request[3]);
-            move.promotion = true;
-        } else if (request[1]=='x' && is_in(files, request[0])){ // Ambiguous pawn capture: e.g. axb
-            new_position = convert_to_pos(request.substr(2,2));
-            int old_x { get_index(files,request[0]) +1};
-            if (!new_position.is_valid() || abs(old_x - new_position.x())!=1 ){
-                std::cerr<<"At interpretation: while disambiguating pawn capture, move was not recognised as a valid pawn move."<<std::endl;
-                return move;
-            }
-            move.start = position( old_x, 0);
-            move.end = new_position;
-            move.id = chess_vars::pawn;
-            move.pawn_move = true;
-            move.capture = true;
-        } else if (is_in(files, request[1]) && is_in(abbrevs, request[0])){ // Disambiguate piece with rank
-            int file { get_index(files, request[1]) +1};
-            if (file>8 || file <1){
-                std::cerr<<"At interpretation: disambiguating file ras not recognised."<<std::endl;
-                return move;
-            }
-            move.start = position(file,0);
-            new_position = convert_to_pos(request.substr(2,2));
-            if (!new_position.is_valid()){
-                std::cerr<<"At interpretation: end square was not recognised (4-request)."<<std::endl;
-                return move;
-            }
-            move.id = char_to_piece(request[0]);
-            move.end = new_position;
-
-        } else if (is_in(ranks,request[1]) && is_in(abbrevs, request[0])){ // Disambiguate piece with file
-            int rank { get_index(ranks, request[1]) +1};
-            if (rank>8 || rank <1){
-                std::cerr<<"At interpretation: disambiguating rank was not recognised."<<std::endl;
-                return move;
-            }
-            move.start = position(0,rank);
-            new_position = convert_to_pos(request.substr(2,2));
-            if (!new_position.is_valid()){
-                std::cerr<<"At interpretation: end square was not recognised (4-request with rank)."<<std::endl;
-                return move;
-            }
-            move.id = char_to_piece(request[0]);
-            move.end = new_position;
-        } else { // No other 4-char moves supported
-            std::cerr<<"At interpretation: the 4-request was not recognised as a valid request."<<std::endl;
-            return move;
-        }
-    } else if (request.length() == 5){
-        if (request == "o-o-o"){ //Queenside castle
-            move.q_castle = true;
-            move.valid = true;
-            move.end = position(3,0);
-            move.type = chess_vars::move;
-            return move;
-        } else if (request[2]=='x'){ // Non-unique piece and rank/file capture
-            bool test_0, test_1a, test_1b, test_3, test_4;
-            test_0 = is_in(abbrevs, request[0]);
-            test_1a = is_in(files, request[1]);
-            test_1b = is_in(ranks,request[1]);
-            test_3 = is_in(files, request[3]);
-            test_4 = is_in(ranks, request[4]);
-            if ( ! (test_0 &&  (test_1a || test_1b)  && test_3 && test_4)){
-                std::cerr<<"At interpretation: disambiguating rank or file capture did not meet all the tests."<<std::endl;
-                return move;
-            }
-            position start, end;
-            if (test_1a){
-                int file { get_index(files, request[1]) +1};
-                start = position(0,file);
-                if (file>8 || file <1){
-                    std::cerr<<"At interpretation: disambiguating file invalid (5-request)."<<std::endl;
-                    return move;
-                }
-                move.start = start;
-            } else {
-                int rank { get_index(ranks, request[1]) +1};
-                start = position(rank,0);
-                if (rank>8 || rank <1){
-                    std::cerr<<"At interpretation: disambiguating rank invalid (5-request)."<<std::endl;
-                    return move;
-                }
-                move.start = start;
-            }
-            end = convert_to_pos(request.substr(3,2));
-            if (!end.is_valid()){
-                std::cerr<<"At interpretation: end move of capture was not recognised (5-request)."<<std::endl;
-                return move;
-            }
-            move.end = end;
-            move.id = char_to_piece(request[0]);
-        } else {    // Non-unique piece with start and end position
-            bool test_0, test_1, test_2, test_3, test_4;
-            test_0 = is_in(abbrevs, request[0]);
-            test_1 = is_in(files, request[1]);
-            test_2 = is_in(ranks, request[2]);
-            test_3 = is_in(files, request[3]);
-            test_4 = is_in(ranks, request[4]);
-            if ( ! (test_0 &&  test_1 && test_2 && test_3 && test_4)){
-                std::cerr<<"At interpretation: request with piece, start and end squares did not meet all the tests (5-request)."<<std::endl;
-                return move;
-            }
-            position pos_start, pos_end;
-            pos_start = convert_to_pos(request.substr(1,2));
-            pos_end = convert_to_pos(request.substr(3,2));
-            if (! (pos_end.is_valid() && pos_start.is_valid())){
-                std::cerr<<"At interpretation: request with both start and end position had an invalid position (5-request)."<<std::endl;
-                return move;
-            }
-            move.start = pos_start;
-            move.end = pos_end;
-            move.id = char_to_piece(request[0]);
-        }
-    } else if (request.length() == 6){ // Currently only accepting disambiguating captures
-        bool test_0, test_1, test_2, test_3, test_4, test_5;
-        test_0 = is_in(abbrevs, request[0]);
-        test_1 = is_in(files, request[1]);
-        test_2 = is_in(ranks, request[2]);
-        test_3 = (request[3] == 'x');
-        test_4 = is_in(files, request[4]);
-        test_5 = is_in(ranks, request[5]);
-        if ( ! (test_0 &&  test_1 && test_2 && test_3 && test_4 && test_5)){
-            std::cerr<<"At interpretation: 6-reqest does not meet all the tests."<<std::endl;
-            return move;
-        }
-        position pos_start, pos_end;
-        pos_start = convert_to_pos(request.substr(1,2));
-        pos_end = convert_to_pos(request.substr(4,2));
-        if (! (pos_end.is_valid() && pos_start.is_valid())){
-            std::cerr<<"At interpretation: start or end position of 6-request is invalid."<<std::endl;
-            return move;
-        }
-        move.start = pos_start;
-        move.end = pos_end;
-        move.id = char_to_piece(request[0]);
-        move.capture = true;
-    } else { // No 6-char moves supported 
-        //TS: could trim end/beginning of request to see if valid move found
-        std::cerr<<"At interpretation: requests of length 7 or greater not currently supported!"<<std::endl;
+    }
+
+    compact_board current {compact_board::from_occupied(board_state, current_player)};
+    san_move parsed;
+    compact_move found;
+    san_status status {read_san(current, request, found, parsed)};
+    if (status!=san_ok){
+        std::cerr<<"At interpretation: "<<san_status_message(status)<<"."<<std::endl;
+        move.valid = false;
         return move;
-    }    
-    move.type = chess_vars::move;
-    move.valid = true;
-    return move;
-} 
-// Summary of allowed move:
-// Thinking: 1 simple notation, can complicate later
-// 2: destination
-// -kingside castle (OO)(00)
-// 3:
-// - dest + = DONE
-// - pawn promotion DONE
-// - piece + dest DONE
-// - kingside castle (O-O) DONE
-// - queenside castle (OOO) DONE
-// - pawn capture (exd) DONE
-// 4:
-// - piece + capture + dest DONE
-// - piece (non-unique) + rank/file + dest  DONE
-// 5: 
-// - piece (non-unique) + rank + file + dest #Rare
-// - queenside castle (O-O-O) DONE
-// 6:
-// - piece (non-unique) + rank-file + capture + dest #Rare
-
-// +1:
-// - draw offer: '='
+    }
 
+    requested_position = current;
+    requested_move = found;
+    move = request_for_move(found);
+    move.draw_offer = parsed.draw_offer;
+    if (parsed.promotion==chess_vars::nancy_rothwell){ // The player is asked what to promote to once the pawn has moved
+        move.promotion = false;
+        move.id = chess_vars::nancy_rothwell;
+    }
+    return move;
+}
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 //%%%%%%%%%%% Convert request to move %%%%%%
@@ -618,12 +573,18 @@ void chess::ask_for_move()
     move.valid = false;
     piece *moving_piece;
     piece *castling_rook;
+
+    // The computer's turn: no input required
+    if (current_option==chess_vars::p_v_computer && current_player==computer_color){
+        this->computer_move();
+        return;
+    }
     
 #ifdef DEBUGMODE
     std::cout<<"ALLOWED MOVES:"<<std::endl;
     this->print_accessible_squares();
 #endif
-    std::string optional_msg { "Select one of the following, or provide a (list of) move: (D)raw, (U)ndraw, (R)esgin, (M)enu, (S)ave: "};
+    std::string optional_msg { "Select one of the following, or provide a (list of) move: (D)raw, (I)gnore draw, (U)ndo, Redo, (R)esign, (M)enu, (S)ave, (A)nalyse: "};
     // Keep asking for a new move if last move left a check or was invalid
     while ( leaves_check || !move.valid){
             // Debugging statements:
@@ -654,7 +615,7 @@ void chess::ask_for_move()
 
             // The magic begins: a move_request is generated from the string request.
             // This move_request is then applied to the current board status to ensure it is unambigous, valid, and legal.
-            move_request move { interpret_move(request)} ;
+            move_request move { this->interpret_move(request)} ;
             current_request = chess_vars::invalid_request;
 
             // If move is valid: then interpret
@@ -665,7 +626,16 @@ void chess::ask_for_move()
                     current_request = move.type;
                     switch(move.type){
                         case chess_vars::undo:
-                            // Only possible against computer: revert the last two moves
+                        case chess_vars::redo:
+                            // Take back (or play again) a move, then keep asking: the player to move may have changed
+                            if (move.type==chess_vars::undo ? this->undo_last_move() : this->redo_move()){
+                                system("clear");
+                                chess_board.print_board();
+                                std::cout<<"Current player: "<<color_to_char(current_player)<<std::endl;
+                            } else {
+                                std::cout<<(move.type==chess_vars::undo ? "No move to take back." : "No move to play again.")<<std::endl;
+                            }
+                            continue;
                         case chess_vars::save:
                             // Save game to file. IF file exists already, allow user to modify?
                             this->save_game();
@@ -684,6 +654,10 @@ void chess::ask_for_move()
                         case chess_vars::menu:
                             // Make temporary save of game before exiting to the menu.
                             break;
+                        case chess_vars::analyse:
+                            // Analyse the position until the player quits the analysis, then keep asking for a move
+                            this->analysis_mode();
+                            continue;
                         default:
                             // If any other non-move requests are introduced they will default here.
                             current_request = chess_vars::invalid_request;
@@ -692,181 +666,8 @@ void chess::ask_for_move()
                     // No need to go any further: request is valid and requires no further interpretation
                     if (current_request!= chess_vars::invalid_request) return;
 
-                } else if (move.k_castle){ // Instead: check if (position(7,backrank)) is in destinations and that type is king
-                    chess_vars::castle castle_type { (*the_kings)[current_player]->can_castle()};
-                    int backrank{1};
-                    if (current_player==chess_vars::black) backrank = 8;
-                    if (castle_type==chess_vars::k_castle || castle_type==chess_vars::both_castle){
-                        move.end = position(7, backrank);
-                        move.start = position(5, backrank);
-                        move.castle_end = position(6,backrank);
-                        moving_piece = chess_board.get_locations()->at(move.start);
-                        castling_rook = chess_board.get_locations()->at(position(8,backrank));
-                    } else{
-                        // not able to castle: ask again
-                        move.valid = false;
-                        std::cerr<<"At conversion: King castling not accepted."<<std::endl;
-                    }
-                } else if (move.q_castle){ // Asked for queen castling: check if possible
-                    chess_vars::castle castle_type { (*the_kings)[current_player]->can_castle()};
-                    int backrank{1};
-                    if (current_player==chess_vars::black) backrank = 8;
-                    if (castle_type==chess_vars::q_castle || castle_type==chess_vars::both_castle){
-                        move.end = position(3, backrank);
-                        move.start = position(5, backrank);
-                        move.castle_end = position(4,backrank);
-                        moving_piece = chess_board.get_locations()->at(move.start);
-                        castling_rook = chess_board.get_locations()->at(position(1,backrank));
-                    } else{
-                        // not able to castle: ask again
-                        move.valid = false;
-                        std::cerr<<"At conversion: Queen castling not accepted."<<std::endl;
-                    }
-                } else if ( move.promotion){ // Pawn (capture to) promotion //TS : should work for both forms of promotion (move/capture)
-                    int last_rank{1}, direction{-1};
-                    if (current_player==chess_vars::white){
-                        last_rank = 8;
-                        direction = 1;
-                    }
-                    position start_position {position(move.start.x(), last_rank-direction)};
-                    position end_position {position(move.end.x(), last_rank)};
-                    if ( (*accessible_squares).count(move.end)){ // Check if destination has possible moves
-                        bool test_1, test_2;
-                        int found_one{};
-                        for (auto it{(*accessible_squares).at(end_position).begin()}; it< (*accessible_squares).at(end_position).end(); ++it ){ // Check all squares in end file
-                            test_1 = (*it)->get_owner() == current_player;
-                            test_2 = (*it)->get_abbrev() == chess_vars::pawn;
-                            
-                            if (test_1 && test_2){
-                                moving_piece = (*it);
-                                found_one ++;
-                                break;
-                            }
-                        }  
-                        if (found_one==0){
-                            std::cerr<<"At conversion: No pawns were found that could make this move."<<std::endl;
-                            move.valid = false;
-                        }
-                    } else { // Destination has no moves. Pawn unable to move here.
-                        std::cerr<<"At conversion: no piece can move to this position."<<std::endl;
-                        move.valid = false;
-                    }
-
-                } else if (move.pawn_move && move.pawn_attack){ // Pawn capture (as ranks need to be deduced)
-                    // Deduce positions
-                    int found_one{0};
-                    position end_position; // Bad practise to change a variable used in the for loop
-                    for (int r{1}; r<=8; r++){
-                        if ((*accessible_squares).count(position(move.end.x(), r))){
-                            for (auto it{(*accessible_squares).at(position(move.end.x(),r)).begin()}; it< (*accessible_squares).at(position(move.end.x(),r)).end(); ++it ){ // Check all squares in end file
-                                bool test_1, test_2, test_3;
-                                // Note: we don't have to test if move is indeed a capture, as it must be so to be added to destinations;
-                                
-                                test_1 = (*it)->get_owner() == current_player; // If piece belongs to me: can move
-                                test_2 = (*it)->get_abbrev() == chess_vars::pawn; // If piece is a pawn: can perform a pawn move
-                                test_3 = (*it)->location().x() == move.start.x(); // Check that this piece has the right starting file
-                                
-
-                                if (test_1 && test_2 && test_3){
-                                    if (found_one>0){
-                                        // Non-unique: please specify: need a specific end square
-                                        found_one ++;
-                                        move.valid = false;
-                                        std::cerr<<"The pawn capture was not unique. That's a rare situation! Please specify the end-square!"<<std::endl;
-                                        break; // Second pawn found: exit both loops (EDIT: unless we want to tell user how many pawns are there)
-                                    } else {
-                                        found_one ++;
-                                        moving_piece = (*it);
-                                        end_position.set(move.end.x(), r);
-                                        break; // Can proceed to next destination, as only one pawn can acess a square from a given file
-                                    }
-                                } // Else: not a valid pawn move: keep_looking
-                            }
-                            if (found_one>1){ // Need a second check to exit the second loop
-                                break;
-                            }
-
-                        }
-                    }
-                    if ( found_one==0){ // No valid pieces found
-                        // Invalid move: ask again
-                        std::cerr<< "At conversion: no pawn capture found!"<<std::endl;
-                        move.valid = false;
-                    } else if (found_one==1){ // One and only one valid piece found!
-                        move.end = end_position; 
-                    }
-                } else { // All other cases: give exact square reference 
-                    if ((*accessible_squares).count(move.end)){
-                        // Valid destination
-                        // Now locate actual piece based on: start + id
-                        // If start rank!=0: must be same
-                        // If start file!=0: must be same
-                        // If id!='': must be same
-                        int options{}, pawn_options{},capturing_pawn_options{};
-                        bool correct;
-                        
-                        for (auto it{ (*accessible_squares).at(move.end).begin() }; it < (*accessible_squares).at(move.end).end(); ++it){    
-                            correct = true;
-                            if ((*it)->get_owner()!=current_player){
-                                continue;
-                            }
-                            if (move.start.x()!=0){
-                                correct &= (*it)->location().x() == move.start.x();
-                            }
-                            if (move.start.y()!=0){
-                                correct &= (*it)->location().y() == move.start.y();
-                            }
-                            //if (move.id != chess_vars::pawn){ //TS: what is this meant to achieve? Should I not be checking this no matter what?
-                            if (move.id != chess_vars::nancy_rothwell){ //If type has purposefully not been set, don't bother checking the type of piece.
-                                correct &= (*it)->get_abbrev() == move.id;
-                            }
-
-                            // Cases:
-                            // 1: dealing with a non-pawn piece from move e.g. XXe7
-                            // 2: dealing with a pawn which is moving forwards (only one possible piece, and the default)
-                            // 3: dealing with a capturing pawn which was written incorrectly // No need to support this currently
-                            if (correct && (*it)->get_abbrev()!=chess_vars::pawn && pawn_options==0 && capturing_pawn_options==0){ // Case 1: If no non-pawn found, keep track of piece.
-                                moving_piece = (*it);
-                                move.valid = true;
-                                options ++;
-                                std::cout<<"At search: found a "<<piece_to_char((*it)->get_abbrev())<<" at "<<(*it)->location()<<std::endl;
-                            } else if (correct && (*it)->get_abbrev()==chess_vars::pawn ){ //&& (*it)->location().x()==move.end.x()){ // Case 2: If all tests correct, and piece is a (NON-capturing) pawn, takes preference over other moves, so long as only one available
-                                if (pawn_options>1 || capturing_pawn_options>1){
-                                    std::cerr<<"There are somehow multiple pawns able to access this same square: "<<move.end; // Something went terribly wrong: exiting!
-                                    exit(EXIT_FAILURE);
-                                }
-                                moving_piece = (*it);
-                                move.valid = true;
-                                if (move.capture){
-                                    pawn_options ++;
-                                    std::cout<<"At search: found a "<<piece_to_char((*it)->get_abbrev())<<" at "<<(*it)->location()<<std::endl;
-                                } else {
-                                    capturing_pawn_options++;
-                                }
-                            } else { // Case 3: incorrect or an undefined piecd or a capturing pawn or a second valid non-pawn piece
-                                // If capture and pawn_options = 0 -> take
-                                // If capture and pawn_options > 0 -> ignore
-                                // Skip and keep looking
-                                //std::cout<<"Not yet supported..."<<std::endl;
-                            }
-
-                            if (options>1){
-                                // Non-unique: ask for details
-                                move.valid = false;
-                                std::cerr<< "At conversion: non-unique end square. Please a further identifier!" <<std::endl;
-                                break; // Optional: could check to see how many fit the brief
-                            }
-                        } 
-                        if (options == 0 && pawn_options==0 && capturing_pawn_options==0){
-                            // If piece invalid
-                            move.valid = false;
-                            std::cerr <<"At conversion: No pieces of yours were found which could move there!" <<std::endl;
-                        }
-                    } else { // No piece can be moved to this end position
-                        // Invalid move: ask again
-                        std::cerr<<"At conversion: No piece is able to move here!"<<std::endl;
-                        move.valid = false;
-                    }
+                } else {
+                    this->resolve_move(move, moving_piece, castling_rook);
                 }
             } 
 
@@ -887,9 +688,9 @@ void chess::ask_for_move()
                         if ((*occupied).at(move.end)->get_abbrev()==chess_vars::king){
                             throw KingDeletionException();
                         }
-                        delete (*occupied).at(move.end);
+                        board_state.release((*occupied).at(move.end));
                         (*occupied).erase(move.end);
-                        piece* temp {promote_piece(current_player, move.end, move.id)};
+                        piece* temp {promote_piece(board_state, current_player, move.end, move.id)};
                         (*occupied)[move.end] = temp;
                         std::cout<<"Check promotion ptr:"<<std::endl;
                         std::cout<<(*temp)<<std::endl;
@@ -924,11 +725,13 @@ void chess::ask_for_move()
                             //std::cerr<<"Asked to delete a king!"<<std::endl;
                             throw KingDeletionException();
                         }
-                        delete (*occupied).at(move.end);
+                        board_state.release((*occupied).at(move.end));
                         (*occupied).erase(move.end);
-                        piece* temp {promote_piece(current_player, move.end, promotion_type)};
+                        piece* temp {promote_piece(board_state, current_player, move.end, promotion_type)};
                         (*occupied)[move.end] = temp;
+                        requested_move.promotion = promotion_type;
                     }
+                    this->record_move(requested_position, requested_move);
                     current_request = move.type;
                     break; // Technically sufficient to exit the loop
                 } else{
@@ -970,28 +773,45 @@ void chess::ask_for_move()
 // - if request if : undo, save, draw, resign, quit, menu: don't move and act
 // - if multiple pieces available: ask for which one
 
-//Prcess of making a move, checking for revealed check, backtracking if it does.
+// Locate the piece (and the castling rook) carrying out an interpreted move.
+// Clears move.valid if the pieces on the board do not agree with the move.
+bool chess::resolve_move(move_request &move, piece *&moving_piece, piece *&castling_rook)
+{
+    if (!move.valid || !(*occupied).count(move.start)){
+        std::cerr<<"At conversion: no piece stands on the start square!"<<std::endl;
+        move.valid = false;
+        return false;
+    }
+    moving_piece = (*occupied).at(move.start);
+    if (move.k_castle || move.q_castle){
+        position rook_start {move.k_castle ? 8 : 1, move.start.y()};
+        if (!(*occupied).count(rook_start)){
+            std::cerr<<"At conversion: no rook to castle with!"<<std::endl;
+            move.valid = false;
+            return false;
+        }
+        castling_rook = (*occupied).at(rook_start);
+    }
+    if (!moving_piece->can_move_to(move.end)){ // piece::move would refuse it
+        std::cerr<<"At conversion: the piece cannot move there!"<<std::endl;
+        move.valid = false;
+    }
+    return move.valid;
+}
+
+// Process of making a move. Returns true if the move was refused, in which case nothing moved.
+// The moves allowed to the pieces are legal (see generate_moves): a move resolved against them cannot leave the king in check.
 bool chess::make_move(move_request selected_move, piece* moving_piece, piece* castling_rook = nullptr)
 {
     typedef std::pair<bool, piece*> bool_piece_pair;
 
-    piece current_piece_state = *moving_piece;
     position old_position { moving_piece->location()};
-    position old_rook_position;
-    piece current_rook_state;
     bool_piece_pair captured_piece_state; 
     
-    // First ensure king doesn't move into threatened position
-    if (moving_piece->get_abbrev()==chess_vars::king){
-        // Sanity check: should not be moving to an invalid position anyway
-        if (!selected_move.end.is_valid() && !(selected_move.k_castle || selected_move.q_castle)){
-            std::cerr<<"About to move to an unvalid position despite previous checks. Exiting..."<<std::endl;
-            exit(EXIT_FAILURE);
-        }
-        if ( (*the_kings)[current_player]->is_checked(selected_move.end)) {
-            // No need to roll back as the King will not have moved
-            return true;
-        }
+    // Sanity check: should not be moving to an invalid position anyway
+    if (moving_piece->get_abbrev()==chess_vars::king && !selected_move.end.is_valid() && !(selected_move.k_castle || selected_move.q_castle)){
+        std::cerr<<"About to move to an unvalid position despite previous checks. Exiting..."<<std::endl;
+        exit(EXIT_FAILURE);
     }
     // Next, ensure I'm not capturing my own piece before moving (Sanity check: should not have been allowed otherwise)
     // If capturing enemy piece: safeguard it first
@@ -1005,50 +825,204 @@ bool chess::make_move(move_request selected_move, piece* moving_piece, piece* ca
         } 
     }   
 
-    // If a piece was captured: needs to be stored in case move is illegal
     captured_piece_state =  moving_piece->move(selected_move.end);
     if (selected_move.k_castle || selected_move.q_castle){
-        current_rook_state = *castling_rook;
-        old_rook_position = castling_rook ->location();
         castling_rook->move(selected_move.castle_end); // No capture intended: no need to store rvalue in an lvalue
     }
 
-    // If the move reveals a check, roll back
-    if ( (*the_kings)[current_player]->revealed_check(true)){
-        moving_piece -> unmove(old_position, captured_piece_state);
-        if (selected_move.k_castle || selected_move.q_castle){
-            castling_rook -> unmove(old_rook_position, std::make_pair(false,castling_rook)); // Note: the pair is not needed in this case, so it can be fed default values.
+    // Delete the captured piece, if one was captured
+    if (captured_piece_state.first){
+#ifdef DEBUGMODE
+        std::cout<<"Deleting captured piece: "<<piece_to_char(captured_piece_state.second->get_abbrev())<<std::endl;
+#endif
+        if (captured_piece_state.second->get_abbrev()==chess_vars::king){
+            throw KingDeletionException();
         }
-        return true;
-     
+        // The captured piece still believes it stands on the capture square, which now holds the capturing piece:
+        // only clear squares which still point to it (piece::move already removed it from the board)
+        position captured_at {captured_piece_state.second->location()};
+        if ((*occupied).count(captured_at) && (*occupied).at(captured_at)==captured_piece_state.second){
+            (*occupied).erase(captured_at);
+        }
+        board_state.release(captured_piece_state.second); // Note: even if capture is not explicitly provided in move request, will delete if space was previously occupied
+
+    }
+
+    // Elegant way: generate moves for this piece 
+    // and remove this new position from the allowed moves of my own pieces
+    // Currently: delete all data contained in allowed moves and destinations;
+    // EDIT: not that straightforward -> move can break lines of sight, thus removing multiple moves
+    
+    // Update en-passant state : check if last move was a pawn double jump
+    if (moving_piece->get_abbrev()==chess_vars::pawn && abs(old_position.y()-selected_move.end.y())==2 && old_position.x()-selected_move.end.x()==0){
+        board_state.set_legal_en_passant(true, moving_piece->location()); // Update position of pawn to capture
     } else {
-        // Delete the captured piece, if one was captured
-        if (captured_piece_state.first){
-            std::cout<<"Deleting captured piece: "<<piece_to_char(captured_piece_state.second->get_abbrev())<<std::endl;
-            if (captured_piece_state.second->get_abbrev()==chess_vars::king){
+        board_state.set_legal_en_passant(false, position(0,0));
+    }
+
+    // Clocks of the FEN: plies since the last capture or pawn move, and move number
+    halfmove_clock = (moving_piece->get_abbrev()==chess_vars::pawn || captured_piece_state.first) ? 0 : halfmove_clock+1;
+    if (current_player==chess_vars::black){
+        fullmove_number++;
+    }
+    return false;
+}
+
+
+// Play a move chosen by the computer on the board: same path as a player's move, without the interpretation step.
+// Returns false if the move is refused (e.g. it would leave the king in check).
+bool chess::play_move(const compact_move &m)
+{
+    move_request request {request_for_move(m)};
+    piece *moving_piece {nullptr};
+    piece *castling_rook {nullptr};
+    if (!this->resolve_move(request, moving_piece, castling_rook)){
+        return false;
+    }
+
+    try {
+        if (this->make_move(request, moving_piece, castling_rook)){
+            return false;
+        }
+        if (request.promotion){
+            if ((*occupied).at(request.end)->get_abbrev()==chess_vars::king){
                 throw KingDeletionException();
             }
-            (*occupied).erase(captured_piece_state.second->location());
-            delete captured_piece_state.second; // Note: even if capture is not explicitly provided in move request, will delete if space was previously occupied
+            board_state.release((*occupied).at(request.end));
+            (*occupied).erase(request.end);
+            (*occupied)[request.end] = promote_piece(board_state, current_player, request.end, request.id);
+        }
+    } catch (KingDeletionException& e){
+        std::cerr<< e.what() << "\n";
+        return false;
+    }
+    current_request = chess_vars::move;
+    return true;
+}
 
+// Replay a recorded game from the initial position, through the same interpretation and move checks as a player's moves,
+// but without drawing the board or asking for anything. Returns the number of moves played: if a move could not be played,
+// error says which one and why.
+int chess::replay_game(const std::vector<std::string> &moves, std::string &error)
+{
+    this->reset_board();
+    this->generate_moves();
+
+    // Moves are read on the compact board of the move stack, kept in step with the pieces
+    played_moves.reset(compact_board::starting_position());
+    int played{};
+    for (const std::string &san : moves){
+        if (current_status==chess_vars::game_over){
+            error = "move after the end of the game: " + san;
+            break;
+        }
+        compact_move found;
+        san_status status {read_san(played_moves.current(), san, found)};
+        if (status!=san_ok){
+            error = std::string(san_status_message(status)) + ": " + san;
+            break;
+        }
+        if (!this->play_move(found)){
+            error = "move refused by the board: " + san;
+            break;
         }
+        played_moves.play(found);
+        this->next_turn(false);
+        played++;
+    }
+    return played;
+}
 
-        // Elegant way: generate moves for this piece 
-        // and remove this new position from the allowed moves of my own pieces
-        // Currently: delete all data contained in allowed moves and destinations;
-        // EDIT: not that straightforward -> move can break lines of sight, thus removing multiple moves
-        
-        // Update en-passant state : check if last move was a pawn double jump
-        if (moving_piece->get_abbrev()==chess_vars::pawn && abs(old_position.y()-selected_move.end.y())==2 && old_position.x()-selected_move.end.x()==0){
-            piece::set_legal_en_passant(true, moving_piece->location()); // Update position of pawn to capture
+// Computer's turn: book move, tablebase move, or search. While the player then thinks about a reply,
+// the computer searches the position after the reply it expects (pondering) on a background thread.
+void chess::computer_move()
+{
+    compact_board current {compact_board::from_occupied(board_state, current_player)};
+    compact_move choice;
+    search_result result;
+    std::string source;
+    tb_root_move tb_choice;
+
+    if (pondering && polyglot_key(current)==ponder_key){
+        // Expected reply: the search already ran during the player's turn and only finishes its time
+        computer.set_movetime(computer_think_ms);
+        result = computer.wait();
+        choice = result.best;
+        source = "ponder hit";
+    } else {
+        this->stop_pondering();
+        if (book.pick_move(current, choice)){
+            source = "book";
+        } else if (endgame_tables.can_probe(current) && endgame_tables.best_move(current, tb_choice)){
+            choice = tb_choice.move;
+            source = "tablebase";
         } else {
-            piece::set_legal_en_passant(false, position(0,0));
+            // Positions of the game so far, for repetitions in the search
+            computer.set_history(played_moves.keys());
+            result = computer.think(current, search_limits{0, computer_think_ms, 0});
+            choice = result.best;
+            source = "search";
         }
+    }
+    pondering = false;
+
+    if (!this->play_move(choice)){
+        // The board refused the move: play the first move it accepts
+        std::cerr<<"WARNING: computer move "<<move_to_string(choice)<<" was refused by the board."<<std::endl;
+        std::vector<compact_move> moves;
+        current.generate_legal(moves);
+        bool played {false};
+        for (auto &m : moves){
+            if (this->play_move(m)){
+                choice = m;
+                played = true;
+                break;
+            }
+        }
+        if (!played){
+            current_request = chess_vars::invalid_request;
+            return;
+        }
+    }
 
-        return false;
+    this->record_move(current, choice);
+    const std::string &san {move_history.back()};
+    std::stringstream report;
+    report<<"Computer plays "<<san<<" ("<<source;
+    if (result.found && source!="book"){
+        report<<", depth "<<result.depth<<", score "<<result.score<<", "<<result.nodes<<" nodes";
+    }
+    report<<")";
+    computer_report = report.str();
+
+    // Guess the reply: second move of the principal variation, or a short search
+    compact_board after {current};
+    after.make_move(choice);
+    compact_move guess;
+    if (result.found && result.pv.size()>=2 && result.pv[0]==choice){
+        guess = result.pv[1];
+    } else {
+        search_result quick {computer.think(after, search_limits{4, 100, 0})};
+        if (!quick.found) return;
+        guess = quick.best;
     }
+    if (!after.is_legal(guess)) return;
+    after.make_move(guess);
+    if (!after.has_legal_move()) return;
+    ponder_key = polyglot_key(after);
+    std::vector<uint64_t> history {played_moves.keys()};
+    history.push_back(polyglot_key(played_moves.current()));
+    computer.set_history(history);
+    computer.start(after, search_limits{});
+    pondering = true;
 }
 
+// Safe cancel of the background search
+void chess::stop_pondering()
+{
+    computer.stop();
+    pondering = false;
+}
 
 // Generate threeats for all of  current player's pieces
 void chess::generate_threats()
@@ -1057,19 +1031,11 @@ void chess::generate_threats()
     // All other pieces do not have moves which cannot capture.
     
     // First: reset the threats for this player
-    piece::reset_threats(current_player);    
-
-    for (int x{1}; x<=8; x++){
-        for (int y{1}; y<=8; y++){
-            if ( (*occupied).count(position(x,y))){
-                //std::cout<<"Generating threats for "<<position(x,y)<<std::endl;
-                piece *temp {(*occupied).at(position(x,y))};
-                
-                if (temp->get_owner()!=current_player){
-                    continue;
-                }
-                (*temp).generate_threats();
-            }
+    board_state.reset_threats(current_player);    
+
+    for (auto iter= (*occupied).begin(); iter!=(*occupied).end(); ++iter){
+        if (iter->first.is_valid() && iter->second->get_owner()==current_player){
+            iter->second->generate_threats();
         }
     }
 
@@ -1082,6 +1048,153 @@ void chess::print_board()
     chess_board.print_board();
 }
 
+// Print the book moves and the collection statistics, then the tablebase verdict and the best move when the tables cover the position
+void chess::print_analysis(const compact_board &current)
+{
+    std::vector<book_entry> book_moves {book.find(current)};
+    if (!book_moves.empty()){
+        uint32_t total{};
+        for (auto &e : book_moves) total += e.weight;
+        std::cout<<"Book moves:";
+        for (auto &e : book_moves){
+            compact_move m;
+            if (!decode_book_move(current, e.move, m)) continue;
+            std::cout<<" "<<move_to_san(current, m);
+            if (total>0) std::cout<<" ("<<(100*e.weight)/total<<"%)";
+        }
+        std::cout<<std::endl;
+    }
+    std::vector<tree_move> played {game_statistics.find(current)};
+    if (!played.empty()){
+        std::cout<<"Played in the collection:";
+        for (auto &t : played){
+            compact_move m;
+            if (!decode_book_move(current, t.move, m)) continue;
+            std::cout<<" "<<move_to_san(current, m)<<" ("<<t.games<<" games, "<<(50*t.score)/t.games<<"%)";
+        }
+        std::cout<<std::endl;
+    }
+    if (!endgame_tables.available()){ // No tables: nothing to add to the search
+        return;
+    }
+    if (!endgame_tables.can_probe(current)){
+        std::cout<<"Analysis: position not covered by the tablebases ("<<current.piece_total()<<" pieces, tables go up to "
+            <<endgame_tables.max_pieces()<<" pieces without castling rights)."<<std::endl;
+        return;
+    }
+
+    chess_vars::probe_state state;
+    chess_vars::wdl_score wdl {endgame_tables.probe_wdl(current, state)};
+    if (state==chess_vars::probe_fail){
+        std::cout<<"Analysis: no table found for this material."<<std::endl;
+        return;
+    }
+    std::string player { current.side_to_move()==chess_vars::white ? "White" : "Black" };
+    std::cout<<"Tablebase: "<<wdl_to_string(wdl)<<" for "<<player;
+    int dtz {endgame_tables.probe_dtz(current, state)};
+    if (state!=chess_vars::probe_fail && wdl!=chess_vars::tb_draw){
+        std::cout<<" (distance to zeroing: "<<abs(dtz)<<" plies)";
+    }
+    std::cout<<std::endl;
+
+    tb_root_move best;
+    if (endgame_tables.best_move(current, best)){
+        std::cout<<"Best move: "<<move_to_san(current, best.move, true)<<std::endl;
+    }
+}
+
+// Analysis mode: the best analysis_lines lines of the position, searched on a background thread until the player presses Enter.
+// The display is redrawn in place after each depth. The player can then step into a line, play any move, or go back:
+// the transposition table is kept, so the search resumes from what it already knows about the new position.
+void chess::analysis_mode()
+{
+    this->stop_pondering();
+    // Lines are branched off the game, which they share: going back stops at the game's position
+    variation line {this->snapshot()};
+    size_t game_length {line.length()};
+    std::vector<std::string> variation_moves;
+    std::vector<search_line> last_lines;
+
+    while (true){
+        const compact_board analysed {line.board()};
+        std::cout<<std::endl<<"Analysis";
+        for (auto &text : variation_moves) std::cout<<" "<<text;
+        std::cout<<std::endl;
+        this->print_analysis(analysed);
+        if (!analysed.has_legal_move()){
+            std::cout<<(analysed.in_check() ? "Checkmate." : "Stalemate.")<<std::endl;
+        } else {
+            std::cout<<"Searching... press Enter to stop."<<std::endl;
+            int printed_lines{};
+            std::mutex display_mutex;
+            search_limits limits;
+            limits.multi_pv = analysis_lines;
+            computer.set_history(line.keys());
+            computer.start(analysed, limits, [&analysed, &printed_lines, &display_mutex](const search_result &result){
+                std::lock_guard<std::mutex> lock(display_mutex);
+                clear_line(printed_lines);
+                printed_lines = 0;
+                for (size_t i{}; i<result.lines.size(); i++){
+                    std::cout<<" "<<i+1<<". "<<score_to_string(result.lines[i].score)<<"  depth "<<result.depth
+                        <<"  nodes "<<result.nodes<<"  nps "<<result.nodes_per_second()<<" :";
+                    std::cout<<" "<<line_to_san(analysed, result.lines[i].pv)<<"\n";
+                    printed_lines++;
+                }
+                std::cout<<std::flush;
+            });
+            std::string input;
+            getline(std::cin, input);
+            computer.stop();
+            last_lines = computer.current_result().lines;
+        }
+
+        if (!last_lines.empty()){
+            std::cout<<"Step into a line (1-"<<last_lines.size()<<"), ";
+        }
+        std::cout<<"Play a move (e.g. Nf3), (B)ack, (C)ontinue, (Q)uit analysis: ";
+        std::string answer;
+        if (!getline(std::cin, answer)) break;
+        compact_move chosen;
+        bool step_in {false};
+        if (answer=="q" || answer=="Q"){
+            break;
+        } else if (answer=="b" || answer=="B"){
+            if (line.length()>game_length){
+                line = line.back();
+                variation_moves.pop_back();
+                last_lines.clear();
+            }
+        } else if (!answer.empty() && std::all_of(answer.begin(), answer.end(), ::isdigit)){
+            // Digits past the range of size_t are refused like any other line number out of range
+            size_t line_number{};
+            auto [end, error] = std::from_chars(answer.data(), answer.data() + answer.size(), line_number);
+            if (error==std::errc() && end==answer.data() + answer.size() && line_number>=1 && line_number<=last_lines.size()
+                && !last_lines[line_number-1].pv.empty()){
+                chosen = last_lines[line_number-1].pv.front();
+                step_in = true;
+            } else {
+                std::cout<<"No such line: "<<answer<<std::endl;
+            }
+        } else if (!answer.empty() && answer!="c" && answer!="C"){
+            step_in = find_san_move(analysed, answer, chosen);
+            if (!step_in) std::cout<<"Move not recognised: "<<answer<<std::endl;
+        }
+        if (step_in){
+            // variation::play does not check the move: a line is only stepped into from the position it was searched in
+            std::vector<compact_move> legal;
+            analysed.generate_legal(legal);
+            if (std::find(legal.begin(), legal.end(), chosen)==legal.end()){
+                std::cout<<"No such line: "<<answer<<std::endl;
+                continue;
+            }
+            line = line.play(chosen);
+            variation_moves.push_back(move_to_san(analysed, chosen, true));
+            last_lines.clear();
+        }
+    }
+    chess_board.print_board();
+}
+
 // End of turn: generate moves and threats and check for endgame
 void chess::update_game_status()
 {
@@ -1095,6 +1208,10 @@ void chess::update_game_status()
 
     //Currently only prints board
     chess_board.print_board();
+    if (!computer_report.empty()){
+        std::cout<<computer_report<<std::endl;
+        computer_report.clear();
+    }
     
     // If initialising a non-default board: need to switch to previous player to generate threats and check for end of game scenario.
     if (!initialisation_requested){
@@ -1103,16 +1220,8 @@ void chess::update_game_status()
         current_player = switch_player(current_player);
     }
 
-    // First calculate threats + defences
-    this -> generate_threats(); 
-    // Switch player
-    current_player = switch_player(current_player); 
+    chess_vars::check_status status {this->next_turn()};
     std::cout<<"Current player: "<<color_to_char(current_player)<<std::endl;   
-    // Then calculate allowed moves (note: this is also done once during initialisation)
-    this -> generate_moves();
-    
-    // If opponent checked: check for checkmate or stalemate
-    chess_vars::check_status status { (*the_kings)[current_player]->is_checkmated() };
     switch (status)
     {
     case chess_vars::nominal:
@@ -1123,6 +1232,55 @@ void chess::update_game_status()
         std::cout<<"CHECK!! CAREFUL..."<<std::endl;
         break;
     case chess_vars::checkmate:
+        std::cout<<"CHECKMATE!!"<<std::endl;
+        this->stop_pondering();
+        autosave.discard(); // Nothing left to recover
+        break;
+    case chess_vars::stalemate:
+        std::cout<<"STALEMATE !!"<<std::endl;
+        this->stop_pondering();
+        autosave.discard();
+        break;
+    case chess_vars::draw:
+        switch (outcome)
+        {
+        case chess_vars::draw_by_repetition:
+            std::cout<<"DRAW: threefold repetition."<<std::endl;
+            break;
+        case chess_vars::draw_by_move_rule:
+            std::cout<<"DRAW: fifty moves without a capture or a pawn move."<<std::endl;
+            break;
+        default:
+            std::cout<<"DRAW: neither side has the material to mate."<<std::endl;
+            break;
+        }
+        this->stop_pondering();
+        autosave.discard();
+        break;
+    default: // Not accessible
+        // TS: error handling
+        break;
+    }
+    
+}
+
+// Hand over to the other player after a move, without printing anything: allowed moves of the next player,
+// then checkmate, stalemate and draw detection (see move_stack::draw_by_rule).
+chess_vars::check_status chess::next_turn(bool claim_draws)
+{
+    // Switch player
+    current_player = switch_player(current_player); 
+    // Then calculate allowed moves (note: this is also done once during initialisation)
+    this -> generate_moves();
+    
+    // The moves are legal: without any, the player is checkmated or stalemated
+    chess_vars::check_status status;
+    if (legal_moves.empty()){
+        status = is_checked[current_player] ? chess_vars::checkmate : chess_vars::stalemate;
+    } else {
+        status = is_checked[current_player] ? chess_vars::check : chess_vars::nominal;
+    }
+    if (status==chess_vars::checkmate){
         // Current player has lost. Update game status.
         current_status = chess_vars::game_over;
         if (current_player==chess_vars::black){
@@ -1130,19 +1288,19 @@ void chess::update_game_status()
         } else {
             outcome = chess_vars::black_won;
         }
-        std::cout<<"CHECKMATE!!"<<std::endl;
-        break;
-    case chess_vars::stalemate:
+    } else if (status==chess_vars::stalemate){
         // Current player has suffered a stalemate. Update game status.
         current_status = chess_vars::game_over;
         outcome = chess_vars::draw_by_stalemate;
-        std::cout<<"STALEMATE !!"<<std::endl;
-        break;
-    default: // Not accessible
-        // TS: error handling
-        break;
+    } else {
+        chess_vars::game_outcome draw {played_moves.draw_by_rule(claim_draws)};
+        if (draw!=chess_vars::ongoing){
+            current_status = chess_vars::game_over;
+            outcome = draw;
+            status = chess_vars::draw;
+        }
     }
-    
+    return status;
 }
 
 
@@ -1224,6 +1382,12 @@ void chess::save_game()
     }
 
     std::ofstream file(save_location);
+    // Files named .fen hold the position alone, for other chess programs
+    if (save_location.size()>4 && get_lower(save_location.substr(save_location.size()-4))==".fen"){
+        file << this->to_fen() << std::endl;
+        file.close();
+        return;
+    }
     // Save current status of game to file
     file << "---GAME_STATUS---" << std::endl;
     file << current_player<<std::endl;
@@ -1233,7 +1397,10 @@ void chess::save_game()
         piece* temp {iter->second};
         file << temp->location().x() <<" "<< temp->location().y() <<" "<< temp->get_owner() << " "<< temp->get_abbrev()<<std::endl;
     }
-    file << "---MOVE_HISTORY---" << std::endl; //TS: not currently supported
+    file << "---MOVE_HISTORY---" << std::endl; // One move per line, for reference: loading starts from the positions above
+    for (auto &san : move_history){
+        file << san << std::endl;
+    }
     
     file.close();
 }
@@ -1250,7 +1417,8 @@ void chess::load_game()
         save_location = requested_location;
     }
     // Hard reset of game: required, even if loading fails
-    piece::reset_occupied_spaces();
+    board_state.reset_occupied_spaces();
+    move_history.clear();
 
     std::fstream file(save_location);
     std::stringstream input_stream;
@@ -1263,9 +1431,16 @@ void chess::load_game()
         throw LoadFileException("File did not open.");
     }
     getline(file,line);
+    if (line.find('/')!=std::string::npos){ // A position in Forsyth-Edwards Notation (e.g. saved to a .fen file)
+        if (!this->load_fen(line)){
+            throw LoadFileException("The position was not recognised as a valid FEN: "+line);
+        }
+        file.close();
+        return;
+    }
     to_lower(line);
     if (line.find(header,0)==std::string::npos){
-        throw LoadFileException("File structure was not recognised: expected \""+header+"\"");
+        throw LoadFileException("File structure was not recognised: expected \""+header+"\" or a FEN");
     }
     int player_, status_;
     file >> player_ >> status_;
@@ -1305,7 +1480,9 @@ void chess::load_game()
     int count_of_pieces{};
     std::map<chess_vars::player_color, king*> loaded_kings;
     
-    loaded_positions.clear();
+    // The pieces are set up and checked on a board of their own, which only replaces the game's once found valid
+    position_state loading;
+    std::map<position, piece*> &loaded_positions {loading.occupied_squares};
     while(line.find(moves_line,0)==std::string::npos){
         file >> x_ >> y_ >> owner_ >> abbrev_;
         file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -1341,7 +1518,7 @@ void chess::load_game()
         if (loaded_positions.count(that_pos)>0){
             throw OvercrowdedPosition(that_pos.x(),that_pos.y());            
         }
-        loaded_positions[that_pos] = piece_initialiser(that_color, that_piece, that_pos);
+        loaded_positions[that_pos] = piece_initialiser(loading, that_color, that_piece, that_pos);
         if (that_piece==chess_vars::king){
             if (loaded_kings.count(that_color)!=0){
                 throw TooManyKingsException(that_color);
@@ -1402,9 +1579,9 @@ void chess::load_game()
                     default:
                         break;
                     }
-                    delete loaded_positions.at(check_position);
+                    loading.release(loaded_positions.at(check_position));
                     loaded_positions.erase(check_position);
-                    piece* temp {promote_piece(current_player, check_position, promotion_type)};
+                    piece* temp {promote_piece(loading, current_player, check_position, promotion_type)};
                     loaded_positions[check_position] = temp;
                 }
             }
@@ -1414,8 +1591,8 @@ void chess::load_game()
     }
 
     // Check if game status has been left in check.
-    piece::reset_threats(temp_color);  
-    piece::reset_threats(switch_player(temp_color));  
+    loading.reset_threats(temp_color);  
+    loading.reset_threats(switch_player(temp_color));  
     
     // Reset and generate threats for both players (although probably sufficient just to reset/restart the enemy threats).
     for (std::map<position, piece*>::iterator iter= loaded_positions.begin(); iter!=loaded_positions.end(); ++iter){
@@ -1424,15 +1601,17 @@ void chess::load_game()
     }
 
     // Check that the previous player's king was not left in a threatened square: if they are, this would not picked up by is_checkmated().
-    if (piece::is_threatened(loaded_kings[switch_player(temp_color)])){
+    if (loading.is_threatened(loaded_kings[switch_player(temp_color)])){
         throw LoadFileException("The previous player has left their king in a state of check. The game position is thus invalid.");
     }
 
     // All in order. Game status will be checked on initialisation. Perform transaction to game variables.
     current_player = temp_color;
     current_status = temp_status;
-    occupied = &loaded_positions;
-    the_kings = &loaded_kings;
+    board_state.adopt(loading);
+    occupied = board_state.get_locations();
+    chess_board.load_board(*occupied, loaded_kings);
+    the_kings = &chess_board.get_the_kings();
     initialisation_requested = true;
 
     file.close();
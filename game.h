@@ -6,6 +6,14 @@
 #include "pieces.cpp"
 
 #include "board.h"
+#include "tablebase.h"
+#include "opening_book.h"
+#include "opening_tree.h"
+#include "engine.h"
+#include "notation.h"
+#include "move_journal.h"
+#include "move_stack.h"
+#include "board_snapshot.h"
 #include "utils.cpp"
 
 #pragma once
@@ -14,22 +22,43 @@
 class chess
 {
     private:
-        board chess_board{piece::get_locations()}; 
+        position_state board_state; // Pieces of this game: each game has its own
+        board chess_board{board_state}; 
         chess_vars::game_option current_option {chess_vars::p_v_p}; // Play option: currently only pvp is supported
         chess_vars::player_color main_player {chess_vars::white}; // Which player to print on bottom of board
         chess_vars::player_color current_player {chess_vars::white}; // Which player is currently active
         chess_vars::setup setup_type { chess_vars::default_board }; // Allows for loading of previous games
         chess_vars::game_status current_status { chess_vars::game_on }; // Track if game is on or over
         chess_vars::game_outcome outcome { chess_vars::ongoing }; // Track the outcome of a game
-        std::map<position, piece*> loaded_positions; // Load positions from previous game to the board
-        std::map<position, piece*>* occupied {piece::get_locations()}; // Track locations of pieces on the board
-        std::map<position, std::vector<piece*>>* accessible_squares {piece::get_destinations()}; // Track the pieces which can access any given square
+        std::map<position, piece*>* occupied {board_state.get_locations()}; // Track locations of pieces on the board
+        std::map<position, std::vector<piece*>>* accessible_squares {board_state.get_destinations()}; // Track the pieces which can access any given square
 
         std::map<chess_vars::player_color, std::deque<std::string>> premoves; // Allow players to store moves
         std::map<chess_vars::player_color, king*>* the_kings; // Need to track kings' position to check for checks and checkmate
         std::map<chess_vars::player_color, bool> is_checked; // Track status of kings
+        std::vector<compact_move> legal_moves; // Legal moves of the current player, from the compact board
 
         std::string save_location{"foobar.txt"}; // Default name for the savefile
+        std::vector<std::string> move_history; // Moves played since the start of the game, in SAN
+        compact_board requested_position; // Position and move of the last move interpreted, to add it to the history
+        compact_move requested_move;
+        move_stack played_moves; // Moves of the game on a compact board, for undo and redo
+        int halfmove_clock {0}; // Plies since the last capture or pawn move
+        int fullmove_number {1};
+        tablebase endgame_tables; // Syzygy tables, found through the SYZYGY_PATH environment variable
+        opening_book book; // Polyglot book, found through the CHESS_BOOK environment variable
+        opening_tree game_statistics; // Opening tree index, found through the CHESS_TREE environment variable
+        move_journal autosave; // Journal of the moves of the game in progress, at the path in CHESS_AUTOSAVE
+        std::string autosave_path;
+
+        // Computer player (PvC): thinks for computer_think_ms, then ponders on the expected reply while the player thinks
+        engine computer;
+        chess_vars::player_color computer_color {chess_vars::black};
+        int64_t computer_think_ms {2000};
+        bool pondering {false};
+        uint64_t ponder_key {0}; // Position searched while pondering
+        std::string computer_report; // Printed under the board after the computer's move
+        int analysis_lines {3}; // Number of lines shown by the analysis mode
 
         chess_vars::request current_request; // Current user request type for a move
         bool is_ready_status {false}; 
@@ -39,6 +68,25 @@ class chess
     public:
         chess()
         {
+            if (const char* syzygy_path = std::getenv("SYZYGY_PATH")){
+                endgame_tables.set_paths(syzygy_path);
+            }
+            if (const char* book_path = std::getenv("CHESS_BOOK")){
+                book.open(book_path);
+            }
+            if (const char* tree_path = std::getenv("CHESS_TREE")){
+                game_statistics.open(tree_path);
+            }
+            if (const char* journal_path = std::getenv("CHESS_AUTOSAVE")){
+                autosave_path = journal_path;
+                // Optional batching, "<moves>,<milliseconds>,<moves between snapshots>"
+                size_t sync_moves{16}, compact_moves{256};
+                long long sync_ms{1000};
+                if (const char* policy = std::getenv("CHESS_AUTOSAVE_SYNC")){
+                    std::sscanf(policy, "%zu,%lld,%zu", &sync_moves, &sync_ms, &compact_moves);
+                }
+                autosave.set_policy(sync_moves, sync_ms, compact_moves);
+            }
             // While troubleshooting: option to load some basic premoves
             
             //premoves[chess_vars::white] = {"g4","f3","g5","g6","gxf","fxg"};//
@@ -59,18 +107,44 @@ class chess
         void load_game();
         void save_game();
         void initialise_game();
+        void reset_board();
+        bool load_fen(std::string_view);
+        std::string to_fen();
+        compact_board start_position();
+        void set_up_pieces(const compact_board&);
+        void take_position_state(const compact_board&);
+        void take_back_pieces(const undo_record&, const compact_board&);
+        void start_autosave();
+        bool recover_autosave();
         chess_vars::request get_request();
         chess_vars::setup get_setup();
-        void undo_last_move();
+        bool undo_last_move();
+        bool redo_move();
+        void resume_from_stack();
+        void record_move(const compact_board&, const compact_move&);
+        variation snapshot();
         void generate_moves();
         void generate_threats();
         void update_game_status();
+        chess_vars::check_status next_turn(bool claim_draws=true);
         bool over();
         bool is_ready();
         bool keep_going(){return true;}
         bool resume_game();
         bool want_initialisation();
         bool make_move(move_request, piece*, piece*);
+        move_request interpret_move(std::string_view);
+        bool resolve_move(move_request&, piece*&, piece*&);
+        bool play_move(const compact_move&);
+        int replay_game(const std::vector<std::string>&, std::string&);
+        chess_vars::game_outcome get_outcome()
+        {
+            return outcome;
+        }
+        void computer_move();
+        void stop_pondering();
+        void print_analysis(const compact_board&);
+        void analysis_mode();
         //TS:
         void print_accessible_squares();
         void print_board();
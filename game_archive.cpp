@@ -0,0 +1,284 @@
+// Game archive, part of the C++ Chess Project.
+
+#include <algorithm>
+
+#include "game_archive.h"
+#include "pgn.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Order of the legal moves: origin, then destination, then promotion
+uint16_t archive_key(const compact_move &m)
+{
+    return static_cast<uint16_t>((m.from << 10) | (m.to << 4) | m.promotion);
+}
+
+bool archive_order(const compact_move &a, const compact_move &b)
+{
+    return archive_key(a) < archive_key(b);
+}
+
+// Squares of the pieces of the side to move: the moves are indexed origin first, so these are visited lowest first
+uint64_t archive_origins(const compact_board &board)
+{
+    uint64_t origins{};
+    for (int type{chess_vars::pawn}; type<=chess_vars::king; type++){
+        origins |= board.pieces(board.side_to_move(), static_cast<chess_vars::piece_type>(type));
+    }
+    return origins;
+}
+
+// Legal moves of the piece on one square, read against the threats of the board (see compact_board::find_threats), in a
+// buffer kept by each thread. Moves from different squares never need comparing: only the square of the move looked for
+// has its moves put in order.
+std::vector<compact_move> &archive_moves_from(const compact_board &board, const threat_map &map, int square)
+{
+    thread_local std::vector<compact_move> moves;
+    moves.clear();
+    board.generate_pseudo_legal_from(square, moves);
+    moves.erase(std::remove_if(moves.begin(), moves.end(), [&](const compact_move &m){ return !board.is_legal(m, map); }), moves.end());
+    return moves;
+}
+
+// Only the squares up to the origin of the move are visited
+int encode_move(const compact_board &board, const compact_move &m)
+{
+    threat_map map;
+    board.find_threats(map);
+    int before{};
+    for (uint64_t set {archive_origins(board) & ((uint64_t{2} << m.from) - 1)}; set!=0; set &= set - 1){
+        int square {lowest_square(set)};
+        const std::vector<compact_move> &moves {archive_moves_from(board, map, square)};
+        if (square<m.from){
+            before += static_cast<int>(moves.size());
+        } else if (std::find(moves.begin(), moves.end(), m)!=moves.end()){
+            return before + static_cast<int>(std::count_if(moves.begin(), moves.end(), [&m](const compact_move &other){
+                return archive_order(other, m);
+            }));
+        }
+    }
+    return -1;
+}
+
+// The search stops at the square holding the move with the index
+bool decode_move(const compact_board &board, uint8_t index, compact_move &m)
+{
+    threat_map map;
+    board.find_threats(map);
+    size_t remaining {index};
+    for (uint64_t set {archive_origins(board)}; set!=0; set &= set - 1){
+        std::vector<compact_move> &moves {archive_moves_from(board, map, lowest_square(set))};
+        if (remaining>=moves.size()){
+            remaining -= moves.size();
+            continue;
+        }
+        std::nth_element(moves.begin(), moves.begin() + static_cast<std::ptrdiff_t>(remaining), moves.end(), archive_order);
+        m = moves[remaining];
+        return true;
+    }
+    return false;
+}
+
+archive_result result_code(std::string_view result)
+{
+    if (result=="1-0") return archive_white_won;
+    if (result=="0-1") return archive_black_won;
+    if (result=="1/2-1/2") return archive_draw;
+    return archive_unknown;
+}
+
+std::string_view result_text(archive_result result)
+{
+    switch (result)
+    {
+    case archive_white_won: return "1-0";
+    case archive_black_won: return "0-1";
+    case archive_draw: return "1/2-1/2";
+    default: return "*";
+    }
+}
+
+std::string_view archive_game::tag(std::string_view name) const
+{
+    for (auto &t : tags){
+        if (t.name==name) return t.value;
+    }
+    return std::string_view();
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Writing %%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+void archive_put(std::string &out, uint64_t value, int bytes)
+{
+    for (int b{bytes-1}; b>=0; b--){
+        out += static_cast<char>((value >> (8*b)) & 0xFF);
+    }
+}
+
+bool game_archive_writer::open(std::string path)
+{
+    close();
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()){
+        std::cerr<<"WARNING: could not create "<<path<<std::endl;
+        return false;
+    }
+    block_offsets.clear();
+    games_written = moves_written = games_skipped = 0;
+    // The game count and the index offset are filled in by close()
+    record.assign(archive_magic, 4);
+    archive_put(record, archive_version, 4);
+    archive_put(record, 0, 16);
+    file.write(record.data(), static_cast<std::streamsize>(record.size()));
+    return file.good();
+}
+
+bool game_archive_writer::add(const pgn_game &game)
+{
+    if (!file.is_open()) return false;
+    compact_board board {compact_board::starting_position()};
+    std::string_view fen {game.tag("FEN")};
+    if ((!fen.empty() && !compact_board::from_fen(fen, board)) || game.moves.size()>0xFFFF){
+        games_skipped++;
+        return false;
+    }
+
+    // Moves first, so that nothing is written for a game which stops on a bad move
+    move_indices.clear();
+    compact_move m;
+    for (auto &san : game.moves){
+        if (read_san(board, san, m)!=san_ok){
+            games_skipped++;
+            return false;
+        }
+        move_indices += static_cast<char>(encode_move(board, m));
+        board.make_move(m);
+    }
+    size_t tag_bytes{};
+    for (auto &t : game.tags) tag_bytes += t.name.size() + t.value.size() + 2;
+    if (tag_bytes>0xFFFF){
+        games_skipped++;
+        return false;
+    }
+
+    record.clear();
+    archive_put(record, tag_bytes, 2);
+    archive_put(record, move_indices.size(), 2);
+    record += static_cast<char>(result_code(game.result));
+    for (auto &t : game.tags){
+        record.append(t.name.data(), t.name.size());
+        record += '\0';
+        record.append(t.value.data(), t.value.size());
+        record += '\0';
+    }
+    record += move_indices;
+    if (games_written%block_games==0) block_offsets.push_back(static_cast<uint64_t>(file.tellp()));
+    file.write(record.data(), static_cast<std::streamsize>(record.size()));
+    games_written++;
+    moves_written += game.moves.size();
+    return file.good();
+}
+
+bool game_archive_writer::close()
+{
+    if (!file.is_open()) return false;
+    uint64_t index_offset {static_cast<uint64_t>(file.tellp())};
+    record.clear();
+    for (auto offset : block_offsets) archive_put(record, offset, 8);
+    file.write(record.data(), static_cast<std::streamsize>(record.size()));
+    record.clear();
+    archive_put(record, games_written, 8);
+    archive_put(record, index_offset, 8);
+    file.seekp(8);
+    file.write(record.data(), static_cast<std::streamsize>(record.size()));
+    bool written {file.good()};
+    file.close();
+    return written;
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Reading %%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+bool game_archive::open(std::string path)
+{
+    game_count = 0;
+    index = nullptr;
+    if (!file.open(path)){
+        std::cerr<<"WARNING: could not open the game archive "<<path<<std::endl;
+        return false;
+    }
+    uint64_t index_offset {file.size()>=archive_header_size ? read_be64(file.data()+16) : 0};
+    uint64_t count {file.size()>=archive_header_size ? read_be64(file.data()+8) : 0};
+    uint64_t blocks {(count + block_games - 1)/block_games};
+    if (file.size()<archive_header_size || !std::equal(archive_magic, archive_magic+4, reinterpret_cast<const char*>(file.data()))
+        || read_be32(file.data()+4)!=archive_version || index_offset<archive_header_size || index_offset>file.size()
+        || blocks>(file.size() - index_offset)/8){
+        std::cerr<<"WARNING: "<<path<<" is not a game archive"<<std::endl;
+        file.close();
+        return false;
+    }
+    game_count = count;
+    index = file.data() + index_offset;
+    cursor_game = 0;
+    cursor_offset = archive_header_size;
+    return true;
+}
+
+// Move offset past the game starting there. Returns false if the game runs past the end of the games.
+bool game_archive::skip(uint64_t &offset) const
+{
+    uint64_t end {static_cast<uint64_t>(index - file.data())};
+    if (offset + 5>end) return false;
+    offset += 5 + read_be16(file.data() + offset) + read_be16(file.data() + offset + 2);
+    return offset<=end;
+}
+
+bool game_archive::read(uint64_t n, archive_game &game, bool decode_moves)
+{
+    if (n>=game_count) return false;
+    uint64_t offset {cursor_offset};
+    if (n!=cursor_game){
+        offset = read_be64(index + 8*(n/block_games));
+        for (uint64_t k{}; k<n%block_games; k++){
+            if (!skip(offset)) return false;
+        }
+    }
+    uint64_t start {offset};
+    if (!skip(offset)) return false;
+    cursor_game = n + 1;
+    cursor_offset = offset;
+
+    const uint8_t *p {file.data() + start};
+    size_t tag_bytes {read_be16(p)}, move_count {read_be16(p+2)};
+    game.result = static_cast<archive_result>(std::min<uint8_t>(p[4], archive_draw));
+    game.tags.clear();
+    std::string_view tag_text {reinterpret_cast<const char*>(p+5), tag_bytes};
+    while (!tag_text.empty()){
+        size_t name_end {tag_text.find('\0')};
+        size_t value_end {name_end==std::string_view::npos ? name_end : tag_text.find('\0', name_end + 1)};
+        if (value_end==std::string_view::npos) return false;
+        game.tags.push_back(pgn_tag{tag_text.substr(0, name_end), tag_text.substr(name_end + 1, value_end - name_end - 1)});
+        tag_text.remove_prefix(value_end + 1);
+    }
+
+    game.start = compact_board::starting_position();
+    std::string_view fen {game.tag("FEN")};
+    if (!fen.empty() && !compact_board::from_fen(fen, game.start)) return false;
+    game.moves.clear();
+    if (!decode_moves) return true;
+
+    compact_board board {game.start};
+    compact_move m;
+    const uint8_t *indices {p + 5 + tag_bytes};
+    for (size_t k{}; k<move_count; k++){
+        if (!decode_move(board, indices[k], m)) return false;
+        game.moves.push_back(m);
+        board.make_move(m);
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+// Game archive, part of the C++ Chess Project.
+// A binary container for large game collections, about one byte per move:
+// - each move is stored as its index among the legal moves of the position, sorted by origin, destination and promotion,
+//   so the index never depends on the order the move generator happens to use
+// - each game keeps its tags and result in a short header; games starting from a FEN tag are replayed from that position
+// - a block index gives the offset of every block_games-th game, for random access
+// File layout (big-endian, like the opening books):
+// - header: magic "CGAM", version, number of games (8), offset of the block index (8)
+// - games: tag bytes (2), moves (2), result (1), then the tags as name\0value\0 pairs and one byte per move
+// - block index: offset of games 0, block_games, 2*block_games,... (8 bytes each)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+
+#include "compact_board.h"
+#include "mapped_file.h"
+#include "pgn.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+const char archive_magic[4] {'C', 'G', 'A', 'M'};
+const uint32_t archive_version {1};
+const size_t archive_header_size {24};
+const uint64_t block_games {64};
+
+// Index of a legal move among the legal moves of the board, or -1 if the move is not legal
+int encode_move(const compact_board &board, const compact_move &m);
+// Legal move with the given index. Returns false if the board has fewer legal moves.
+bool decode_move(const compact_board &board, uint8_t index, compact_move &m);
+
+// Results stored in one byte
+enum archive_result{
+    archive_unknown = 0, // *
+    archive_white_won,
+    archive_black_won,
+    archive_draw
+};
+archive_result result_code(std::string_view result);
+std::string_view result_text(archive_result result);
+
+// One game read back from an archive. Tags point into the mapped file.
+struct archive_game
+{
+    std::vector<pgn_tag> tags;
+    archive_result result{archive_unknown};
+    compact_board start;              // Standard start, or the position of the FEN tag
+    std::vector<compact_move> moves;
+
+    std::string_view tag(std::string_view name) const;
+};
+
+class game_archive_writer
+{
+    private:
+        std::ofstream file;
+        std::vector<uint64_t> block_offsets;
+        uint64_t games_written{0}, moves_written{0}, games_skipped{0};
+        std::string record, move_indices; // Reused between games
+    public:
+        game_archive_writer() = default;
+        ~game_archive_writer(){ close(); }
+
+        bool open(std::string path);
+        // Games whose moves cannot all be read, or which have over 65535 moves or tag bytes, are skipped: returns false.
+        bool add(const pgn_game &game);
+        // Writes the block index and completes the header
+        bool close();
+
+        uint64_t games() const
+        {
+            return games_written;
+        }
+        uint64_t moves() const
+        {
+            return moves_written;
+        }
+        uint64_t skipped() const
+        {
+            return games_skipped;
+        }
+};
+
+class game_archive
+{
+    private:
+        mapped_file file;
+        uint64_t game_count{0};
+        const uint8_t *index{nullptr};
+        // The last game read, so that games read in order are found without going back to the index
+        uint64_t cursor_game{0}, cursor_offset{0};
+
+        bool skip(uint64_t &offset) const;
+    public:
+        game_archive() = default;
+        game_archive(std::string path){ open(path); }
+
+        bool open(std::string path);
+        bool is_open() const
+        {
+            return file.is_open();
+        }
+        uint64_t size() const
+        {
+            return game_count;
+        }
+        // Game n, from 0. Without decode_moves, only the tags, result and start position are read.
+        bool read(uint64_t n, archive_game &game, bool decode_moves=true);
+};
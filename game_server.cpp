@@ -0,0 +1,386 @@
+// Game server, part of the C++ Chess Project.
+
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <csignal>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "game_server.h"
+#include "pgn_pipeline.cpp"
+#include "notation.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Entry of a game in the table: node of the map (next pointer, key, shared pointer) and the control block allocated
+// with the game. The buckets are counted separately.
+const size_t game_entry_bytes {sizeof(void*) + sizeof(std::pair<const uint64_t, std::shared_ptr<server_game>>) + 16};
+// A client sending more than this without a new line is dropped
+const size_t max_request_bytes {1 << 16};
+// Requests answered for one connection before the thread moves on to the next one waiting
+const int requests_per_turn {16};
+
+size_t server_game::footprint() const
+{
+    return sizeof(server_game) + moves.capacity()*sizeof(compact_move) + game_entry_bytes;
+}
+
+std::string_view game_status_word(const compact_board &board)
+{
+    bool check {board.in_check()};
+    if (!board.has_legal_move()) return check ? "checkmate" : "stalemate";
+    return check ? "check" : "ongoing";
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Latencies %%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+int latency_histogram::bucket(uint64_t micros)
+{
+    if (micros<exact_buckets) return static_cast<int>(micros);
+    int top_bit{6};
+    while (micros >> (top_bit + 1)) top_bit++;
+    int step {top_bit - 5}; // 32 buckets between 2^top_bit and 2^(top_bit+1)
+    return exact_buckets + (top_bit - 6)*octave_buckets + static_cast<int>((micros >> step) & (octave_buckets - 1));
+}
+
+uint64_t latency_histogram::bucket_top(int index)
+{
+    if (index<exact_buckets) return static_cast<uint64_t>(index);
+    int top_bit {6 + (index - exact_buckets)/octave_buckets};
+    uint64_t sub {static_cast<uint64_t>((index - exact_buckets)%octave_buckets)};
+    return ((octave_buckets + sub + 1) << (top_bit - 5)) - 1;
+}
+
+void latency_histogram::add(uint64_t micros)
+{
+    counts[bucket(micros)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t seen {largest.load(std::memory_order_relaxed)};
+    while (micros>seen && !largest.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {}
+}
+
+uint64_t latency_histogram::total() const
+{
+    uint64_t sum{};
+    for (auto &count : counts) sum += count.load(std::memory_order_relaxed);
+    return sum;
+}
+
+uint64_t latency_histogram::percentile(double fraction) const
+{
+    uint64_t samples {total()};
+    if (samples==0) return 0;
+    uint64_t wanted {std::max<uint64_t>(1, static_cast<uint64_t>(fraction*static_cast<double>(samples) + 0.5))};
+    uint64_t seen{};
+    for (int index{}; index<bucket_count; index++){
+        seen += counts[index].load(std::memory_order_relaxed);
+        if (seen>=wanted) return std::min(bucket_top(index), max());
+    }
+    return max();
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Requests %%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+game_server::game_server(unsigned threads)
+    : thread_count{threads>0 ? threads : 1}, work{std::numeric_limits<size_t>::max()}
+{
+}
+
+bool read_game_number(std::string_view id, uint64_t &number)
+{
+    number = 0;
+    for (char c : id){
+        if (c<'0' || c>'9' || number>std::numeric_limits<uint64_t>::max()/10 - 1) return false;
+        number = number*10 + static_cast<uint64_t>(c - '0');
+    }
+    return !id.empty();
+}
+
+std::shared_ptr<server_game> game_server::find_game(uint64_t number)
+{
+    std::shared_lock<std::shared_mutex> guard {games_lock};
+    auto found {games.find(number)};
+    return found==games.end() ? nullptr : found->second;
+}
+
+// Answer to one request line, without the new line
+std::string game_server::answer(const std::string &line, bool &is_move, bool &quit)
+{
+    std::stringstream args {line};
+    std::string command, id;
+    if (!(args>>command)) return "error empty request";
+
+    if (command=="new"){
+        std::string fen;
+        std::getline(args, fen);
+        auto game {std::make_shared<server_game>()};
+        size_t first_char {fen.find_first_not_of(" \t\r")};
+        if (first_char==std::string::npos){
+            game->board = compact_board::starting_position();
+        } else if (!compact_board::from_fen(std::string_view(fen).substr(first_char), game->board)){
+            return "error invalid fen";
+        }
+        std::unique_lock<std::shared_mutex> guard {games_lock};
+        uint64_t number {next_game++};
+        games.emplace(number, std::move(game));
+        return "ok " + std::to_string(number);
+    }
+    if (command=="stats"){
+        return "ok " + statistics();
+    }
+    if (command=="quit"){
+        quit = true;
+        return "ok";
+    }
+    if (command=="shutdown"){
+        stop();
+        return "ok";
+    }
+
+    bool known {command=="move" || command=="board" || command=="status" || command=="moves" || command=="close"};
+    if (!known) return "error unknown command " + command;
+    uint64_t number{};
+    if (!(args>>id)) return "error missing game";
+    if (!read_game_number(id, number)) return "error no game " + id;
+    if (command=="close"){
+        std::unique_lock<std::shared_mutex> guard {games_lock};
+        return games.erase(number)==1 ? "ok" : "error no game " + id;
+    }
+    // A game closed meanwhile stays alive until this request is answered
+    std::shared_ptr<server_game> game {find_game(number)};
+    if (!game) return "error no game " + id;
+    std::lock_guard<std::mutex> guard {game->lock};
+    compact_board &board {game->board};
+
+    if (command=="board"){
+        return "ok " + board.to_fen();
+    }
+    if (command=="status"){
+        return std::string("ok ") + (board.side_to_move()==chess_vars::white ? "white " : "black ")
+            + std::string(game_status_word(board)) + " " + std::to_string(game->moves.size());
+    }
+    std::vector<compact_move> legal;
+    board.generate_legal(legal);
+    if (command=="moves"){
+        std::string list {"ok"};
+        for (auto &m : legal) list += " " + move_to_string(m);
+        return list;
+    }
+
+    // move
+    is_move = true;
+    std::string text;
+    if (!(args>>text)) return "error missing move";
+    if (legal.empty()) return "error game over";
+    compact_move found;
+    auto coordinates {std::find_if(legal.begin(), legal.end(), [&text](const compact_move &m){ return move_to_string(m)==get_lower(text); })};
+    if (coordinates!=legal.end()){
+        found = *coordinates;
+    } else {
+        san_status status {read_san(board, text, found)};
+        if (status!=san_ok) return "error " + std::string(san_status_message(status)) + ": " + text;
+    }
+    std::string san {move_to_san(board, found, true)};
+    board.make_move(found);
+    game->moves.push_back(found);
+    return "ok " + san + " " + std::string(game_status_word(board));
+}
+
+// Cut what a client sent into lines, and hand the connection to the pool if it is not there already
+void game_server::receive(const std::shared_ptr<connection> &client, const char *data, size_t size)
+{
+    auto now {std::chrono::steady_clock::now()};
+    client->partial.append(data, size);
+    size_t start{}, end{};
+    bool any {false};
+    std::lock_guard<std::mutex> guard {client->lock};
+    while ((end = client->partial.find('\n', start))!=std::string::npos){
+        client->pending.push_back(request_line{client->partial.substr(start, end - start), now});
+        start = end + 1;
+        any = true;
+    }
+    client->partial.erase(0, start);
+    if (any && !client->scheduled){
+        client->scheduled = true;
+        work.push(client);
+    }
+}
+
+// A thread of the pool: answers the requests of one connection at a time, a few in a row
+void game_server::work_loop()
+{
+    std::shared_ptr<connection> client;
+    while (work.pop(client)){
+        for (int turn{}; ; turn++){
+            request_line request;
+            {
+                std::lock_guard<std::mutex> guard {client->lock};
+                if (client->pending.empty()){
+                    client->scheduled = false;
+                    break;
+                }
+                if (turn==requests_per_turn){
+                    // Still scheduled: back in the queue, behind the connections waiting
+                    work.push(client);
+                    break;
+                }
+                request = std::move(client->pending.front());
+                client->pending.pop_front();
+            }
+            bool is_move{false}, quit{false};
+            std::string reply {answer(request.text, is_move, quit)};
+            reply += '\n';
+#ifndef _WIN32
+            const char *out {reply.data()};
+            size_t left {reply.size()};
+            while (left>0){
+                ssize_t written {::write(client->fd, out, left)};
+                if (written<0 && errno==EINTR) continue;
+                if (written<=0) break; // The client left: its connection is dropped by the socket thread
+                out += written;
+                left -= static_cast<size_t>(written);
+            }
+            if (quit) ::shutdown(client->fd, SHUT_RDWR);
+#endif
+            if (is_move){
+                auto elapsed {std::chrono::steady_clock::now() - request.received};
+                move_latency.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+            }
+        }
+        client.reset();
+    }
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Socket %%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+game_server::connection::~connection()
+{
+#ifndef _WIN32
+    if (fd>=0) ::close(fd);
+#endif
+}
+
+void game_server::stop()
+{
+    stopping = true;
+#ifndef _WIN32
+    if (wake_pipe[1]>=0){
+        char wake {1};
+        ssize_t ignored {::write(wake_pipe[1], &wake, 1)};
+        (void)ignored;
+    }
+#endif
+}
+
+bool game_server::run(std::string path)
+{
+#ifdef _WIN32
+    std::cerr<<"WARNING: the server needs Unix sockets, which this build does not support"<<std::endl;
+    return false;
+#else
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size()>=sizeof(address.sun_path)){
+        std::cerr<<"WARNING: the socket path must be between 1 and "<<sizeof(address.sun_path)-1<<" characters"<<std::endl;
+        return false;
+    }
+    std::copy(path.begin(), path.end(), address.sun_path);
+    std::signal(SIGPIPE, SIG_IGN); // Writing to a client which left fails instead
+    ::unlink(path.c_str()); // Socket left by a previous server
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd<0 || ::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))<0
+        || ::listen(listen_fd, SOMAXCONN)<0 || ::pipe(wake_pipe)<0){
+        std::cerr<<"WARNING: could not listen on "<<path<<std::endl;
+        if (listen_fd>=0) ::close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+
+    std::vector<std::thread> pool;
+    for (unsigned t{}; t<thread_count; t++) pool.emplace_back(&game_server::work_loop, this);
+
+    std::vector<std::shared_ptr<connection>> clients;
+    std::vector<pollfd> watched;
+    std::vector<char> buffer(1 << 16);
+    while (!stopping){
+        watched.clear();
+        watched.push_back(pollfd{wake_pipe[0], POLLIN, 0});
+        watched.push_back(pollfd{listen_fd, POLLIN, 0});
+        for (auto &client : clients) watched.push_back(pollfd{client->fd, POLLIN, 0});
+        if (::poll(watched.data(), watched.size(), -1)<0){
+            if (errno==EINTR) continue;
+            std::cerr<<"WARNING: the server stopped watching its clients"<<std::endl;
+            break;
+        }
+        if (watched[0].revents) break;
+
+        size_t watched_clients {clients.size()};
+        for (size_t k{}; k<watched_clients; k++){
+            if (!watched[k+2].revents) continue;
+            ssize_t got {::read(clients[k]->fd, buffer.data(), buffer.size())};
+            if (got<0 && errno==EINTR) continue;
+            if (got<=0 || clients[k]->partial.size() + static_cast<size_t>(got)>max_request_bytes){
+                clients[k].reset(); // Closed once the pool is done with it
+                continue;
+            }
+            receive(clients[k], buffer.data(), static_cast<size_t>(got));
+        }
+        clients.erase(std::remove(clients.begin(), clients.end(), nullptr), clients.end());
+        if (watched[1].revents & POLLIN){
+            int client_fd {::accept(listen_fd, nullptr, nullptr)};
+            if (client_fd>=0) clients.push_back(std::make_shared<connection>(client_fd));
+        }
+    }
+
+    work.close();
+    for (auto &thread : pool) thread.join();
+    clients.clear();
+    ::close(listen_fd);
+    ::unlink(path.c_str());
+    listen_fd = -1;
+    ::close(wake_pipe[0]);
+    ::close(wake_pipe[1]);
+    wake_pipe[0] = wake_pipe[1] = -1;
+    return true;
+#endif
+}
+
+size_t game_server::game_count()
+{
+    std::shared_lock<std::shared_mutex> guard {games_lock};
+    return games.size();
+}
+
+size_t game_server::bytes_per_game()
+{
+    std::shared_lock<std::shared_mutex> guard {games_lock};
+    if (games.empty()) return 0;
+    size_t bytes {games.bucket_count()*sizeof(void*)};
+    for (auto &entry : games){
+        std::lock_guard<std::mutex> game_guard {entry.second->lock};
+        bytes += entry.second->footprint();
+    }
+    return bytes/games.size();
+}
+
+std::string game_server::statistics()
+{
+    std::stringstream text;
+    text<<"games "<<game_count()<<" bytes_per_game "<<bytes_per_game()<<" moves "<<move_latency.total()
+        <<" p50_us "<<move_latency.percentile(0.5)<<" p99_us "<<move_latency.percentile(0.99)<<" max_us "<<move_latency.max();
+    return text.str();
+}
@@ -0,0 +1,121 @@
+// Game server, part of the C++ Chess Project.
+// Started with --serve: hosts any number of independent games in one process, for clients on a local Unix socket.
+// - each game is a compact_board with the moves played on it, behind its own lock: nothing is shared between games
+// - one thread watches the socket and the connections (poll) and cuts what they send into lines
+// - a fixed pool of threads answers the requests, whichever game they are for. The requests of one connection are
+//   answered in the order they were sent; a game is only locked while one of its requests is answered.
+// Protocol: one request per line, one answer per line, either "ok ..." or "error <reason>"
+//   new [<fen>]         -> ok <game>
+//   move <game> <move>  -> ok <san> <status>           the move in SAN or in coordinates (e2e4, e7e8q)
+//   board <game>        -> ok <fen>
+//   status <game>       -> ok <white|black> <status> <moves played>     status: ongoing, check, checkmate, stalemate
+//   moves <game>        -> ok <legal moves in coordinates>
+//   close <game>        -> ok
+//   stats               -> ok games <n> bytes_per_game <n> moves <n> p50_us <n> p99_us <n> max_us <n>
+//   quit                -> closes the connection
+//   shutdown            -> ok, then stops the server
+// Latencies are those of move requests, from the line being read off the socket to the answer being written.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <chrono>
+
+#include "compact_board.h"
+#include "pgn_pipeline.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+struct server_game
+{
+    std::mutex lock;
+    compact_board board;
+    std::vector<compact_move> moves;
+
+    // Bytes held for the game: itself, its moves and its entry in the table of games
+    size_t footprint() const;
+};
+
+// Counts of latencies in microseconds: exact below 64, then 32 buckets for each power of two (within about 3%)
+class latency_histogram
+{
+    private:
+        static const int exact_buckets {64};
+        static const int octave_buckets {32};
+        static const int bucket_count {exact_buckets + octave_buckets*58};
+        std::atomic<uint64_t> counts[bucket_count]{};
+        std::atomic<uint64_t> largest{0};
+
+        static int bucket(uint64_t micros);
+        static uint64_t bucket_top(int index);
+    public:
+        void add(uint64_t micros);
+        uint64_t total() const;
+        // Upper bound of the latency below which this fraction of the samples falls
+        uint64_t percentile(double fraction) const;
+        uint64_t max() const
+        {
+            return largest.load(std::memory_order_relaxed);
+        }
+};
+
+class game_server
+{
+    private:
+        struct request_line
+        {
+            std::string text;
+            std::chrono::steady_clock::time_point received;
+        };
+        struct connection
+        {
+            int fd{-1};
+            std::string partial; // Text after the last complete line (only touched by the socket thread)
+            std::mutex lock;
+            std::deque<request_line> pending;
+            bool scheduled{false}; // Waiting for, or held by, a thread of the pool
+            connection(int fd_) : fd{fd_} {}
+            ~connection();
+        };
+
+        unsigned thread_count{1};
+        int listen_fd{-1};
+        int wake_pipe[2]{-1, -1};
+        std::atomic<bool> stopping{false};
+
+        std::shared_mutex games_lock;
+        std::unordered_map<uint64_t, std::shared_ptr<server_game>> games;
+        uint64_t next_game{1};
+
+        // Each connection is queued at most once at a time, so the queue never holds more than the connections
+        bounded_queue<std::shared_ptr<connection>> work;
+        latency_histogram move_latency;
+
+        std::shared_ptr<server_game> find_game(uint64_t number);
+        std::string answer(const std::string &line, bool &is_move, bool &quit);
+        void receive(const std::shared_ptr<connection> &client, const char *data, size_t size);
+        void work_loop();
+    public:
+        game_server(unsigned threads=std::thread::hardware_concurrency());
+        game_server(const game_server&) = delete;
+        game_server &operator=(const game_server&) = delete;
+
+        // Serves clients on a Unix socket at this path until stop() or a shutdown request. Returns false if the socket
+        // could not be set up.
+        bool run(std::string path);
+        // Safe to call from a signal handler
+        void stop();
+
+        size_t game_count();
+        size_t bytes_per_game();
+        std::string statistics();
+};
@@ -4,16 +4,550 @@
 // Last udated: 24/05/2021
 
 
+#include <chrono>
+
 #include "game.cpp"
 
 
-int main(){
+// Compile PGN files into a Polyglot opening book: --build-book <book.bin> <games.pgn> [<games.pgn>...]
+int build_book(int argc, char* argv[])
+{
+    if (argc<4){
+        std::cerr<<"Usage: "<<argv[0]<<" --build-book <book.bin> <games.pgn> [<games.pgn>...]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    auto start {std::chrono::steady_clock::now()};
+    book_builder builder;
+    for (int i{3}; i<argc; i++){
+        std::cout<<argv[i]<<": "<<builder.add_pgn(argv[i])<<" games"<<std::endl;
+    }
+    if (!builder.write(argv[2])){
+        return EXIT_FAILURE;
+    }
+    std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - start};
+    std::cout<<"Book "<<argv[2]<<": "<<builder.games()<<" games, "<<builder.positions()<<" positions in "<<elapsed.count()<<"s"<<std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Aggregate the move statistics of game collections (PGN or one game per line): --build-tree <tree.idx> <games> [<games>...]
+int build_tree(int argc, char* argv[])
+{
+    if (argc<4){
+        std::cerr<<"Usage: "<<argv[0]<<" --build-tree <tree.idx> <games.pgn|moves.txt> [<games.pgn|moves.txt>...]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    auto start {std::chrono::steady_clock::now()};
+    opening_tree_builder builder;
+    for (int i{3}; i<argc; i++){
+        builder.add_file(argv[i]);
+    }
+    if (!builder.write(argv[2])){
+        return EXIT_FAILURE;
+    }
+    std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - start};
+    std::cout<<"Tree "<<argv[2]<<": "<<builder.games()<<" games ("<<builder.skipped()<<" with an illegal move), "
+        <<builder.moves()<<" moves, "<<builder.positions()<<" positions in "<<elapsed.count()<<"s ("
+        <<builder.games()/elapsed.count()<<" games/s)"<<std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Replay recorded games without drawing the board, and report how each one ended: --batch <games.txt> [<games.txt>...]
+// Games are either one per line (move numbers and a final result are allowed), or in premove style: a "white:" line
+// with white's moves followed by a "black:" line with black's moves.
+int replay_batch(int argc, char* argv[])
+{
+    if (argc<3){
+        std::cerr<<"Usage: "<<argv[0]<<" --batch <games.txt> [<games.txt>...]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    chess game;
+    std::string report; // Printed at the end: no output while the games are replayed
+    size_t games{}, failed{}, moves{};
+    auto start {std::chrono::steady_clock::now()};
+    auto replay = [&](const std::vector<std::string> &san_moves, const std::string &result){
+        std::string error;
+        int played {game.replay_game(san_moves, error)};
+        games++;
+        moves += played;
+        report += "Game " + std::to_string(games) + ": " + std::to_string(played) + " moves, ";
+        if (!error.empty()){
+            failed++;
+            report += "stopped at move " + std::to_string(played+1) + " (" + error + ")\n";
+            return;
+        }
+        switch (game.get_outcome()){
+            case chess_vars::white_won:
+                report += "1-0 (checkmate)\n";
+                break;
+            case chess_vars::black_won:
+                report += "0-1 (checkmate)\n";
+                break;
+            case chess_vars::draw_by_stalemate:
+                report += "1/2-1/2 (stalemate)\n";
+                break;
+            case chess_vars::draw_by_repetition:
+                report += "1/2-1/2 (fivefold repetition)\n";
+                break;
+            case chess_vars::draw_by_move_rule:
+                report += "1/2-1/2 (seventy-five-move rule)\n";
+                break;
+            case chess_vars::draw_by_material:
+                report += "1/2-1/2 (insufficient material)\n";
+                break;
+            default:
+                report += (result.empty() ? std::string("*") : result) + "\n";
+                break;
+        }
+    };
+
+    for (int i{2}; i<argc; i++){
+        mapped_file games_file;
+        if (!games_file.open(argv[i])){
+            std::cerr<<"WARNING: could not open "<<argv[i]<<std::endl;
+            continue;
+        }
+        std::string_view text {reinterpret_cast<const char*>(games_file.data()), games_file.size()};
+        std::vector<std::string> white_moves;
+        size_t line_start{};
+        while (line_start<text.size()){
+            size_t line_end {std::min(text.find('\n', line_start), text.size())};
+            std::string_view line {text.substr(line_start, line_end - line_start)};
+            line_start = line_end + 1;
+            std::string prefix {get_lower(std::string(line.substr(0, 6)))};
+            if (prefix=="white:" || prefix=="black:"){
+                std::stringstream tokens {std::string(line.substr(6))};
+                std::vector<std::string> side_moves;
+                std::string san;
+                while (tokens>>san) side_moves.push_back(san);
+                if (prefix=="white:"){
+                    white_moves = side_moves;
+                    continue;
+                }
+                std::vector<std::string> san_moves;
+                for (size_t m{}; m<white_moves.size(); m++){
+                    san_moves.push_back(white_moves[m]);
+                    if (m<side_moves.size()) san_moves.push_back(side_moves[m]);
+                }
+                white_moves.clear();
+                replay(san_moves, "");
+            } else {
+                read_games(line, true, [&replay](std::vector<std::string> &san_moves, const std::string &result){
+                    replay(san_moves, result);
+                });
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - start};
+    std::cout<<report;
+    std::cout<<games<<" games ("<<failed<<" stopped on a move), "<<moves<<" moves in "<<elapsed.count()<<"s: "
+        <<games/elapsed.count()<<" games/s, "<<moves/elapsed.count()<<" moves/s"<<std::endl;
+    return failed==0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Check every move of PGN files, reporting the games which stop on a move with the byte offset of that move.
+// Games are replayed by a pool of threads (all cores by default); with --verdicts, one line per game is written in the
+// order of the input: number, offset, verdict, moves played, result tag, outcome on the board and final position (FEN).
+// --check-pgn [--threads <n>] [--verdicts <out.tsv>] <games.pgn> [<games.pgn>...]
+int check_pgn(int argc, char* argv[])
+{
+    unsigned threads {std::thread::hardware_concurrency()};
+    std::string verdicts_path;
+    int first_file{2};
+    for (; first_file+1<argc; first_file+=2){
+        std::string option {argv[first_file]};
+        if (option=="--threads") threads = static_cast<unsigned>(std::atoi(argv[first_file+1]));
+        else if (option=="--verdicts") verdicts_path = argv[first_file+1];
+        else break;
+    }
+    if (first_file>=argc){
+        std::cerr<<"Usage: "<<argv[0]<<" --check-pgn [--threads <n>] [--verdicts <out.tsv>] <games.pgn> [<games.pgn>...]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ofstream verdicts;
+    if (!verdicts_path.empty()){
+        verdicts.open(verdicts_path);
+        if (!verdicts){
+            std::cerr<<"WARNING: could not write "<<verdicts_path<<std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t games{}, failed{}, moves{}, bytes{};
+    auto start {std::chrono::steady_clock::now()};
+    for (int i{first_file}; i<argc; i++){
+        mapped_file pgn_file;
+        if (!pgn_file.open(argv[i])){
+            std::cerr<<"WARNING: could not open "<<argv[i]<<std::endl;
+            continue;
+        }
+        std::string_view text {reinterpret_cast<const char*>(pgn_file.data()), pgn_file.size()};
+        bytes += text.size();
+        pgn_pipeline pipeline {threads};
+        pipeline.run(text, [&](const pgn_game_report &game){
+            const pgn_verdict &verdict {game.verdict};
+            if (!game.syntax_error.empty()){
+                std::cerr<<argv[i]<<":"<<game.syntax_error_offset<<": WARNING: game "<<game.number<<": "<<game.syntax_error<<std::endl;
+            }
+            if (verdict.bad_setup){
+                std::cout<<argv[i]<<":"<<game.offset<<": game "<<game.number<<": invalid FEN tag"<<std::endl;
+            } else if (!verdict.valid()){
+                std::cout<<argv[i]<<":"<<verdict.error_offset<<": game "<<game.number<<", move "<<verdict.moves+1<<" ("
+                    <<verdict.failed_move<<"): "<<verdict.error_message()<<std::endl;
+            }
+            if (!verdicts.is_open()) return;
+
+            const char *outcome {"ongoing"};
+            if (verdict.outcome==chess_vars::white_won) outcome = "1-0 (checkmate)";
+            else if (verdict.outcome==chess_vars::black_won) outcome = "0-1 (checkmate)";
+            else if (verdict.outcome==chess_vars::draw_by_stalemate) outcome = "1/2-1/2 (stalemate)";
+            else if (verdict.outcome==chess_vars::draw_by_repetition) outcome = "1/2-1/2 (fivefold repetition)";
+            else if (verdict.outcome==chess_vars::draw_by_move_rule) outcome = "1/2-1/2 (seventy-five-move rule)";
+            else if (verdict.outcome==chess_vars::draw_by_material) outcome = "1/2-1/2 (insufficient material)";
+            verdicts<<game.number<<'\t'<<game.offset<<'\t'
+                <<(verdict.bad_setup ? "invalid FEN tag" : verdict.error_message())<<'\t'
+                <<verdict.moves<<'\t'<<game.result<<'\t'<<outcome<<'\t'
+                <<(verdict.bad_setup ? std::string("-") : verdict.final_position.to_fen())<<'\n';
+        });
+        games += pipeline.games();
+        failed += pipeline.failed();
+        moves += pipeline.moves();
+    }
+    std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - start};
+    std::cout<<games<<" games ("<<failed<<" stopped on a move), "<<moves<<" moves, "<<bytes/1e6<<" MB in "<<elapsed.count()<<"s on "
+        <<std::max(threads, 1u)<<" threads: "<<games/elapsed.count()<<" games/s, "<<moves/elapsed.count()<<" moves/s, "
+        <<bytes/1e6/elapsed.count()<<" MB/s"<<std::endl;
+    return failed==0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Store PGN files in a game archive, one byte per move, then time reading the games back from both: --pack-pgn <games.cgm> <games.pgn> [...]
+int pack_pgn(int argc, char* argv[])
+{
+    if (argc<4){
+        std::cerr<<"Usage: "<<argv[0]<<" --pack-pgn <games.cgm> <games.pgn> [<games.pgn>...]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    game_archive_writer writer;
+    if (!writer.open(argv[2])){
+        return EXIT_FAILURE;
+    }
+    size_t pgn_bytes{};
+    double pgn_seconds{};
+    for (int i{3}; i<argc; i++){
+        mapped_file pgn_file;
+        if (!pgn_file.open(argv[i])){
+            std::cerr<<"WARNING: could not open "<<argv[i]<<std::endl;
+            continue;
+        }
+        std::string_view text {reinterpret_cast<const char*>(pgn_file.data()), pgn_file.size()};
+        pgn_bytes += text.size();
+        pgn_reader reader {text};
+        pgn_game game;
+        while (reader.next(game)){
+            writer.add(game);
+        }
+
+        // Reading the games back from PGN: every move has to be parsed and matched against the board
+        auto start {std::chrono::steady_clock::now()};
+        pgn_reader timed_reader {text};
+        pgn_verdict verdict;
+        while (timed_reader.next(game)){
+            replay_pgn(game, verdict);
+        }
+        pgn_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    if (!writer.close()){
+        std::cerr<<"WARNING: could not write "<<argv[2]<<std::endl;
+        return EXIT_FAILURE;
+    }
+
+    game_archive archive;
+    if (!archive.open(argv[2])){
+        return EXIT_FAILURE;
+    }
+    auto start {std::chrono::steady_clock::now()};
+    archive_game game;
+    size_t moves{};
+    for (uint64_t n{}; n<archive.size(); n++){
+        if (archive.read(n, game)) moves += game.moves.size();
+    }
+    double archive_seconds {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+
+    mapped_file packed;
+    packed.open(argv[2]);
+    std::cout<<"Archive "<<argv[2]<<": "<<writer.games()<<" games ("<<writer.skipped()<<" skipped), "<<writer.moves()<<" moves"<<std::endl
+        <<"Size: "<<pgn_bytes<<" bytes of PGN, "<<packed.size()<<" bytes packed ("<<100.0*packed.size()/std::max<size_t>(pgn_bytes, 1)<<"%)"<<std::endl
+        <<"Reading back: PGN "<<pgn_seconds<<"s, archive "<<archive_seconds<<"s ("<<moves/archive_seconds<<" moves/s)"<<std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Print games of an archive as PGN: --unpack-games <games.cgm> [<first game> [<count>]], games numbered from 1
+int unpack_games(int argc, char* argv[])
+{
+    if (argc<3){
+        std::cerr<<"Usage: "<<argv[0]<<" --unpack-games <games.cgm> [<first game> [<count>]]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    game_archive archive;
+    if (!archive.open(argv[2])){
+        return EXIT_FAILURE;
+    }
+    uint64_t first {argc>3 ? std::max(std::strtoull(argv[3], nullptr, 10), 1ull) - 1 : 0};
+    uint64_t last {argc>4 ? std::min<uint64_t>(archive.size(), first + std::strtoull(argv[4], nullptr, 10)) : archive.size()};
+    archive_game game;
+    char text[max_move_text];
+    for (uint64_t n{first}; n<last; n++){
+        if (!archive.read(n, game)){
+            std::cerr<<"WARNING: game "<<n+1<<" of "<<argv[2]<<" is damaged"<<std::endl;
+            return EXIT_FAILURE;
+        }
+        for (auto &t : game.tags) std::cout<<"["<<t.name<<" \""<<t.value<<"\"]\n";
+        std::cout<<"\n";
+        compact_board board {game.start};
+        for (size_t k{}; k<game.moves.size(); k++){
+            if (board.side_to_move()==chess_vars::white) std::cout<<board.fullmoves()<<". ";
+            else if (k==0) std::cout<<board.fullmoves()<<"... ";
+            std::cout.write(text, static_cast<std::streamsize>(write_san(board, game.moves[k], text, true)))<<" ";
+            board.make_move(game.moves[k]);
+        }
+        std::cout<<result_text(game.result)<<"\n\n";
+    }
+    return EXIT_SUCCESS;
+}
+
+// Convert position files (EPD, or already packed) to packed records of 32 bytes: --pack-positions <out.cpos> <positions.epd> [...]
+int pack_positions(int argc, char* argv[])
+{
+    if (argc<4){
+        std::cerr<<"Usage: "<<argv[0]<<" --pack-positions <out.cpos> <positions.epd|positions.cpos> [...]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    position_set positions;
+    for (int i{3}; i<argc; i++){
+        positions.load(argv[i]);
+    }
+    if (!positions.write_packed(argv[2])){
+        return EXIT_FAILURE;
+    }
+    std::cout<<"Packed "<<positions.size()<<" positions ("<<positions.skipped()<<" skipped) into "<<argv[2]<<std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Load position files into boards and report the rate: --load-positions <positions.epd|positions.cpos> [...]
+int load_positions(int argc, char* argv[])
+{
+    if (argc<3){
+        std::cerr<<"Usage: "<<argv[0]<<" --load-positions <positions.epd|positions.cpos> [...]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    for (int i{2}; i<argc; i++){
+        position_set positions;
+        auto start {std::chrono::steady_clock::now()};
+        if (!positions.load(argv[i])) continue;
+        std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - start};
+        size_t decided{};
+        for (size_t n{}; n<positions.size(); n++){
+            if (positions.result(n)!=archive_unknown) decided++;
+        }
+        std::cout<<argv[i]<<": "<<positions.size()<<" positions ("<<positions.skipped()<<" skipped, "<<decided<<" with a result) in "
+            <<elapsed.count()<<"s: "<<positions.size()/elapsed.count()<<" positions/s"<<std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Count the positions reached after a number of plies, to check and time the move generator: --perft <depth> [<fen>]
+// From the initial position by default.
+int run_perft(int argc, char* argv[])
+{
+    compact_board start {compact_board::starting_position()};
+    if (argc<3 || std::atoi(argv[2])<1 || (argc>3 && !compact_board::from_fen(argv[3], start))){
+        std::cerr<<"Usage: "<<argv[0]<<" --perft <depth> [<fen>]"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    int depth {std::atoi(argv[2])};
+    auto begin {std::chrono::steady_clock::now()};
+    uint64_t nodes {perft(start, depth)};
+    std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - begin};
+    std::cout<<"Perft "<<depth<<": "<<nodes<<" positions in "<<elapsed.count()<<"s ("<<nodes/elapsed.count()<<" positions/s)"<<std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Check the readers of the file formats against known and damaged data, and the tablebase decoder against known
+// positions when the directories of the 3-piece Syzygy tables are given: --self-test [<tablebase paths>]. Fails if any
+// check fails.
+int self_test(const char *tablebase_paths)
+{
+    int failures{};
+    auto check = [&failures](bool passed, const char *what){
+        std::cout<<(passed ? "ok    " : "FAILED ")<<what<<std::endl;
+        if (!passed) failures++;
+    };
+
+    // Packed positions: a record is read back as written, and rejected if its pieces could not be played or its castling
+    // or en-passant state does not match them
+    compact_board board, read;
+    archive_result result;
+    uint8_t record[packed_position_size];
+    compact_board::from_fen("r3k2r/8/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1", board);
+    pack_position(board, archive_unknown, record);
+    check(unpack_position(record, read, result) && read.to_fen()==board.to_fen(), "packed position read back as written");
+    compact_board::from_fen("4k3/8/8/8/8/8/8/4K3 w - - 0 1", board);
+    pack_position(board, archive_unknown, record);
+    record[24] |= white_k_castle | white_q_castle;
+    check(!unpack_position(record, read, result), "packed position with castling rights but no rooks rejected");
+    pack_position(board, archive_unknown, record);
+    record[25] = 43; // d6, with no pawn on d5
+    check(!unpack_position(record, read, result), "packed position with an en-passant square but no pawn rejected");
+    pack_position(board, archive_unknown, record);
+    record[0] |= 0x80; // A third piece, after both kings in square order: a white pawn on h8
+    record[9] = static_cast<uint8_t>(piece_code(chess_vars::white, chess_vars::pawn) << 4);
+    check(!unpack_position(record, read, result), "packed position with a pawn on its last rank rejected");
+
+    // FEN: a pawn on its first or last rank is rejected, like a missing king
+    check(!compact_board::from_fen("P3k3/8/8/8/8/8/8/4K3 w - - 0 1", board), "FEN with a white pawn on the last rank rejected");
+    check(!compact_board::from_fen("4k3/8/8/8/8/8/8/p3K3 b - - 0 1", board), "FEN with a black pawn on the last rank rejected");
+    check(!compact_board::from_fen("4k3/8/8/8/8/8/8/4K2P w - - 0 1", board), "FEN with a white pawn on the first rank rejected");
+
+    // Opening book keys: the test positions published with the Polyglot book format
+    const std::pair<const char*, uint64_t> book_keys[] {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0x463b96181691fc9cULL},
+        {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", 0x22a48b5a8e47ff78ULL},
+        {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4", 0x00fdd303c946bdd9ULL},
+        {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3", 0x3c8123ea7b067637ULL},
+        {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4", 0x5c3f9b829b279560ULL}};
+    for (auto &[fen, key] : book_keys){
+        check(compact_board::from_fen(fen, board) && polyglot_key(board)==key, "Polyglot key of a published test position");
+    }
+
+    // Tablebases: WDL and DTZ of positions whose values follow from the rules. DTZ is 1 where a mate or a winning pawn
+    // move is available, 0 for a draw, and otherwise has the sign of the WDL.
+    if (tablebase_paths){
+        tablebase tables {tablebase_paths};
+        check(tables.max_pieces()>=3, "3-piece tables found");
+        struct known_probe
+        {
+            const char *fen;
+            chess_vars::wdl_score wdl;
+            int dtz; // 2: any positive DTZ, -2: any negative DTZ
+        };
+        const known_probe probes[] {
+            {"4k3/8/8/8/8/8/8/3QK3 w - - 0 1", chess_vars::tb_win, 2},
+            {"4k3/8/8/8/8/8/8/3QK3 b - - 0 1", chess_vars::tb_loss, -2},
+            {"4k3/8/8/8/8/8/8/3NK3 w - - 0 1", chess_vars::tb_draw, 0},
+            {"k7/8/1K6/8/8/8/8/7R w - - 0 1", chess_vars::tb_win, 1},      // Rh8#
+            {"7k/4P3/8/8/8/8/8/4K3 w - - 0 1", chess_vars::tb_win, 1},     // e8=Q+
+            {"k7/8/8/8/8/8/P7/K7 w - - 0 1", chess_vars::tb_draw, 0},      // Rook's pawn, king in the corner
+            {"8/8/8/8/8/8/6kR/K7 b - - 0 1", chess_vars::tb_draw, 0}};     // Kxh2
+        for (auto &probe : probes){
+            chess_vars::probe_state state {chess_vars::probe_ok};
+            bool read {compact_board::from_fen(probe.fen, board) && tables.can_probe(board)};
+            chess_vars::wdl_score wdl {read ? tables.probe_wdl(board, state) : chess_vars::tb_draw};
+            int dtz {read && state!=chess_vars::probe_fail ? tables.probe_dtz(board, state) : 0};
+            bool dtz_matches {probe.dtz==2 ? dtz>0 : (probe.dtz==-2 ? dtz<0 : dtz==probe.dtz)};
+            check(read && state!=chess_vars::probe_fail && wdl==probe.wdl && dtz_matches, "tablebase WDL and DTZ of a known position");
+        }
+        compact_board::from_fen("8/8/8/8/8/8/6kR/K7 b - - 0 1", board);
+        tb_root_move best;
+        check(tables.best_move(board, best) && best.move.to==15 && best.rank==0, "tablebase best move takes the hanging rook");
+        compact_board::from_fen("k7/8/1K6/8/8/8/8/7R w - - 0 1", board);
+        check(tables.best_move(board, best) && best.move.to==63 && best.dtz==1, "tablebase best move mates");
+    }
+
+    std::cout<<(failures==0 ? "All checks passed" : "Some checks failed")<<std::endl;
+    return failures==0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Host independent games for clients on a Unix socket, until a shutdown request or Ctrl+C. The protocol is described in
+// game_server.h; the number of games, their memory and the move latencies are printed when the server stops.
+// --serve [--threads <n>] <socket path>
+game_server *running_server {nullptr};
+
+void stop_server(int)
+{
+    if (running_server) running_server->stop();
+}
+
+int serve(int argc, char* argv[])
+{
+    unsigned threads {std::thread::hardware_concurrency()};
+    int path_arg{2};
+    if (argc>3 && std::string(argv[2])=="--threads"){
+        threads = static_cast<unsigned>(std::atoi(argv[3]));
+        path_arg = 4;
+    }
+    if (path_arg>=argc){
+        std::cerr<<"Usage: "<<argv[0]<<" --serve [--threads <n>] <socket path>"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    game_server server {threads};
+    running_server = &server;
+    std::signal(SIGINT, stop_server);
+    std::signal(SIGTERM, stop_server);
+    std::cout<<"Serving games on "<<argv[path_arg]<<std::endl;
+    bool served {server.run(argv[path_arg])};
+    running_server = nullptr;
+    std::cout<<"Server stopped: "<<server.statistics()<<std::endl;
+    return served ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]){
+    // Command line tools run on their own, without starting a game
+    if (argc>1 && std::string(argv[1])=="--build-book"){
+        return build_book(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--build-tree"){
+        return build_tree(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--batch"){
+        return replay_batch(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--check-pgn"){
+        return check_pgn(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--pack-pgn"){
+        return pack_pgn(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--unpack-games"){
+        return unpack_games(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--pack-positions"){
+        return pack_positions(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--load-positions"){
+        return load_positions(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--perft"){
+        return run_perft(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--self-test"){
+        return self_test(argc>2 ? argv[2] : nullptr);
+    }
+    if (argc>1 && std::string(argv[1])=="--serve"){
+        return serve(argc, argv);
+    }
+    if (argc>1 && std::string(argv[1])=="--uci"){
+        uci_session session;
+        return session.run(std::cin);
+    }
+
     chess game;
+    // Start from a given position: --fen "<fen>"
+    bool start_from_fen {argc>2 && std::string(argv[1])=="--fen"};
+    if (start_from_fen && !game.load_fen(argv[2])){
+        std::cerr<<"Invalid FEN: "<<argv[2]<<std::endl;
+        return EXIT_FAILURE;
+    }
     print_welcome(); 
+    // A game left unfinished in the autosave journal (CHESS_AUTOSAVE) is resumed straight away
+    if (!start_from_fen){
+        start_from_fen = game.recover_autosave();
+    }
     // While player wants to keep playing: loop
     while (game.keep_going()){
-        // Menu: choose an option to proceed
-        game.ask_game_option();   
+        // Menu: choose an option to proceed (the first time round, a given or recovered position goes straight to the game)
+        if (!start_from_fen){
+            game.ask_game_option();   
+        }
+        start_from_fen = false;
 
         // If menu option requires a board initialisation: proceed 
         if (game.want_initialisation()){
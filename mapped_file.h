@@ -0,0 +1,139 @@
+// Read-only memory mapping of a file, part of the C++ Chess Project.
+// Used by the modules that read large binary files (endgame tablebases,...)
+// without copying them into memory first.
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#pragma once
+
+
+class mapped_file
+{
+    private:
+        const uint8_t *base{nullptr};
+        size_t length{0};
+#ifdef _WIN32
+        HANDLE mapping{nullptr};
+#endif
+    public:
+        mapped_file() = default;
+        // Mappings own an OS handle: no copies
+        mapped_file(const mapped_file&) = delete;
+        mapped_file &operator=(const mapped_file&) = delete;
+        ~mapped_file(){ close(); }
+
+        bool open(const std::string &path);
+        void close();
+        bool is_open() const
+        {
+            return base!=nullptr;
+        }
+        const uint8_t *data() const
+        {
+            return base;
+        }
+        size_t size() const
+        {
+            return length;
+        }
+};
+
+// Map the whole file in read-only mode. Returns false if the file can't be opened or is empty.
+bool mapped_file::open(const std::string &path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file { CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr) };
+    if (file==INVALID_HANDLE_VALUE){
+        return false;
+    }
+    DWORD size_high;
+    DWORD size_low { GetFileSize(file, &size_high) };
+    length = (static_cast<uint64_t>(size_high) << 32) | size_low;
+    if (length==0){
+        CloseHandle(file);
+        return false;
+    }
+    mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, size_high, size_low, nullptr);
+    CloseHandle(file);
+    if (!mapping){
+        length = 0;
+        return false;
+    }
+    base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!base){
+        CloseHandle(mapping);
+        mapping = nullptr;
+        length = 0;
+        return false;
+    }
+#else
+    int fd { ::open(path.c_str(), O_RDONLY) };
+    if (fd==-1){
+        return false;
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf)!=0 || statbuf.st_size==0){
+        ::close(fd);
+        return false;
+    }
+    length = statbuf.st_size;
+    void *address { mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0) };
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+    if (address==MAP_FAILED){
+        length = 0;
+        return false;
+    }
+    base = static_cast<const uint8_t*>(address);
+#endif
+    return true;
+}
+
+void mapped_file::close()
+{
+    if (!base){
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+    CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(base), length);
+#endif
+    base = nullptr;
+    length = 0;
+}
+
+// Readers for the (unaligned) numbers stored in binary files
+uint16_t read_le16(const uint8_t *p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+uint32_t read_le32(const uint8_t *p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+uint16_t read_be16(const uint8_t *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+uint32_t read_be32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+uint64_t read_be64(const uint8_t *p)
+{
+    return (static_cast<uint64_t>(read_be32(p)) << 32) | read_be32(p+4);
+}
@@ -0,0 +1,351 @@
+// Move journal, part of the C++ Chess Project.
+
+#include <cstdio>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "move_journal.h"
+#include "position_set.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Thin layer over the file descriptors of each system
+int journal_create(const std::string &file_path)
+{
+#ifdef _WIN32
+    return _open(file_path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+bool journal_write(int fd, const uint8_t *data, size_t size)
+{
+    while (size>0){
+#ifdef _WIN32
+        int written {_write(fd, data, static_cast<unsigned>(size))};
+#else
+        ssize_t written {::write(fd, data, size)};
+#endif
+        if (written<=0) return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool journal_sync(int fd)
+{
+#ifdef _WIN32
+    return _commit(fd)==0;
+#else
+    return fsync(fd)==0;
+#endif
+}
+
+void journal_close(int fd)
+{
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+// Rename over an existing file, in one step
+bool journal_replace(const std::string &from, const std::string &to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)!=0;
+#else
+    if (std::rename(from.c_str(), to.c_str())!=0) return false;
+    // The new name itself is only durable once the folder is synced
+    size_t slash {to.rfind('/')};
+    int folder {::open(slash==std::string::npos ? "." : to.substr(0, slash + 1).c_str(), O_RDONLY)};
+    if (folder>=0){
+        fsync(folder);
+        ::close(folder);
+    }
+    return true;
+#endif
+}
+
+// Fletcher-16, started off zero so that a record of zeros (e.g. a file extended but never written) does not pass
+uint16_t journal_checksum(const uint8_t *record)
+{
+    uint16_t low {0x4A}, high {0x43};
+    for (size_t i{}; i<journal_record_size-2; i++){
+        low = static_cast<uint16_t>((low + record[i])%255);
+        high = static_cast<uint16_t>((high + low)%255);
+    }
+    return static_cast<uint16_t>((high << 8) | low);
+}
+
+void journal_record(const compact_move &m, uint16_t sequence, uint8_t *record)
+{
+    record[0] = m.from;
+    record[1] = m.to;
+    record[2] = m.promotion;
+    record[3] = m.flags;
+    record[4] = static_cast<uint8_t>(sequence >> 8);
+    record[5] = static_cast<uint8_t>(sequence & 0xFF);
+    uint16_t check {journal_checksum(record)};
+    record[6] = static_cast<uint8_t>(check >> 8);
+    record[7] = static_cast<uint8_t>(check & 0xFF);
+}
+
+void move_journal::set_policy(size_t sync_every, int64_t sync_after_ms, size_t compact_every)
+{
+    std::lock_guard<std::mutex> guard {lock};
+    sync_moves = std::max<size_t>(sync_every, 1);
+    sync_ms = std::max<int64_t>(sync_after_ms, 0);
+    compact_moves = std::min<size_t>(std::max<size_t>(compact_every, 1), 0xFFFF);
+}
+
+bool move_journal::write_snapshot(int file, const compact_board &board) const
+{
+    uint8_t header[journal_header_size] {};
+    std::copy(journal_magic, journal_magic+4, header);
+    for (int b{}; b<4; b++){
+        header[4 + b] = static_cast<uint8_t>(journal_version >> (24 - 8*b));
+    }
+    return pack_position(board, archive_unknown, header + 8) && journal_write(file, header, journal_header_size);
+}
+
+bool move_journal::start(std::string path_, const compact_board &start_position)
+{
+    close();
+    path = path_;
+    fd = journal_create(path);
+    if (fd<0 || !write_snapshot(fd, start_position) || !journal_sync(fd)){
+        std::cerr<<"WARNING: could not create the autosave journal "<<path<<std::endl;
+        if (fd>=0) journal_close(fd);
+        fd = -1;
+        return false;
+    }
+    position = snapshot = start_position;
+    since_snapshot.clear();
+    unsynced = 0;
+    failed = false;
+    rewrite = false;
+    stopping = false;
+    flusher = std::thread(&move_journal::flush_loop, this);
+    return true;
+}
+
+bool move_journal::append(const compact_move &m)
+{
+    std::lock_guard<std::mutex> guard {lock};
+    if (fd<0 || failed) return false;
+    // While a new snapshot is due, the file does not lead to this move: the compaction writes it
+    if (!rewrite){
+        uint8_t record[journal_record_size];
+        journal_record(m, static_cast<uint16_t>(since_snapshot.size()), record);
+        if (!journal_write(fd, record, journal_record_size)){
+            failed = true; // Later moves would not follow on from this one: stop here, recovery keeps the moves before
+            std::cerr<<"WARNING: could not write to the autosave journal "<<path<<": autosave stopped"<<std::endl;
+            return false;
+        }
+        if (unsynced++==0) first_unsynced = std::chrono::steady_clock::now();
+    }
+    since_snapshot.push_back(m);
+    position.make_move(m);
+    if (rewrite || unsynced>=sync_moves || since_snapshot.size()>=compact_moves) wake.notify_one();
+    return true;
+}
+
+bool move_journal::undo(const compact_board &position_after)
+{
+    std::lock_guard<std::mutex> guard {lock};
+    if (fd<0 || failed) return false;
+    undos++;
+    position = position_after;
+    // A move of the snapshot itself cannot be taken back by a record: the background thread writes the file afresh
+    if (since_snapshot.empty() || rewrite){
+        if (!since_snapshot.empty()) since_snapshot.pop_back();
+        rewrite = true;
+        wake.notify_one();
+        return true;
+    }
+    uint8_t record[journal_record_size];
+    journal_record(compact_move{journal_undo_square, journal_undo_square}, static_cast<uint16_t>(since_snapshot.size()), record);
+    if (!journal_write(fd, record, journal_record_size)){
+        failed = true;
+        std::cerr<<"WARNING: could not write to the autosave journal "<<path<<": autosave stopped"<<std::endl;
+        return false;
+    }
+    since_snapshot.pop_back();
+    if (unsynced++==0) first_unsynced = std::chrono::steady_clock::now();
+    if (unsynced>=sync_moves) wake.notify_one();
+    return true;
+}
+
+// Background thread: fsync in batches, and compaction when enough moves follow the snapshot
+void move_journal::flush_loop()
+{
+    std::unique_lock<std::mutex> guard {lock};
+    while (true){
+        auto batch_full = [this]{ return stopping || rewrite || unsynced>=sync_moves || since_snapshot.size()>=compact_moves; };
+        wake.wait(guard, [this]{ return stopping || rewrite || unsynced>0; });
+        wake.wait_until(guard, first_unsynced + std::chrono::milliseconds(sync_ms), batch_full);
+
+        int file {fd};
+        bool compaction {!failed && (rewrite || since_snapshot.size()>=compact_moves)};
+        unsynced = 0;
+        guard.unlock();
+        // Only this thread replaces the file, so it stays open while it is synced without the lock
+        journal_sync(file);
+        if (compaction) compact();
+        guard.lock();
+        if (stopping && unsynced==0 && !rewrite) return;
+    }
+}
+
+// Write the current position aside, carry over the moves appended meanwhile, then rename it over the journal.
+// The writes, the fsync and the rename run without the lock, so that append never waits on the disk: the lock is only
+// taken to copy the moves that arrived meanwhile and, at the end, to write the last few of them and switch files.
+// Moves taken back meanwhile may be in the new file already: it is then dropped, or written again on the next round.
+void move_journal::compact()
+{
+    std::unique_lock<std::mutex> guard {lock};
+    compact_board board {position};
+    size_t covered {since_snapshot.size()}, carried {covered}, undos_before {undos};
+    guard.unlock();
+
+    std::string aside {path + ".tmp"};
+    int file {journal_create(aside)};
+    bool written {file>=0 && write_snapshot(file, board)}, stale {false};
+    uint8_t record[journal_record_size];
+    std::vector<compact_move> late;
+    auto copy_late = [&]{
+        stale = undos!=undos_before;
+        if (!stale) late.assign(since_snapshot.begin() + static_cast<std::ptrdiff_t>(carried), since_snapshot.end());
+    };
+    auto write_late = [&]{
+        for (size_t k{}; k<late.size() && written; k++){
+            journal_record(late[k], static_cast<uint16_t>(carried - covered + k), record);
+            written = journal_write(file, record, journal_record_size);
+        }
+        carried += late.size();
+    };
+    do {
+        guard.lock();
+        copy_late();
+        guard.unlock();
+        if (!stale) write_late();
+    } while (written && !stale && !late.empty());
+    written = written && !stale && journal_sync(file) && journal_replace(aside, path);
+
+    guard.lock();
+    if (!written){
+        // The old journal is still complete: keep it. If it was due to be written afresh, it still leads to moves taken
+        // back, and autosave stops there.
+        if (!stale && rewrite){
+            failed = true;
+            rewrite = false;
+        }
+        guard.unlock();
+        if (file>=0) journal_close(file);
+        std::remove(aside.c_str());
+        if (!stale) std::cerr<<"WARNING: could not compact the autosave journal "<<path<<std::endl;
+        return;
+    }
+    // Moves appended during the sync and the rename went to the old file only. They cost one write each, like append,
+    // and stay unsynced until the next round of the background thread.
+    copy_late();
+    if (stale){
+        rewrite = true;
+    } else {
+        write_late();
+        rewrite = false;
+        since_snapshot.erase(since_snapshot.begin(), since_snapshot.begin() + static_cast<std::ptrdiff_t>(covered));
+    }
+    if (!written){
+        failed = true;
+        std::cerr<<"WARNING: could not write to the autosave journal "<<path<<": autosave stopped"<<std::endl;
+    }
+    journal_close(fd);
+    fd = file;
+    snapshot = board;
+}
+
+void move_journal::sync()
+{
+    std::lock_guard<std::mutex> guard {lock};
+    if (fd>=0) journal_sync(fd);
+    unsynced = 0;
+}
+
+void move_journal::close()
+{
+    if (flusher.joinable()){
+        {
+            std::lock_guard<std::mutex> guard {lock};
+            stopping = true;
+        }
+        wake.notify_one();
+        flusher.join();
+    }
+    if (fd>=0){
+        journal_sync(fd);
+        journal_close(fd);
+        fd = -1;
+    }
+}
+
+void move_journal::discard()
+{
+    bool had_file {fd>=0};
+    close();
+    if (had_file) std::remove(path.c_str());
+}
+
+bool move_journal::recover(std::string path_, compact_board &start_position, std::vector<compact_move> &moves)
+{
+    moves.clear();
+    mapped_file file;
+    if (!file.open(path_)) return false;
+    const uint8_t *data {file.data()};
+    archive_result ignored;
+    if (file.size()<journal_header_size || !std::equal(journal_magic, journal_magic+4, reinterpret_cast<const char*>(data))
+        || read_be32(data+4)!=journal_version || !unpack_position(data+8, start_position, ignored)){
+        return false;
+    }
+
+    compact_board board {start_position};
+    std::vector<compact_move> legal;
+    std::vector<undo_record> undos;
+    for (size_t offset{journal_header_size}; offset + journal_record_size<=file.size(); offset += journal_record_size){
+        const uint8_t *record {data + offset};
+        if (read_be16(record+6)!=journal_checksum(record) || read_be16(record+4)!=moves.size()) break;
+        if (record[0]==journal_undo_square && record[1]==journal_undo_square){
+            if (moves.empty()) break;
+            board.unmake_move(undos.back());
+            undos.pop_back();
+            moves.pop_back();
+            continue;
+        }
+        compact_move recorded;
+        recorded.from = record[0];
+        recorded.to = record[1];
+        recorded.promotion = record[2];
+        legal.clear();
+        board.generate_legal(legal);
+        auto found {std::find(legal.begin(), legal.end(), recorded)};
+        if (found==legal.end()) break;
+        undos.emplace_back();
+        board.make_move(*found, undos.back());
+        moves.push_back(*found);
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+// Move journal, part of the C++ Chess Project.
+// Crash-safe autosave: every move is appended to the journal as a fixed-size record as soon as it is played.
+// - the write goes straight to the operating system, so a crash of the program loses nothing
+// - fsync, which protects against power loss but may take milliseconds, runs on a background thread: after sync_moves
+//   moves, or sync_ms milliseconds after the first move not yet synced, whichever comes first
+// - every compact_moves moves, the same thread rewrites the journal as a snapshot of the position (compaction):
+//   the new file is written aside and renamed over the old one, so a crash leaves one or the other
+// - a move taken back is appended as an undo record, like a move: the file is never rewritten on the caller's thread.
+//   Taking back moves played before the snapshot leaves the background thread to write a new snapshot (as compaction).
+// Recovery reads the snapshot, then the moves after it up to the first record which is torn, out of sequence or illegal.
+// File layout (big-endian, like the other binary files):
+// - header: magic "CJRN", version, then the snapshot as a packed position of 32 bytes (see position_set.h)
+// - move records of 8 bytes: from, to, promotion, flags, sequence number (2), checksum of the first 6 bytes (2).
+//   The sequence number is the number of moves before the record; an undo record has 0xFF for from and to.
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "compact_board.h"
+#include "position_set.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+const char journal_magic[4] {'C', 'J', 'R', 'N'};
+const uint32_t journal_version {1};
+const size_t journal_header_size {8 + packed_position_size};
+const size_t journal_record_size {8};
+const uint8_t journal_undo_square {0xFF};
+
+class move_journal
+{
+    private:
+        std::string path;
+        int fd{-1};
+        size_t sync_moves{16};
+        int64_t sync_ms{1000};
+        size_t compact_moves{256};
+
+        // Shared with the background thread, under lock
+        std::mutex lock;
+        std::condition_variable wake;
+        std::thread flusher;
+        bool stopping{false};
+        compact_board position;                // Position after the last move appended
+        compact_board snapshot;                // Position at the start of the file
+        std::vector<compact_move> since_snapshot; // Moves in the file after the snapshot, to carry over on compaction
+        size_t unsynced{0};
+        bool rewrite{false}; // Moves were taken back past the snapshot: the file no longer leads to position
+        size_t undos{0};     // Moves taken back so far, for compaction to notice those taken back while it runs
+        std::chrono::steady_clock::time_point first_unsynced;
+        bool failed{false};
+
+        bool write_snapshot(int file, const compact_board &board) const;
+        void flush_loop();
+        void compact();
+    public:
+        move_journal() = default;
+        // The journal owns a file and a thread: no copies
+        move_journal(const move_journal&) = delete;
+        move_journal &operator=(const move_journal&) = delete;
+        ~move_journal(){ close(); }
+
+        // Batching: fsync after this many moves or milliseconds. compact_every is at most 65535 (the sequence numbers).
+        void set_policy(size_t sync_every, int64_t sync_after_ms, size_t compact_every);
+
+        // Creates the journal afresh from a position, synced before returning
+        bool start(std::string path_, const compact_board &start_position);
+        // Appends a move played from the last position. Costs one write to the operating system: no fsync.
+        bool append(const compact_move &m);
+        // Takes back the last move appended, the journal then leading to position_after. Costs one write, like append.
+        bool undo(const compact_board &position_after);
+        // Waits for the moves appended so far to be on disk
+        void sync();
+        // Syncs and stops the background thread. The file stays, to be recovered.
+        void close();
+        // Closes and deletes the file: the game it held needs no recovery (e.g. it is over)
+        void discard();
+        bool is_open() const
+        {
+            return fd>=0;
+        }
+
+        // Reads a journal: the snapshot, and the moves played after it up to the last consistent one.
+        // Returns false if there is no journal or its header is damaged.
+        static bool recover(std::string path_, compact_board &start_position, std::vector<compact_move> &moves);
+};
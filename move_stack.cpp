@@ -0,0 +1,79 @@
+// Move stack, part of the C++ Chess Project.
+
+#include <algorithm>
+
+#include "move_stack.h"
+#include "opening_book.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+void move_stack::reset(const compact_board &start)
+{
+    first = position = start;
+    position_key = polyglot_key(position);
+    entries.clear();
+    played = 0;
+}
+
+void move_stack::play(const compact_move &m)
+{
+    entries.resize(played);
+    entries.push_back(entry{undo_record{}, position_key});
+    position.make_move(m, entries.back().undo);
+    position_key = polyglot_key(position);
+    played++;
+}
+
+bool move_stack::undo()
+{
+    if (played==0) return false;
+    position.unmake_move(entries[--played].undo);
+    position_key = entries[played].key;
+    return true;
+}
+
+// The record is filled in again, the same as when the move was first played
+bool move_stack::redo()
+{
+    if (played==entries.size()) return false;
+    undo_record &undo {entries[played++].undo};
+    position.make_move(compact_move{undo.move}, undo);
+    position_key = played<entries.size() ? entries[played].key : polyglot_key(position);
+    return true;
+}
+
+std::vector<compact_move> move_stack::moves() const
+{
+    std::vector<compact_move> list;
+    list.reserve(played);
+    for (size_t n{}; n<played; n++) list.push_back(entries[n].undo.move);
+    return list;
+}
+
+// Positions with the same side to move are two plies apart. The halfmove clock counts the plies since the last
+// capture or pawn move: earlier positions had other pawns or pieces, so the scan stops there.
+int move_stack::repetitions() const
+{
+    int count{};
+    size_t reversible {std::min(static_cast<size_t>(position.halfmoves()), played)};
+    for (size_t back{2}; back<=reversible; back+=2){
+        if (entries[played - back].key==position_key) count++;
+    }
+    return count;
+}
+
+// Costs a scan of the plies since the last capture or pawn move, at most
+chess_vars::game_outcome move_stack::draw_by_rule(bool claim_draws) const
+{
+    return position.draw_by_rule(repetitions(), claim_draws);
+}
+
+std::vector<uint64_t> move_stack::keys() const
+{
+    std::vector<uint64_t> list;
+    list.reserve(played);
+    for (size_t n{}; n<played; n++) list.push_back(entries[n].key);
+    return list;
+}
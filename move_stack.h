@@ -0,0 +1,79 @@
+// Move stack, part of the C++ Chess Project.
+// The moves of a game as a stack of undo records over one compact_board (see undo_record in compact_board.h):
+// - undo takes the last move back and redo plays it again, each in constant time, to any depth
+// - playing a move after an undo drops the moves which could have been played again, as in an editor
+// - the key of the position before each move is kept with it, for repetitions and the engine's search history:
+//   a repetition is looked for back to the last capture or pawn move only, as no position before it can come again
+// The interactive game keeps its moves here, for the undo and redo commands.
+
+#include <vector>
+
+#include "compact_board.h"
+#include "opening_book.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+class move_stack
+{
+    private:
+        struct entry
+        {
+            undo_record undo;
+            uint64_t key{}; // Polyglot key of the position before the move
+        };
+        compact_board first;       // Position before the first move
+        compact_board position;    // Position after the moves played
+        uint64_t position_key{};
+        std::vector<entry> entries; // Moves played, then the moves taken back which redo may play again
+        size_t played{0};
+    public:
+        // Starts again from this position, with no moves
+        void reset(const compact_board &start);
+        // Plays a legal move of the current position: the moves taken back can no longer be played again
+        void play(const compact_move &m);
+        // Both return false, changing nothing, if there is no move to take back or to play again
+        bool undo();
+        bool redo();
+
+        const compact_board &start() const
+        {
+            return first;
+        }
+        const compact_board &current() const
+        {
+            return position;
+        }
+        size_t moves_played() const
+        {
+            return played;
+        }
+        size_t moves_undone() const
+        {
+            return entries.size() - played;
+        }
+        // Only if a move was played
+        const compact_move &last_move() const
+        {
+            return entries[played-1].undo.move;
+        }
+        // What the last move changed, e.g. to take it back on another board as well
+        const undo_record &last_undo() const
+        {
+            return entries[played-1].undo;
+        }
+        // Moves played from the start, in order
+        std::vector<compact_move> moves() const;
+        // Keys of the positions before each move played, in order (the current position is not included)
+        std::vector<uint64_t> keys() const;
+        uint64_t key() const
+        {
+            return position_key;
+        }
+        // Times the current position occurred before, with the same side to move
+        int repetitions() const;
+        // Draw by rule in the current position, ongoing if there is none
+        chess_vars::game_outcome draw_by_rule(bool claim_draws) const;
+};
+
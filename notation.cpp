@@ -0,0 +1,343 @@
+// Chess notation, part of the C++ Chess Project.
+
+#include <array>
+
+#include "notation.h"
+#include "compact_board.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Character classes of the SAN reader
+enum san_char : uint8_t{
+    sc_other = 0,
+    sc_file,        // a-h
+    sc_rank,        // 1-8
+    sc_piece,       // K Q R B N P, and k q r n (b is a file)
+    sc_capture,     // x :
+    sc_equals,      // =
+    sc_castle,      // O o 0
+    sc_dash,        // -
+    sc_suffix,      // + # ! ?
+    sc_space
+};
+
+const std::array<uint8_t, 256> &san_classes()
+{
+    static const std::array<uint8_t, 256> table = []{
+        std::array<uint8_t, 256> classes{};
+        for (char c{'a'}; c<='h'; c++) classes[static_cast<uint8_t>(c)] = sc_file;
+        for (char c{'1'}; c<='8'; c++) classes[static_cast<uint8_t>(c)] = sc_rank;
+        for (char c : std::string_view{"KQRBNPkqrn"}) classes[static_cast<uint8_t>(c)] = sc_piece;
+        for (char c : std::string_view{"x:"}) classes[static_cast<uint8_t>(c)] = sc_capture;
+        for (char c : std::string_view{"Oo0"}) classes[static_cast<uint8_t>(c)] = sc_castle;
+        for (char c : std::string_view{"+#!?"}) classes[static_cast<uint8_t>(c)] = sc_suffix;
+        for (char c : std::string_view{" \t\r\n"}) classes[static_cast<uint8_t>(c)] = sc_space;
+        classes[static_cast<uint8_t>('=')] = sc_equals;
+        classes[static_cast<uint8_t>('-')] = sc_dash;
+        return classes;
+    }();
+    return table;
+}
+
+san_char san_class(char c)
+{
+    return static_cast<san_char>(san_classes()[static_cast<uint8_t>(c)]);
+}
+
+// Promotion letter, either case: b is only read as a bishop here, after the destination
+uint8_t san_promotion(char c)
+{
+    switch (c)
+    {
+    case 'Q': case 'q': return chess_vars::queen;
+    case 'R': case 'r': return chess_vars::rook;
+    case 'B': case 'b': return chess_vars::bishop;
+    case 'N': case 'n': return chess_vars::knight;
+    default: return chess_vars::nancy_rothwell;
+    }
+}
+
+// Read a move without looking at the board
+san_status parse_san(std::string_view text, san_move &parsed)
+{
+    parsed = san_move();
+    while (!text.empty() && san_class(text.front())==sc_space) text.remove_prefix(1);
+    while (!text.empty() && (san_class(text.back())==sc_space || san_class(text.back())==sc_suffix)) text.remove_suffix(1);
+    if (text.empty()) return san_empty;
+
+    // Castling: two or three O's (letter or digit), dashes allowed in between
+    if (san_class(text.front())==sc_castle){
+        int count{};
+        for (char c : text){
+            if (san_class(c)==sc_castle) count++;
+            else if (san_class(c)!=sc_dash) return san_bad_syntax;
+        }
+        if (count!=2 && count!=3) return san_bad_syntax;
+        parsed.castle = count==2 ? chess_vars::k_castle : chess_vars::q_castle;
+        parsed.piece = chess_vars::king;
+        parsed.piece_given = true;
+        return san_ok;
+    }
+
+    size_t i{};
+    if (san_class(text[i])==sc_piece){
+        parsed.piece = char_to_piece(text[i]);
+        parsed.piece_given = true;
+        i++;
+    }
+
+    // Files and ranks up to the promotion: at most an origin square and a destination square,
+    // separated by a capture mark or, in long algebraic notation, a dash (Ng1-f3)
+    char coords[4]{};
+    int count{};
+    bool separated{false};
+    for (; i<text.size(); i++){
+        san_char kind {san_class(text[i])};
+        if (kind==sc_file || kind==sc_rank){
+            if (count==4 && text[i]=='b') break; // Promotion to a bishop (e7e8b)
+            if (count==4) return san_bad_syntax;
+            coords[count++] = text[i];
+        } else if ((kind==sc_capture || kind==sc_dash) && !separated){
+            separated = true;
+            parsed.capture = kind==sc_capture;
+        } else {
+            break;
+        }
+    }
+    // A b after a full square can only be a promotion to a bishop (e8b)
+    if (count>=3 && coords[count-1]=='b' && san_class(coords[count-2])==sc_rank){
+        parsed.promotion = chess_vars::bishop;
+        count--;
+    }
+
+    // Promotion, with or without '=', or a trailing '=' offering a draw
+    if (i<text.size() && san_class(text[i])==sc_equals){
+        i++;
+        if (i==text.size()){
+            parsed.draw_offer = true;
+        } else if (parsed.promotion!=chess_vars::nancy_rothwell){
+            return san_bad_syntax;
+        }
+    }
+    if (i<text.size() && parsed.promotion==chess_vars::nancy_rothwell){
+        if (san_class(text[i])==sc_piece || text[i]=='b'){
+            if (san_promotion(text[i])==chess_vars::nancy_rothwell) return san_bad_promotion;
+            parsed.promotion = san_promotion(text[i]);
+            i++;
+        }
+    }
+    if (i<text.size()){
+        return san_bad_syntax;
+    }
+
+    // Destination: the last file and rank. Whatever comes before is the origin.
+    auto is_file = [](char c){ return san_class(c)==sc_file; };
+    auto is_rank = [](char c){ return san_class(c)==sc_rank; };
+    int origin{};
+    if (count>=2 && is_file(coords[count-2]) && is_rank(coords[count-1])){
+        parsed.to_file = static_cast<int8_t>(coords[count-2] - 'a');
+        parsed.to_rank = static_cast<int8_t>(coords[count-1] - '1');
+        origin = count-2;
+    } else if (count==2 && !parsed.piece_given && parsed.capture && is_file(coords[0]) && is_file(coords[1])){
+        parsed.to_file = static_cast<int8_t>(coords[1] - 'a'); // Pawn capture by file only
+        origin = 1;
+    } else {
+        return san_bad_syntax;
+    }
+    if (origin==2){
+        if (!is_file(coords[0]) || !is_rank(coords[1])) return san_bad_syntax;
+        parsed.from_file = static_cast<int8_t>(coords[0] - 'a');
+        parsed.from_rank = static_cast<int8_t>(coords[1] - '1');
+    } else if (origin==1){
+        if (is_file(coords[0])) parsed.from_file = static_cast<int8_t>(coords[0] - 'a');
+        else parsed.from_rank = static_cast<int8_t>(coords[0] - '1');
+    }
+
+    if (parsed.promotion!=chess_vars::nancy_rothwell){
+        if (parsed.piece!=chess_vars::pawn) return san_bad_promotion;
+        if (parsed.to_rank>=0 && parsed.to_rank!=0 && parsed.to_rank!=7) return san_bad_promotion;
+    }
+    return san_ok;
+}
+
+// Find the one move of the list that fits. The list may hold pseudo-legal moves: legality is only tested on the moves that fit.
+// A promotion without a piece is read as a promotion to a queen.
+san_status match_san(const compact_board &board, const std::vector<compact_move> &moves, const san_move &parsed, compact_move &found)
+{
+    // Coordinates (e2e4) name the origin square, whatever the piece
+    bool any_piece {!parsed.piece_given && parsed.from_file>=0 && parsed.from_rank>=0};
+    int matches{};
+    for (auto &m : moves){
+        if (parsed.castle!=chess_vars::no_castle){
+            if (!(m.flags & castle_move) || (m.to > m.from)!=(parsed.castle==chess_vars::k_castle)) continue;
+        } else {
+            if (m.to%8!=parsed.to_file) continue;
+            if (parsed.to_rank>=0 && m.to/8!=parsed.to_rank) continue;
+            if (parsed.from_file>=0 && m.from%8!=parsed.from_file) continue;
+            if (parsed.from_rank>=0 && m.from/8!=parsed.from_rank) continue;
+            if (!any_piece && code_type(board.at(m.from))!=parsed.piece) continue;
+            uint8_t promotion {parsed.promotion};
+            if (promotion==chess_vars::nancy_rothwell && m.is_promotion()) promotion = chess_vars::queen;
+            if (m.promotion!=promotion) continue;
+        }
+        if (!board.is_legal(m)) continue;
+        found = m;
+        matches++;
+    }
+    if (matches==0) return san_no_move;
+    return matches==1 ? san_ok : san_ambiguous;
+}
+
+// Read a move of the position: parsing first, so that malformed input costs no move generation.
+// Only the moves of the piece written are generated.
+san_status read_san(const compact_board &board, std::string_view text, compact_move &found, san_move &parsed)
+{
+    san_status status {parse_san(text, parsed)};
+    if (status!=san_ok) return status;
+    thread_local std::vector<compact_move> moves; // Kept between calls: no allocation once it has grown
+    moves.clear();
+    if (parsed.piece_given || parsed.from_file<0 || parsed.from_rank<0){
+        board.generate_pseudo_legal(moves, static_cast<chess_vars::piece_type>(parsed.piece));
+    } else {
+        board.generate_pseudo_legal(moves); // Coordinates: any piece
+    }
+    return match_san(board, moves, parsed, found);
+}
+
+san_status read_san(const compact_board &board, std::string_view text, compact_move &found)
+{
+    san_move parsed;
+    return read_san(board, text, found, parsed);
+}
+
+const char *san_status_message(san_status status)
+{
+    switch (status)
+    {
+    case san_ok: return "ok";
+    case san_empty: return "empty move";
+    case san_bad_syntax: return "move not recognised";
+    case san_bad_promotion: return "invalid promotion";
+    case san_no_move: return "illegal move";
+    case san_ambiguous: return "ambiguous move";
+    default: return "unknown error";
+    }
+}
+
+// Square name (e.g. e4) without building a string
+char *write_square(int square, char *out)
+{
+    *out++ = static_cast<char>('a' + square%8);
+    *out++ = static_cast<char>('1' + square/8);
+    return out;
+}
+
+// Check or mate mark of a legal move
+char *write_check(const compact_board &board, const compact_move &m, char *out, bool detect_mate)
+{
+    compact_board after {board};
+    after.make_move(m);
+    if (after.in_check()){
+        *out++ = (detect_mate && !after.has_legal_move()) ? '#' : '+';
+    }
+    return out;
+}
+
+size_t write_san(const compact_board &board, const compact_move &m, char *out, bool detect_mate)
+{
+    char *text {out};
+    chess_vars::piece_type type {code_type(board.at(m.from))};
+    if (m.flags & castle_move){
+        for (char c : std::string_view{m.to > m.from ? "O-O" : "O-O-O"}) *text++ = c;
+    } else if (type==chess_vars::pawn){
+        if (m.is_capture()){
+            *text++ = static_cast<char>('a' + m.from%8);
+            *text++ = 'x';
+        }
+        text = write_square(m.to, text);
+        if (m.is_promotion()){
+            *text++ = '=';
+            *text++ = piece_to_char(static_cast<chess_vars::piece_type>(m.promotion));
+        }
+    } else {
+        *text++ = piece_to_char(type);
+        // Other legal moves of the same piece type to the same square
+        thread_local std::vector<compact_move> moves;
+        moves.clear();
+        board.generate_pseudo_legal(moves, type);
+        bool ambiguous{false}, same_file{false}, same_rank{false};
+        for (auto &other : moves){
+            if (other.to!=m.to || other.from==m.from || !board.is_legal(other)) continue;
+            ambiguous = true;
+            same_file |= other.from%8==m.from%8;
+            same_rank |= other.from/8==m.from/8;
+        }
+        if (ambiguous && (!same_file || same_rank)) *text++ = static_cast<char>('a' + m.from%8);
+        if (ambiguous && same_file) *text++ = static_cast<char>('1' + m.from/8);
+        if (m.is_capture()) *text++ = 'x';
+        text = write_square(m.to, text);
+    }
+    text = write_check(board, m, text, detect_mate);
+    *text = '\0';
+    return static_cast<size_t>(text - out);
+}
+
+size_t write_lan(const compact_board &board, const compact_move &m, char *out, bool detect_mate)
+{
+    char *text {out};
+    chess_vars::piece_type type {code_type(board.at(m.from))};
+    if (m.flags & castle_move){
+        for (char c : std::string_view{m.to > m.from ? "O-O" : "O-O-O"}) *text++ = c;
+    } else {
+        if (type!=chess_vars::pawn) *text++ = piece_to_char(type);
+        text = write_square(m.from, text);
+        *text++ = m.is_capture() ? 'x' : '-';
+        text = write_square(m.to, text);
+        if (m.is_promotion()){
+            *text++ = '=';
+            *text++ = piece_to_char(static_cast<chess_vars::piece_type>(m.promotion));
+        }
+    }
+    text = write_check(board, m, text, detect_mate);
+    *text = '\0';
+    return static_cast<size_t>(text - out);
+}
+
+size_t write_uci(const compact_move &m, char *out)
+{
+    char *text {write_square(m.from, out)};
+    text = write_square(m.to, text);
+    if (m.is_promotion()){
+        *text++ = static_cast<char>(tolower(piece_to_char(static_cast<chess_vars::piece_type>(m.promotion))));
+    }
+    *text = '\0';
+    return static_cast<size_t>(text - out);
+}
+
+std::string move_to_san(const compact_board &board, const compact_move &m, bool detect_mate)
+{
+    char text[max_move_text];
+    return std::string(text, write_san(board, m, text, detect_mate));
+}
+
+// Moves played one after the other from board, separated by spaces (e.g. a principal variation)
+std::string line_to_san(compact_board board, const std::vector<compact_move> &moves)
+{
+    std::string line;
+    char text[max_move_text];
+    for (auto &m : moves){
+        if (!line.empty()) line += ' ';
+        line.append(text, write_san(board, m, text, true));
+        board.make_move(m);
+    }
+    return line;
+}
+
+// Find the legal move matching a move in standard algebraic notation (e.g. Nbd7, exd6, e8=Q+, O-O).
+// Returns false if no move or more than one move matches.
+bool find_san_move(const compact_board &board, std::string_view san, compact_move &found)
+{
+    return read_san(board, san, found)==san_ok;
+}
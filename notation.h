@@ -0,0 +1,65 @@
+// Chess notation, part of the C++ Chess Project.
+// Moves in standard algebraic notation (SAN) are read in a single pass over a std::string_view, without allocating:
+// - a table sorts every character into a class (file, rank, piece letter, capture mark,...)
+// - the parsed move (piece, file/rank of origin, destination, promotion, castling) is matched against the moves of the board
+// Besides strict SAN, the shortcuts the game has always accepted are read: castling as oo/ooo/0-0, lowercase piece
+// letters other than b, promotions without '=' (e8Q), pawn captures by file only (exd, exdQ), coordinates (e2e4)
+// and long algebraic notation (Ng1-f3).
+// Moves are written back the same way, into a buffer given by the caller:
+// - SAN, with the origin file or rank only when another legal move of the same piece type reaches the same square
+// - long algebraic notation (Ng1-f3, e7xd8=Q) and the coordinates of UCI (g1f3, e7d8q)
+// The check mark costs one copy of the board and an attack test; telling mate (#) from check needs a search for a legal reply,
+// which is only done when asked for.
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "compact_board.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Outcome of reading a move. Only san_ok leaves a move behind.
+enum san_status{
+    san_ok = 0,
+    san_empty,          // Nothing but spaces or annotation marks
+    san_bad_syntax,     // Not shaped like a move
+    san_bad_promotion,  // Promotion to a king or a pawn, by a piece, or not on the last rank
+    san_no_move,        // Well formed, but no legal move fits
+    san_ambiguous       // More than one legal move fits: the origin file or rank is missing
+};
+
+// A move as written, before it is matched against the board
+struct san_move
+{
+    uint8_t piece {chess_vars::pawn};
+    bool piece_given {false};        // False for pawn moves and coordinates (e2e4), where the piece is whatever stands on the origin
+    int8_t from_file {-1};           // Disambiguation, 0-7 or -1 if not given
+    int8_t from_rank {-1};
+    int8_t to_file {-1};
+    int8_t to_rank {-1};             // -1 for pawn captures by file only (exd)
+    uint8_t promotion {chess_vars::nancy_rothwell};
+    chess_vars::castle castle {chess_vars::no_castle};
+    bool capture {false};
+    bool draw_offer {false};         // Trailing '=' (e.g. e4=)
+};
+
+san_status parse_san(std::string_view text, san_move &parsed);
+san_status match_san(const compact_board &board, const std::vector<compact_move> &moves, const san_move &parsed, compact_move &found);
+san_status read_san(const compact_board &board, std::string_view text, compact_move &found, san_move &parsed);
+san_status read_san(const compact_board &board, std::string_view text, compact_move &found);
+const char *san_status_message(san_status status);
+
+bool find_san_move(const compact_board &board, std::string_view san, compact_move &found);
+
+const size_t max_move_text {10}; // Buffer size fitting any move written below, with the terminating zero (e.g. e7xd8=Q#)
+
+// Each returns the length of the text written, which is followed by a terminating zero
+size_t write_san(const compact_board &board, const compact_move &m, char *out, bool detect_mate=false);
+size_t write_lan(const compact_board &board, const compact_move &m, char *out, bool detect_mate=false);
+size_t write_uci(const compact_move &m, char *out);
+
+std::string move_to_san(const compact_board &board, const compact_move &m, bool detect_mate=false);
+std::string line_to_san(compact_board board, const std::vector<compact_move> &moves);
@@ -0,0 +1,82 @@
+// Opening book, part of the C++ Chess Project.
+// Reads and writes books in the Polyglot .bin format:
+// - 16-byte big-endian entries (key, move, weight, learn) sorted by key
+// - the key is a Zobrist hash of the position, following the Polyglot layout
+// Books are memory-mapped and searched in place, so a lookup costs a binary search.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+
+#include "compact_board.h"
+#include "mapped_file.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+// One move of the book for a given position
+struct book_entry
+{
+    uint64_t key{};
+    uint16_t move{};   // Polyglot move: to file/rank (bits 0-5), from file/rank (bits 6-11), promotion (bits 12-14)
+    uint16_t weight{}; // Relative probability of the move being picked
+    uint32_t learn{};
+};
+
+uint64_t polyglot_key(const compact_board &board);
+uint16_t encode_book_move(const compact_move &m);
+bool decode_book_move(const compact_board &board, uint16_t book_move, compact_move &m);
+
+class opening_book
+{
+    private:
+        mapped_file file;
+        size_t entry_count{0};
+        std::mt19937 generator{std::random_device{}()};
+
+        book_entry entry(size_t index) const;
+    public:
+        opening_book() = default;
+        opening_book(std::string path){ open(path); }
+
+        bool open(std::string path);
+        void close();
+        bool is_open() const
+        {
+            return file.is_open();
+        }
+        size_t size() const
+        {
+            return entry_count;
+        }
+
+        std::vector<book_entry> find(const compact_board &board) const;
+        bool pick_move(const compact_board &board, compact_move &m);
+};
+
+// Compiles games into a book: every position reached in the first max_ply plies
+// records the move played, weighted by the result for the side which played it (win 2, draw 1).
+class book_builder
+{
+    private:
+        std::map<uint64_t, std::map<uint16_t, uint32_t>> scores;
+        int max_ply{30};
+        size_t games_added{0};
+    public:
+        book_builder() = default;
+        book_builder(int plies): max_ply{plies}{}
+
+        bool add_game(const std::vector<std::string> &san_moves, std::string result);
+        size_t add_pgn(std::string path);
+        size_t games() const
+        {
+            return games_added;
+        }
+        size_t positions() const
+        {
+            return scores.size();
+        }
+        bool write(std::string path) const;
+};
@@ -0,0 +1,221 @@
+// Opening tree building and reading, part of the C++ Chess Project.
+// Index file layout (big-endian, like the opening books):
+// - header: magic "CTRE", version, maximum ply, number of records
+// - records of 18 bytes sorted by position key: key (8), move (2), games (4), score (4)
+
+#include <fstream>
+#include <algorithm>
+#include <string_view>
+
+#include "opening_tree.h"
+#include "opening_book.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+const char tree_magic[4] {'C', 'T', 'R', 'E'};
+const uint32_t tree_version {1};
+const size_t tree_header_size {20}, tree_record_size {18};
+
+// Add the statistics of one move to a list of moves
+void add_tree_move(std::vector<tree_move> &moves, uint16_t move, uint32_t games, uint32_t score)
+{
+    for (auto &known : moves){
+        if (known.move==move){
+            known.games += games;
+            known.score += score;
+            return;
+        }
+    }
+    moves.push_back({move, games, score});
+}
+
+opening_tree_builder::opening_tree_builder(int plies, unsigned threads)
+    : max_ply{plies}, thread_count{threads>0 ? threads : 1}
+{
+    shards.resize(shard_count);
+}
+
+// Replay a game from the initial position, adding its first max_ply moves to the target shards
+void opening_tree_builder::replay(const std::vector<std::string> &san_moves, const std::string &result, std::vector<shard> &target, size_t &skipped, size_t &moves) const
+{
+    uint32_t points[2]{}; // Indexed by player_color
+    if (result=="1-0"){
+        points[chess_vars::white] = 2;
+    } else if (result=="0-1"){
+        points[chess_vars::black] = 2;
+    } else if (result=="1/2-1/2"){
+        points[chess_vars::white] = points[chess_vars::black] = 1;
+    }
+
+    compact_board board {compact_board::starting_position()};
+    int ply{};
+    for (const std::string &san : san_moves){
+        if (ply>=max_ply) break;
+        compact_move m;
+        if (!find_san_move(board, san, m)){ // Keep the moves before the illegal one
+            skipped++;
+            return;
+        }
+        uint64_t key {polyglot_key(board)};
+        add_tree_move(target[key % shard_count][key], encode_book_move(m), 1, points[board.side_to_move()]);
+        board.make_move(m);
+        ply++;
+    }
+    moves += san_moves.size();
+}
+
+// Read a PGN file (.pgn, or any file starting with a tag) or a move list (one game per line).
+// The file is split in as many parts as there are threads; each thread fills its own shards, which are merged at the end.
+bool opening_tree_builder::add_file(std::string path)
+{
+    mapped_file games_file;
+    if (!games_file.open(path)){
+        std::cerr<<"WARNING: could not open "<<path<<std::endl;
+        return false;
+    }
+    std::string_view text {reinterpret_cast<const char*>(games_file.data()), games_file.size()};
+    size_t first_char {text.find_first_not_of(" \t\r\n")};
+    bool is_pgn { (path.size()>4 && get_lower(path.substr(path.size()-4))==".pgn")
+                  || (first_char!=std::string_view::npos && text[first_char]=='[') };
+
+    std::vector<size_t> bounds {0};
+    for (unsigned t{1}; t<thread_count; t++){
+        bounds.push_back(std::max(bounds.back(), next_game_start(text, text.size()*t/thread_count, !is_pgn)));
+    }
+    bounds.push_back(text.size());
+
+    std::vector<std::vector<shard>> worker_shards(thread_count, std::vector<shard>(shard_count));
+    std::vector<size_t> worker_games(thread_count), worker_skipped(thread_count), worker_moves(thread_count);
+    std::vector<std::thread> workers;
+    for (unsigned t{}; t<thread_count; t++){
+        workers.emplace_back([&, t]{
+            read_games(text.substr(bounds[t], bounds[t+1] - bounds[t]), !is_pgn,
+                [&, t](std::vector<std::string> &san_moves, const std::string &result){
+                    worker_games[t]++;
+                    replay(san_moves, result, worker_shards[t], worker_skipped[t], worker_moves[t]);
+                });
+        });
+    }
+    for (auto &worker : workers) worker.join();
+    workers.clear();
+
+    // Merge: each thread owns a disjoint set of shards
+    for (unsigned t{}; t<thread_count; t++){
+        workers.emplace_back([&, t]{
+            for (size_t s{t}; s<shard_count; s+=thread_count){
+                for (auto &partial : worker_shards){
+                    for (auto &position : partial[s]){
+                        std::vector<tree_move> &moves {shards[s][position.first]};
+                        for (auto &m : position.second) add_tree_move(moves, m.move, m.games, m.score);
+                    }
+                    shard().swap(partial[s]);
+                }
+            }
+        });
+    }
+    for (auto &worker : workers) worker.join();
+
+    for (unsigned t{}; t<thread_count; t++){
+        games_read += worker_games[t];
+        games_skipped += worker_skipped[t];
+        moves_read += worker_moves[t];
+    }
+    return true;
+}
+
+size_t opening_tree_builder::positions() const
+{
+    size_t total{};
+    for (auto &s : shards) total += s.size();
+    return total;
+}
+
+// Records are sorted by key, then by decreasing number of games
+bool opening_tree_builder::write(std::string path) const
+{
+    std::ofstream tree_file(path, std::ios::binary);
+    if (!tree_file.is_open()){
+        std::cerr<<"WARNING: could not create "<<path<<std::endl;
+        return false;
+    }
+    auto put = [&tree_file](uint64_t value, int bytes){
+        for (int b{bytes-1}; b>=0; b--){
+            tree_file.put(static_cast<char>((value >> (8*b)) & 0xFF));
+        }
+    };
+
+    std::vector<std::pair<uint64_t, const std::vector<tree_move>*>> sorted;
+    size_t records{};
+    for (auto &s : shards){
+        for (auto &position : s){
+            sorted.push_back({position.first, &position.second});
+            records += position.second.size();
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<uint64_t, const std::vector<tree_move>*> &a, const std::pair<uint64_t, const std::vector<tree_move>*> &b){
+        return a.first < b.first;
+    });
+
+    tree_file.write(tree_magic, 4);
+    put(tree_version, 4);
+    put(static_cast<uint32_t>(max_ply), 4);
+    put(records, 8);
+    for (auto &position : sorted){
+        std::vector<tree_move> moves {*position.second};
+        std::sort(moves.begin(), moves.end(), [](const tree_move &a, const tree_move &b){ return a.games > b.games; });
+        for (auto &m : moves){
+            put(position.first, 8);
+            put(m.move, 2);
+            put(m.games, 4);
+            put(m.score, 4);
+        }
+    }
+    return tree_file.good();
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Reading %%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+bool opening_tree::open(std::string path)
+{
+    record_count = 0;
+    if (!file.open(path)){
+        std::cerr<<"WARNING: could not open the opening tree "<<path<<std::endl;
+        return false;
+    }
+    if (file.size()<tree_header_size || !std::equal(tree_magic, tree_magic+4, reinterpret_cast<const char*>(file.data()))
+        || read_be32(file.data()+4)!=tree_version){
+        std::cerr<<"WARNING: "<<path<<" is not an opening tree index"<<std::endl;
+        file.close();
+        return false;
+    }
+    record_count = std::min<uint64_t>(read_be64(file.data()+12), (file.size() - tree_header_size)/tree_record_size);
+    return true;
+}
+
+// Moves played from the position, most played first
+std::vector<tree_move> opening_tree::find(const compact_board &board) const
+{
+    std::vector<tree_move> moves;
+    if (!is_open()) return moves;
+
+    const uint8_t *records {file.data() + tree_header_size};
+    uint64_t key {polyglot_key(board)};
+    size_t low{0}, high{record_count};
+    while (low<high){
+        size_t middle {low + (high-low)/2};
+        if (read_be64(records + tree_record_size*middle) < key){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (size_t i{low}; i<record_count && read_be64(records + tree_record_size*i)==key; i++){
+        const uint8_t *p {records + tree_record_size*i};
+        moves.push_back({read_be16(p+8), read_be32(p+10), read_be32(p+14)});
+    }
+    return moves;
+}
@@ -0,0 +1,79 @@
+// Opening tree, part of the C++ Chess Project.
+// Aggregates, over large game collections, how often each move was played from each position and how it scored:
+// - collections are split between worker threads, each replaying its games on compact_board
+// - every worker fills its own shards (hash maps split by position key), so no locks are needed
+// - shards are merged at the end, one shard per thread at a time, then written to a sorted index file
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+
+#include "compact_board.h"
+#include "mapped_file.h"
+#include "opening_book.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Statistics of one move from one position
+struct tree_move
+{
+    uint16_t move{};   // Polyglot move encoding (see encode_book_move)
+    uint32_t games{};  // Number of games in which the move was played
+    uint32_t score{};  // Half-points scored by the side which played the move (games without a result score nothing)
+};
+
+class opening_tree_builder
+{
+    private:
+        typedef std::unordered_map<uint64_t, std::vector<tree_move>> shard;
+        std::vector<shard> shards; // Merged statistics, indexed by key % shard_count
+        size_t shard_count{64};
+        int max_ply{40};
+        unsigned thread_count{1};
+        size_t games_read{0}, games_skipped{0}, moves_read{0};
+
+        void replay(const std::vector<std::string> &san_moves, const std::string &result, std::vector<shard> &target, size_t &skipped, size_t &moves) const;
+    public:
+        opening_tree_builder(int plies=40, unsigned threads=std::thread::hardware_concurrency());
+
+        bool add_file(std::string path);
+        size_t games() const
+        {
+            return games_read;
+        }
+        size_t skipped() const
+        {
+            return games_skipped;
+        }
+        size_t moves() const
+        {
+            return moves_read;
+        }
+        size_t positions() const;
+        bool write(std::string path) const;
+};
+
+// Read-only access to an index written by opening_tree_builder
+class opening_tree
+{
+    private:
+        mapped_file file;
+        size_t record_count{0};
+    public:
+        opening_tree() = default;
+        opening_tree(std::string path){ open(path); }
+
+        bool open(std::string path);
+        bool is_open() const
+        {
+            return file.is_open();
+        }
+        size_t size() const
+        {
+            return record_count;
+        }
+        std::vector<tree_move> find(const compact_board &board) const;
+};
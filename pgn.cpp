@@ -0,0 +1,230 @@
+// PGN reading, part of the C++ Chess Project.
+
+#include <array>
+
+#include "pgn.h"
+#include "compact_board.h"
+#include "opening_book.h"
+#include "notation.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Characters which end a move token
+const std::array<bool, 256> &pgn_delimiters()
+{
+    static const std::array<bool, 256> table = []{
+        std::array<bool, 256> delimiters{};
+        for (char c : std::string_view{" \t\r\n\v\f{}()[];"}) delimiters[static_cast<uint8_t>(c)] = true;
+        return delimiters;
+    }();
+    return table;
+}
+
+bool is_pgn_space(char c)
+{
+    return c==' ' || c=='\t' || c=='\r' || c=='\n' || c=='\v' || c=='\f';
+}
+
+std::string_view pgn_game::tag(std::string_view name) const
+{
+    for (auto &t : tags){
+        if (t.name==name) return t.value;
+    }
+    return std::string_view();
+}
+
+void pgn_reader::skip_line()
+{
+    size_t end {text.find('\n', position)};
+    position = end==std::string_view::npos ? text.size() : end;
+}
+
+bool pgn_reader::next(pgn_game &game)
+{
+    game.tags.clear();
+    game.moves.clear();
+    game.move_offsets.clear();
+    game.result = std::string_view();
+    game.error = std::string_view();
+    game.error_offset = 0;
+    bool started{false};
+    int variation_depth{};
+    auto fail = [&game](std::string_view error, size_t offset){
+        if (game.error.empty()){
+            game.error = error;
+            game.error_offset = offset;
+        }
+    };
+
+    const std::array<bool, 256> &delimiters {pgn_delimiters()};
+    while (position<text.size()){
+        char c {text[position]};
+        if (c=='\n'){
+            position++;
+            if (line_per_game && started) break;
+        } else if (is_pgn_space(c)){
+            position++;
+        } else if (c=='%' && (position==0 || text[position-1]=='\n')){ // Escape line
+            skip_line();
+        } else if (c=='['){
+            if (!game.moves.empty() && variation_depth==0) break; // Tags of the next game: this one has no result
+            if (!started) game.offset = position;
+            started = true;
+            // [Name "value"]
+            size_t name_start {position + 1};
+            size_t name_end {std::min(text.find_first_of(" \t\"]", name_start), text.size())};
+            size_t quote {text.find('"', name_end)};
+            size_t value_end {quote};
+            while (value_end!=std::string_view::npos){ // Closing quote, skipping escaped ones
+                value_end = text.find_first_of("\\\"", value_end + 1);
+                if (value_end==std::string_view::npos || text[value_end]=='"') break;
+                value_end++;
+            }
+            size_t close {value_end==std::string_view::npos ? std::string_view::npos : text.find(']', value_end)};
+            if (quote==std::string_view::npos || close==std::string_view::npos || text.substr(name_end, quote - name_end).find('\n')!=std::string_view::npos){
+                fail("malformed tag", position);
+                skip_line();
+                continue;
+            }
+            game.tags.push_back(pgn_tag{text.substr(name_start, name_end - name_start), text.substr(quote + 1, value_end - quote - 1)});
+            position = close + 1;
+        } else if (c=='{'){
+            size_t close {text.find('}', position)};
+            if (close==std::string_view::npos){
+                fail("comment never closed", position);
+                position = text.size();
+            } else {
+                position = close + 1;
+            }
+        } else if (c==';'){
+            skip_line();
+        } else if (c=='('){
+            variation_depth++;
+            position++;
+        } else if (c==')'){
+            if (variation_depth==0) fail("unbalanced ')'", position);
+            else variation_depth--;
+            position++;
+        } else if (c==']' || c=='}'){
+            fail("unexpected bracket", position);
+            position++;
+        } else {
+            size_t start {position};
+            while (position<text.size() && !delimiters[static_cast<uint8_t>(text[position])]) position++;
+            std::string_view token {text.substr(start, position - start)};
+            if (!started) game.offset = start;
+            started = true;
+            if (variation_depth>0 || token[0]=='$') continue; // Variation or NAG
+
+            if (token=="1-0" || token=="0-1" || token=="1/2-1/2" || token=="*"){
+                game.result = token;
+                break;
+            }
+            // Move numbers: "12." and "12..." on their own or glued to the move ("12.e4"). Digits only count as a move number
+            // when dots follow them, so that castling written with zeros ("0-0") is left whole.
+            size_t digits{};
+            while (digits<token.size() && token[digits]>='0' && token[digits]<='9') digits++;
+            size_t number_end {digits};
+            while (number_end<token.size() && token[number_end]=='.') number_end++;
+            if (number_end==token.size()) continue;
+            if (number_end==digits) number_end = 0;
+            game.moves.push_back(token.substr(number_end));
+            game.move_offsets.push_back(start + number_end);
+        }
+    }
+    if (!started) return false;
+    if (variation_depth>0) fail("variation never closed", position);
+    if (game.result.empty()) game.result = "*";
+    return true;
+}
+
+// Start of the first game after offset: the first tag of a PGN game, or the start of a line for move lists
+size_t next_game_start(std::string_view text, size_t offset, bool line_per_game)
+{
+    size_t line_start {text.find('\n', offset)};
+    while (line_start!=std::string_view::npos && ++line_start<text.size()){
+        if (line_per_game) return line_start;
+        if (text[line_start]=='['){
+            // Tag line: it opens a game unless the previous non-blank line is also a tag
+            size_t previous {text.find_last_not_of(" \t\r\n", line_start - 1)};
+            if (previous==std::string_view::npos) return line_start;
+            size_t previous_start {text.rfind('\n', previous)};
+            previous_start = previous_start==std::string_view::npos ? 0 : previous_start + 1;
+            if (text[previous_start]!='[') return line_start;
+        }
+        line_start = text.find('\n', line_start);
+    }
+    return text.size();
+}
+
+// Play every main-line move of a game. Stops at the first move which cannot be read or is illegal, or which follows a
+// draw ending the game by itself: the same draws by rule as the replay of --batch, where nobody claims a draw.
+void replay_pgn(const pgn_game &game, pgn_verdict &verdict)
+{
+    verdict = pgn_verdict();
+    verdict.final_position = compact_board::starting_position();
+    std::string_view fen {game.tag("FEN")};
+    if (!fen.empty() && !compact_board::from_fen(fen, verdict.final_position)){
+        verdict.bad_setup = true;
+        return;
+    }
+
+    // A fivefold repetition needs sixteen plies without a capture or a pawn move: only then are the keys of the positions
+    // since the last one taken, by playing those plies again, and from there on after each move
+    compact_board &board {verdict.final_position};
+    compact_board since {board}; // Position after the last capture or pawn move
+    thread_local std::vector<compact_move> reversible; // Kept between calls: no allocation once they have grown
+    thread_local std::vector<uint64_t> keys;
+    reversible.clear();
+    keys.clear();
+    const size_t fivefold_plies {16};
+    compact_move m;
+    for (size_t k{}; k<game.moves.size(); k++){
+        if (verdict.outcome!=chess_vars::ongoing){
+            verdict.after_end = true;
+        } else {
+            verdict.status = read_san(board, game.moves[k], m);
+        }
+        if (!verdict.valid()){
+            verdict.failed_move = game.moves[k];
+            verdict.error_offset = game.move_offsets[k];
+            return;
+        }
+        board.make_move(m);
+        verdict.moves++;
+
+        int repetitions{};
+        if (board.halfmoves()==0){
+            since = board;
+            reversible.clear();
+            keys.clear();
+        } else {
+            reversible.push_back(m);
+        }
+        if (reversible.size()>=fivefold_plies){
+            if (keys.empty()){
+                compact_board replayed {since};
+                keys.push_back(polyglot_key(replayed));
+                for (auto &played : reversible){
+                    replayed.make_move(played);
+                    keys.push_back(polyglot_key(replayed));
+                }
+            } else {
+                keys.push_back(polyglot_key(board));
+            }
+            for (size_t back{2}; back<keys.size(); back+=2){
+                if (keys[keys.size() - 1 - back]==keys.back()) repetitions++;
+            }
+        }
+        verdict.outcome = board.draw_by_rule(repetitions, false);
+    }
+    if (!board.has_legal_move()){
+        if (!board.in_check()){
+            verdict.outcome = chess_vars::draw_by_stalemate;
+        } else {
+            verdict.outcome = board.side_to_move()==chess_vars::white ? chess_vars::black_won : chess_vars::white_won;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+// PGN reading, part of the C++ Chess Project.
+// Game collections are read straight from memory (e.g. a mapped file), one game at a time, without copying the text:
+// - tag pairs and main-line moves come out as std::string_view into the input, with their byte offsets
+// - comments ({...} and ; to the end of the line), NAGs ($1), escape lines (%) and variations, however deeply nested, are skipped
+// - a result token ends a game; so does the tag section of the next game if the result is missing
+// Every move of a game can then be checked on a compact_board (replay_pgn), from the standard start or from its FEN tag.
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "compact_board.h"
+#include "notation.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+struct pgn_tag
+{
+    std::string_view name;
+    std::string_view value; // Without the quotes, escapes (\" and \\) left in
+};
+
+// One game of the input. The views point into the text given to the reader: they are valid as long as that text is.
+// The vectors keep their capacity from one game to the next.
+struct pgn_game
+{
+    size_t offset{};                   // Byte offset of the start of the game
+    std::vector<pgn_tag> tags;
+    std::vector<std::string_view> moves; // Main line only, move numbers removed
+    std::vector<size_t> move_offsets;
+    std::string_view result;           // 1-0, 0-1, 1/2-1/2 or *
+    std::string_view error;            // Set if the text of the game is malformed (e.g. a comment which is never closed)
+    size_t error_offset{};
+
+    std::string_view tag(std::string_view name) const;
+};
+
+class pgn_reader
+{
+    private:
+        std::string_view text;
+        size_t position{};
+        bool line_per_game{false};
+
+        void skip_line();
+    public:
+        // line_per_game: move lists with one game per line, where the end of the line also ends the game
+        pgn_reader(std::string_view text_, bool line_per_game_=false) : text{text_}, line_per_game{line_per_game_} {}
+
+        // Reads the next game. Returns false once the input holds no more games.
+        bool next(pgn_game &game);
+        size_t offset() const
+        {
+            return position;
+        }
+};
+
+// Start of the first game after offset, or the end of the text: used to split a collection between threads
+size_t next_game_start(std::string_view text, size_t offset, bool line_per_game);
+
+// Outcome of playing the moves of a game
+struct pgn_verdict
+{
+    size_t moves{};                    // Moves played, up to the first one which failed
+    san_status status{san_ok};         // Why the move after them failed, if one did
+    std::string_view failed_move;
+    size_t error_offset{};
+    bool bad_setup{false};             // The FEN tag could not be read
+    bool after_end{false};             // The move after them followed a draw which ended the game by itself
+    compact_board final_position;
+    // Checkmate, stalemate, or a draw which ends the game by itself (dead position, fivefold repetition,
+    // seventy-five-move rule) on the board, otherwise ongoing
+    chess_vars::game_outcome outcome{chess_vars::ongoing};
+
+    bool valid() const
+    {
+        return status==san_ok && !bad_setup && !after_end;
+    }
+    // Why the move after the ones played failed
+    const char *error_message() const
+    {
+        return after_end ? "move after the end of the game" : san_status_message(status);
+    }
+};
+
+void replay_pgn(const pgn_game &game, pgn_verdict &verdict);
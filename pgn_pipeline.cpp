@@ -0,0 +1,103 @@
+// Parallel PGN validation, part of the C++ Chess Project.
+
+#include <map>
+#include <atomic>
+#include <algorithm>
+
+#include "pgn_pipeline.h"
+#include "pgn.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+pgn_pipeline::pgn_pipeline(unsigned threads, bool line_per_game_, size_t chunk_bytes_)
+    : thread_count{threads>0 ? threads : 1}, chunk_bytes{chunk_bytes_>0 ? chunk_bytes_ : 1}, line_per_game{line_per_game_}
+{
+    // Enough chunks in flight to keep every worker busy while the writer waits for the oldest one
+    window = 4*thread_count;
+}
+
+// Read and replay the games of one chunk. The reader, the game and the board are local to the call.
+void pgn_pipeline::replay_chunk(std::string_view text, const chunk &part, chunk_reports &reports) const
+{
+    reports.index = part.index;
+    reports.games.clear();
+    pgn_reader reader {text.substr(part.begin, part.end - part.begin), line_per_game};
+    pgn_game game;
+    while (reader.next(game)){
+        reports.games.emplace_back();
+        pgn_game_report &report {reports.games.back()};
+        report.offset = part.begin + game.offset;
+        report.result = game.result;
+        report.syntax_error = game.error;
+        report.syntax_error_offset = game.error.empty() ? 0 : part.begin + game.error_offset;
+        replay_pgn(game, report.verdict);
+        if (!report.verdict.valid() && !report.verdict.bad_setup) report.verdict.error_offset += part.begin;
+    }
+}
+
+void pgn_pipeline::run(std::string_view text, const std::function<void(const pgn_game_report&)> &on_game)
+{
+    bounded_queue<chunk> chunks {window};
+    bounded_queue<chunk_reports> finished {window};
+
+    // The splitter may only start a chunk once fewer than window chunks are waiting to be written
+    std::mutex window_lock;
+    std::condition_variable window_open;
+    size_t chunks_written{};
+
+    std::thread splitter([&]{
+        size_t begin{}, index{};
+        while (begin<text.size()){
+            size_t end {text.size() - begin<=chunk_bytes ? text.size() : std::max(begin + 1, next_game_start(text, begin + chunk_bytes, line_per_game))};
+            {
+                std::unique_lock<std::mutex> guard {window_lock};
+                window_open.wait(guard, [&]{ return index - chunks_written<window; });
+            }
+            if (!chunks.push(chunk{index++, begin, end})) break;
+            begin = end;
+        }
+        chunks.close();
+    });
+
+    std::atomic<unsigned> running {thread_count};
+    std::vector<std::thread> workers;
+    for (unsigned t{}; t<thread_count; t++){
+        workers.emplace_back([&]{
+            chunk part;
+            while (chunks.pop(part)){
+                chunk_reports reports;
+                replay_chunk(text, part, reports);
+                finished.push(std::move(reports));
+            }
+            if (--running==0) finished.close(); // The last worker out closes the writer's queue
+        });
+    }
+
+    // Writer: chunks finished out of order wait in pending until every chunk before them has been written
+    std::map<size_t, std::vector<pgn_game_report>> pending;
+    size_t next_chunk{};
+    chunk_reports reports;
+    while (finished.pop(reports)){
+        pending[reports.index] = std::move(reports.games);
+        for (auto first {pending.begin()}; first!=pending.end() && first->first==next_chunk; first = pending.begin()){
+            for (auto &report : first->second){
+                report.number = ++games_read;
+                moves_read += report.verdict.moves;
+                if (!report.verdict.valid()) games_failed++;
+                on_game(report);
+            }
+            pending.erase(first);
+            next_chunk++;
+            {
+                std::lock_guard<std::mutex> guard {window_lock};
+                chunks_written = next_chunk;
+            }
+            window_open.notify_one();
+        }
+    }
+
+    splitter.join();
+    for (auto &worker : workers) worker.join();
+}
@@ -0,0 +1,115 @@
+// Parallel PGN validation, part of the C++ Chess Project.
+// A collection is checked by three stages joined by bounded queues:
+// - a splitter thread cuts the text into chunks of whole games (about chunk_bytes each)
+// - worker threads read and replay the games of a chunk, each on its own compact_board: no board state is shared
+// - the calling thread writes the reports, chunk after chunk in the order of the input, whatever order they were finished in
+// At most window chunks are in flight between the splitter and the writer, so memory stays bounded on any input size.
+
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "pgn.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Blocking queue between two stages: push waits while the queue is full, pop while it is empty.
+// Once closed, push refuses new items and pop returns what is left, then false.
+template <typename T>
+class bounded_queue
+{
+    private:
+        std::mutex lock;
+        std::condition_variable not_full, not_empty;
+        std::deque<T> items;
+        size_t capacity{1};
+        bool closed{false};
+    public:
+        bounded_queue(size_t capacity_) : capacity{capacity_>0 ? capacity_ : 1} {}
+
+        bool push(T item)
+        {
+            std::unique_lock<std::mutex> guard {lock};
+            not_full.wait(guard, [this]{ return closed || items.size()<capacity; });
+            if (closed) return false;
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+            return true;
+        }
+        bool pop(T &item)
+        {
+            std::unique_lock<std::mutex> guard {lock};
+            not_empty.wait(guard, [this]{ return closed || !items.empty(); });
+            if (items.empty()) return false;
+            item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return true;
+        }
+        void close()
+        {
+            std::lock_guard<std::mutex> guard {lock};
+            closed = true;
+            not_full.notify_all();
+            not_empty.notify_all();
+        }
+};
+
+// Everything known about one game once it has been replayed. Views point into the input text.
+struct pgn_game_report
+{
+    size_t number{};                   // Position of the game in the input, from 1
+    size_t offset{};                   // Byte offsets are from the start of the input
+    std::string_view result;           // Result token of the game
+    std::string_view syntax_error;     // Malformed text (see pgn_game::error)
+    size_t syntax_error_offset{};
+    pgn_verdict verdict;
+};
+
+class pgn_pipeline
+{
+    private:
+        struct chunk
+        {
+            size_t index{};
+            size_t begin{}, end{};
+        };
+        struct chunk_reports
+        {
+            size_t index{};
+            std::vector<pgn_game_report> games;
+        };
+
+        unsigned thread_count{1};
+        size_t chunk_bytes{1<<18};
+        size_t window{4};
+        bool line_per_game{false};
+        size_t games_read{0}, games_failed{0}, moves_read{0};
+
+        void replay_chunk(std::string_view text, const chunk &part, chunk_reports &reports) const;
+    public:
+        // line_per_game: move lists with one game per line (see pgn_reader)
+        pgn_pipeline(unsigned threads=std::thread::hardware_concurrency(), bool line_per_game_=false, size_t chunk_bytes_=1<<18);
+
+        // Replays every game of text. on_game is called on the calling thread, once per game, in the order of the input.
+        void run(std::string_view text, const std::function<void(const pgn_game_report&)> &on_game);
+
+        size_t games() const
+        {
+            return games_read;
+        }
+        size_t failed() const
+        {
+            return games_failed;
+        }
+        size_t moves() const
+        {
+            return moves_read;
+        }
+};
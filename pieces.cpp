@@ -1,4 +1,5 @@
 #include <map>
+#include <type_traits>
 
 #include "pieces.h"
 #include "position.h"
@@ -6,18 +7,67 @@
 #pragma once
 
 
-// Initialise static variables and functions
-std::map<position, piece*> piece::occupied_squares{};
-std::map<position, std::vector<piece*>> piece::destinations{};
-std::map<chess_vars::player_color, int> piece::piece_count{}; // will probs need to set ints to 0.
-std::map<chess_vars::player_color,std::vector<position>> piece::threats{}, piece::pinners{}, piece::defences{};
+// Storage of the pieces of one position_state: 64 slots, as a board never holds more pieces, each large enough for any
+// piece. A slot keeps the move list of the pieces it held, so that the next piece made in it (after a capture, a
+// promotion or a reset) starts with room for its moves.
+struct piece_pool
+{
+    static const int slot_count {64};
+    static const size_t max_piece_moves {27}; // A queen in the middle of an empty board
+    std::aligned_union_t<0, pawn, knight, bishop, rook, queen, king> slots[slot_count];
+    piece *held[slot_count]{};
+    std::vector<position> move_lists[slot_count];
+    int free_slots[slot_count];
+    int free_count{slot_count};
+    uint64_t live{0};
+
+    piece_pool()
+    {
+        for (int n{}; n<slot_count; n++) free_slots[n] = slot_count - 1 - n;
+    }
+};
+
+position_state::position_state() : pool{std::make_unique<piece_pool>()} {}
+
+position_state::~position_state()
+{
+    reset_occupied_spaces();
+}
 
+template <typename T>
+T *position_state::create(chess_vars::player_color color, chess_vars::piece_type type, position pos)
+{
+    if (pool->free_count==0){
+        return new T(*this, color, type, pos); // Only a board of more than 64 pieces gets here
+    }
+    int n {pool->free_slots[--pool->free_count]};
+    T *made {new (&pool->slots[n]) T(*this, color, type, pos)};
+    made->pool_slot = n;
+    if (pool->move_lists[n].capacity()<piece_pool::max_piece_moves) pool->move_lists[n].reserve(piece_pool::max_piece_moves);
+    made->allowed_moves.swap(pool->move_lists[n]);
+    pool->held[n] = made;
+    pool->live |= uint64_t{1} << n;
+    return made;
+}
+
+void position_state::release(piece *old_piece)
+{
+    if (old_piece==nullptr) return;
+    int n {old_piece->pool_slot};
+    if (n<0){
+        delete old_piece;
+        return;
+    }
+    old_piece->allowed_moves.clear();
+    old_piece->allowed_moves.swap(pool->move_lists[n]);
+    old_piece->~piece();
+    pool->held[n] = nullptr;
+    pool->live &= ~(uint64_t{1} << n);
+    pool->free_slots[pool->free_count++] = n;
+}
 
 // Pawn variables
-bool piece::legal_en_passant { false };
-bool piece::move_is_en_passant{ false };
-position piece::capture {position(0,0)};
-void piece::set_legal_en_passant(bool e_p_status, position pawn_position)
+void position_state::set_legal_en_passant(bool e_p_status, position pawn_position)
 {
     legal_en_passant = e_p_status;
     move_is_en_passant = false;
@@ -26,38 +76,27 @@ void piece::set_legal_en_passant(bool e_p_status, position pawn_position)
     }
 }
 
-
-
-std::map<position, piece*>* piece::get_locations()
-{
-    return &occupied_squares;
-};
-
-std::map<position, std::vector<piece*>>* piece::get_destinations()
-{
-    return &destinations;
-};
-void piece::reset_occupied_spaces()
+void position_state::reset_occupied_spaces()
 {
+#ifdef DEBUGMODE
     std::cout<<"--> Resetting occupied_squares..."<<std::endl;
-    for (int x{1}; x<=8; x++){
-        for (int y{1}; y<=8; y++){
-            if ( occupied_squares.count(position(x,y))){
-                piece *temp {occupied_squares.at(position(x,y))};
-                chess_vars::player_color col {(*temp).get_owner()};
-                chess_vars::piece_type type {(*temp).get_abbrev()};
-                position pos_ {(*temp).location()};
-                delete temp;
-                occupied_squares.erase(position(x,y));
-            }
-        }
+#endif
+    // Every piece of the pool goes back to it, on the board or not. Pieces made outside the pool are only known by their square.
+    for (auto iter=occupied_squares.begin(); iter!=occupied_squares.end(); ++iter){
+        if (iter->second->pool_slot<0) delete iter->second;
+    }
+    for (int n{}; pool->live!=0; n++){
+        if (pool->live >> n & 1) release(pool->held[n]);
     }
 
     occupied_squares.clear();
+    piece_count.clear();
+#ifdef DEBUGMODE
     std::cout<<"\tDone resetting."<<std::endl;
+#endif
 }
 
-void piece::reset_threats(chess_vars::player_color current_player)
+void position_state::reset_threats(chess_vars::player_color current_player)
 {
     threats[current_player].clear();
     defences[current_player].clear();
@@ -66,35 +105,54 @@ void piece::reset_threats(chess_vars::player_color current_player)
     // Or threats.erase(owner) if we want to remove that key (bad idea?)
 }
 
-bool piece::is_threatened(piece* piece_ptr)
+bool position_state::is_threatened(piece* piece_ptr)
 {
     chess_vars::player_color enemy_color {switch_player(piece_ptr->get_owner())};
     position pos {piece_ptr->location()};
     return is_in(threats[enemy_color], pos);
 }
 
-piece* piece_initialiser(chess_vars::player_color color, chess_vars::piece_type type, position pos)
+void position_state::adopt(position_state &other)
+{
+    if (&other==this) return;
+    reset_occupied_spaces();
+    threats.swap(other.threats);
+    pinners.swap(other.pinners);
+    defences.swap(other.defences);
+    legal_en_passant = other.legal_en_passant;
+    move_is_en_passant = other.move_is_en_passant;
+    capture = other.capture;
+    occupied_squares.swap(other.occupied_squares);
+    pool.swap(other.pool);
+    destinations.swap(other.destinations);
+    piece_count.swap(other.piece_count);
+    for (auto iter=occupied_squares.begin(); iter!=occupied_squares.end(); ++iter){
+        iter->second->state = this;
+    }
+}
+
+piece* piece_initialiser(position_state &board_state, chess_vars::player_color color, chess_vars::piece_type type, position pos)
 {
     piece* piece_ptr;
     switch (type)
     {
     case chess_vars::pawn:
-        piece_ptr = new pawn(color, type, pos);
+        piece_ptr = board_state.create<pawn>(color, type, pos);
         break;
     case chess_vars::rook:
-        piece_ptr = new rook(color, type, pos);
+        piece_ptr = board_state.create<rook>(color, type, pos);
         break;
     case chess_vars::knight:
-        piece_ptr = new knight(color, type, pos);
+        piece_ptr = board_state.create<knight>(color, type, pos);
         break;
     case chess_vars::bishop:
-        piece_ptr = new bishop(color, type, pos);
+        piece_ptr = board_state.create<bishop>(color, type, pos);
         break;
     case chess_vars::king:
-        piece_ptr = new king(color, type, pos);
+        piece_ptr = board_state.create<king>(color, type, pos);
         break;
     case chess_vars::queen:
-        piece_ptr = new queen(color, type, pos);
+        piece_ptr = board_state.create<queen>(color, type, pos);
         break;
     default:
         throw InvalidPiece();
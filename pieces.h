@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <string>
 #include <map>
+#include <memory>
 
 #include "position.h"
 #include "utils.cpp"
@@ -16,6 +17,72 @@ typedef player_map<position> position_map;
 //typedef player_map<position> position_map;
 
 
+class piece;
+struct piece_pool;
+
+// Steps of the pieces, shared by all the pieces of a type
+const std::vector<position> no_increments {};
+const std::vector<position> knight_increments {position(1,2), position(1,-2), position(-1,2), position(-1,-2),
+    position(2,1), position(2,-1), position(-2,1), position(-2,-1)};
+const std::vector<position> diagonal_increments {position(1,1), position(1,-1), position(-1,-1), position(-1,1)};
+const std::vector<position> straight_increments {position(1,0), position(-1,0), position(0,1), position(0,-1)};
+const std::vector<position> all_increments {position(1,1), position(1,-1), position(-1,-1), position(-1,1), //diagonal moves
+    position(1,0), position(-1,0), position(0,1), position(0,-1)}; // horizontal + vertical moves
+
+// Everything the pieces of one board share. Each game (or board set up aside, e.g. while a savefile is checked) owns one,
+// and its pieces point back to it: boards in different states never see each other's pieces.
+class position_state
+{
+    public:
+        std::map<chess_vars::player_color,std::vector<position>> threats, pinners, defences; // Concerns the opposition, i.e. no requirement to treat on piece-by-piece basis
+
+        // variables for the pawn 
+        bool legal_en_passant{false};
+        bool move_is_en_passant{false};
+        position capture{position(0,0)}; // position of pawn to capture
+
+        std::map<position, piece*> occupied_squares; // Track all squares occupied by pieces
+        std::map<position, std::vector<piece*>> destinations; // Track all pieces that can access a given square
+        std::map<chess_vars::player_color, int> piece_count; // Track the number of pieces a player has (not relevant to functioning of code)
+
+        position_state();
+        // The pieces point to their state: no copies
+        position_state(const position_state&) = delete;
+        position_state &operator=(const position_state&) = delete;
+        ~position_state();
+
+        // Pieces are made in the state's own pool, and given back to it when captured or replaced: no allocation once
+        // the pool has held a game, and the state frees them all on reset_occupied_spaces.
+        template <typename T>
+        T *create(chess_vars::player_color color, chess_vars::piece_type type, position pos);
+        void release(piece *old_piece);
+
+        std::map<position, piece*>* get_locations()
+        {
+            return &occupied_squares;
+        }
+        std::map<position, std::vector<piece*>>* get_destinations()
+        {
+            return &destinations;
+        }
+        void reset_threats(chess_vars::player_color current_player);
+        void reset_occupied_spaces();
+        bool is_threatened(piece*);
+        void set_legal_en_passant(bool new_status, position weak_pawn);
+        bool en_passant_available() const
+        {
+            return legal_en_passant;
+        }
+        position en_passant_pawn() const
+        {
+            return capture;
+        }
+        // Takes over the pieces of another state, e.g. a position set up aside once it is found valid
+        void adopt(position_state &other);
+    private:
+        std::unique_ptr<piece_pool> pool;
+};
+
 class piece
 {
     // May not be necessary in the end, but convenient nonetheless
@@ -33,27 +100,20 @@ class piece
 
         // New approach for moves: must be made static TS!!
         std::vector<position> allowed_moves; // Piece by piece basis
-        static std::map<chess_vars::player_color,std::vector<position>> threats, pinners, defences; // Concerns the opposition, i.e. no requirement to treat on piece-by-piece basis
         //piece_lookup threats,pinners,defences;
         //position_map allowed_moves;
-        std::vector<position> increments;
+        const std::vector<position> *increments{&no_increments};
 
-        // variables for the pawn 
-        static bool legal_en_passant;
-        static bool move_is_en_passant;
-        static position capture; // position of pawn to capture
-        
-        static std::map<position, piece*> occupied_squares; // Track all squares occupied by pieces
-        static std::map<position, std::vector<piece*>> destinations; // Track all pieces that can access a given square
-        static std::map<chess_vars::player_color, int> piece_count; // Track the number of pieces a player has (not relevant to functioning of code)
+        position_state *state{nullptr}; // Board the piece is on, shared with the other pieces
+        int pool_slot{-1}; // Slot of the piece in the pool of its state
     public: 
         piece()=default;
-        piece(chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) :
-            owner{color}, abbreviation{abbrev}, current_position{start_location} 
+        piece(position_state &board_state, chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) :
+            owner{color}, abbreviation{abbrev}, current_position{start_location}, state{&board_state}
         {
             if (current_position.is_valid()){
-                occupied_squares[current_position] = this;
-                piece_count[owner] ++;
+                state->occupied_squares[current_position] = this;
+                state->piece_count[owner] ++;
             } else{
                 // Provide some error catching here
                 std::cerr<<"You gave an incorrect position when creating a new piece."<<std::endl;
@@ -68,12 +128,6 @@ class piece
         virtual void generate_threats();
         piece &operator=(piece&);
 
-        static std::map<position, piece*>* get_locations();
-        static std::map<position, std::vector<piece*>>* get_destinations();
-        static void reset_threats(chess_vars::player_color current_player);
-        static void reset_occupied_spaces();
-        static bool is_threatened(piece*);
-        static void set_legal_en_passant(bool new_status, position weak_pawn);
         position location() const
         {
             return current_position;
@@ -94,6 +148,21 @@ class piece
         {
             has_moved = moved_status;
         }
+        // Whether new_pos is among the moves generated for this piece (move() exits on any other square)
+        bool can_move_to(position new_pos)
+        {
+            return is_in(allowed_moves, new_pos);
+        }
+        // Moves handed over by the compact move generator (see chess::generate_moves), instead of generate_allowed_moves
+        void clear_allowed_moves()
+        {
+            allowed_moves.clear();
+        }
+        void allow_move(position new_pos)
+        {
+            allowed_moves.push_back(new_pos);
+            state->destinations[new_pos].push_back(this);
+        }
         // Return (true, ptr to captured piece) if a piece was captured, else return (false, random pointer). //TS: probs not best practise to leave uninitialised
         std::pair<bool,piece*> move(position new_pos)
         {
@@ -115,41 +184,43 @@ class piece
             // Is the move allowed?
             if (is_in(allowed_moves, new_pos)){
                 // Is the move legal?
-                occupied_squares.erase(current_position);
+                state->occupied_squares.erase(current_position);
                 
                 // Before updating new_pos: check if capture occurs? Will need to delete cpatured piece at some point
-                if (occupied_squares.count(new_pos)){
+                if (state->occupied_squares.count(new_pos)){
                     // Delete dynamic pointer to captured piece
-                    if (occupied_squares[new_pos]->get_owner()==owner){
+                    if (state->occupied_squares[new_pos]->get_owner()==owner){
                         //throw error
                         // Sanity check: should not happen as should already have been checked
                         std::cerr<<"ERROR: asking to delete my own piece during a capture! Exiting...";
                         exit(EXIT_FAILURE);                        
                     }
                     captured_piece.first = true;
-                    captured_piece.second = occupied_squares[new_pos];
+                    captured_piece.second = state->occupied_squares[new_pos];
                     //delete occupied_squares[new_pos]; // What if need to rollback??
-                } else if (legal_en_passant && abbreviation==chess_vars::pawn){
+                } else if (state->legal_en_passant && abbreviation==chess_vars::pawn){
                     int direction{1};
                     if (owner==chess_vars::black){
                         direction = -1;
                     }
                     position ep_pawn_pos{ new_pos.x(), new_pos.y()-direction};
-                    if (1==occupied_squares.count(ep_pawn_pos)){
+                    if (1==state->occupied_squares.count(ep_pawn_pos)){
                         bool test_ep_type, test_ep_owner;
-                        test_ep_owner = occupied_squares[ep_pawn_pos]->get_owner()!=owner;
-                        test_ep_type = occupied_squares[ep_pawn_pos]->get_abbrev()==chess_vars::pawn;
+                        test_ep_owner = state->occupied_squares[ep_pawn_pos]->get_owner()!=owner;
+                        test_ep_type = state->occupied_squares[ep_pawn_pos]->get_abbrev()==chess_vars::pawn;
                         if (test_ep_type && test_ep_owner){
                             captured_piece.first = true;
-                            captured_piece.second = occupied_squares[ep_pawn_pos];
-                            occupied_squares.erase(ep_pawn_pos);
+                            captured_piece.second = state->occupied_squares[ep_pawn_pos];
+                            state->occupied_squares.erase(ep_pawn_pos);
+#ifdef DEBUGMODE
                             std::cout<<"Confirmed En-passant -> returning piece to capture!"<<std::endl;
-                            move_is_en_passant = true;
+#endif
+                            state->move_is_en_passant = true;
                         }
                     }
                 }
                 
-                occupied_squares[new_pos] = this; 
+                state->occupied_squares[new_pos] = this; 
                 
                 current_position = new_pos;
                 has_moved ++;
@@ -171,40 +242,40 @@ class piece
             std::cout<<"UNMOVE CALLED!"<<std::endl;
 #endif
             // Is the previous location valid?
-            if (old_pos.is_valid() && occupied_squares.count(old_pos)==0){ // Verify that the previous position is indeed empty and valid
-                occupied_squares.erase(current_position); // Current position should no longer be occupied
+            if (old_pos.is_valid() && state->occupied_squares.count(old_pos)==0){ // Verify that the previous position is indeed empty and valid
+                state->occupied_squares.erase(current_position); // Current position should no longer be occupied
                 if (captured_piece.first){
-                    if (move_is_en_passant){
+                    if (state->move_is_en_passant){
                         int direction {1};
                         if (owner==chess_vars::black){
                             direction = -1;
                         }
-                        occupied_squares[current_position + position(0,-direction)] = captured_piece.second;
+                        state->occupied_squares[current_position + position(0,-direction)] = captured_piece.second;
                     } else {
-                        occupied_squares[current_position] = captured_piece.second; // If piece was captured: replace it here
+                        state->occupied_squares[current_position] = captured_piece.second; // If piece was captured: replace it here
                     }
                 }
-                occupied_squares[old_pos] = this;
+                state->occupied_squares[old_pos] = this;
                 current_position = old_pos;
                 has_moved --;
             // Castling: rook is in king's previous spot
-            } else if (old_pos.is_valid() && occupied_squares.count(old_pos)){
+            } else if (old_pos.is_valid() && state->occupied_squares.count(old_pos)){
                 
                 bool test_1, test_2, test_3, test_4, test_5;
-                test_1 = occupied_squares[old_pos]->get_owner()==owner; 
-                test_2 = occupied_squares[old_pos]->get_abbrev()==chess_vars::rook;
+                test_1 = state->occupied_squares[old_pos]->get_owner()==owner; 
+                test_2 = state->occupied_squares[old_pos]->get_abbrev()==chess_vars::rook;
                 test_3 = abs(old_pos.x()-current_position.x())==1;
                 test_4 = old_pos.y() == current_position.y();
                 test_5 = abbreviation == chess_vars::king;
                 
                 if ( test_1 && test_2 && test_3 && test_4 && test_5){
                     // Check that neighbouring piece in previous spot is actually a rook and that we are a king
-                    occupied_squares.erase(current_position); // Current position should no longer be occupied
+                    state->occupied_squares.erase(current_position); // Current position should no longer be occupied
                     if (captured_piece.first){
                         std::cerr<<"Move to undo involved a capture, yet it appears the last move was castling!"<<std::endl;
                         exit(EXIT_FAILURE);
                     }
-                    occupied_squares[old_pos] = this;
+                    state->occupied_squares[old_pos] = this;
                     current_position = old_pos;
                     has_moved --;
                 } else{
@@ -217,7 +288,7 @@ class piece
                 std::cerr << "Unable to revert to previous state (either invalid position, or that space isn't empty)." <<std::endl;
                 exit(EXIT_FAILURE);
             }
-            move_is_en_passant = false;
+            state->move_is_en_passant = false;
         }
 
         void print_allowed_moves() const
@@ -233,8 +304,8 @@ class piece
         }
         void print_threats() const
         {
-            std::cout<<"Piece: "<< abbreviation << "; Number of moves: "<<threats.at(owner).size()<<std::endl;
-            for (auto pos_iterator{threats.at(owner).begin()}; pos_iterator<threats.at(owner).end();++pos_iterator){
+            std::cout<<"Piece: "<< abbreviation << "; Number of moves: "<<state->threats.at(owner).size()<<std::endl;
+            for (auto pos_iterator{state->threats.at(owner).begin()}; pos_iterator<state->threats.at(owner).end();++pos_iterator){
                 std::cout<< *pos_iterator <<std::endl;
             }
         }      
@@ -254,6 +325,7 @@ class piece
 
         //Friend functions
         friend std::ostream & operator<<(std::ostream &os, piece p);
+        friend class position_state;
 };
 piece &piece::operator=(piece &old_piece)
 {
@@ -273,49 +345,49 @@ void piece::generate_allowed_moves()
     // First reset the allowed moves 
     allowed_moves.clear();
     //TS: std::cout<<"Generating allowed moves for: "<<color_to_char(owner)<<" "<<piece_to_char(abbreviation)<<std::endl;
-    std::vector<position>::iterator inc_begin {increments.begin()};
-    std::vector<position>::iterator inc_end {increments.end()};
-    std::vector<position>::iterator inc_it {};
+    std::vector<position>::const_iterator inc_begin {increments->begin()};
+    std::vector<position>::const_iterator inc_end {increments->end()};
+    std::vector<position>::const_iterator inc_it {};
     for (inc_it=inc_begin; inc_it<inc_end; ++inc_it){
         position move{*inc_it};
         position increment{*inc_it};
-        while ((current_position+move).is_valid() && occupied_squares.count(current_position+move)==0){
+        while ((current_position+move).is_valid() && state->occupied_squares.count(current_position+move)==0){
             allowed_moves.push_back(current_position+move);
-            destinations[current_position+move].push_back(this);
+            state->destinations[current_position+move].push_back(this);
             move = move + increment;
         }
-        if (occupied_squares.count(current_position+move)==1){
-            if (occupied_squares[current_position+move]->get_owner()!=owner){
+        if (state->occupied_squares.count(current_position+move)==1){
+            if (state->occupied_squares[current_position+move]->get_owner()!=owner){
                 allowed_moves.push_back(current_position+move);
-                destinations[current_position+move].push_back(this);
+                state->destinations[current_position+move].push_back(this);
             }
         }
     }
 }
 
-void piece::generate_threats() //Could these not be combined into one function??
+void piece::generate_threats() //Could these not be combined into one function?? They are on the compact board: see compact_board::threats
 {
-    std::vector<position>::iterator inc_begin {increments.begin()};
-    std::vector<position>::iterator inc_end {increments.end()};
-    std::vector<position>::iterator inc_it {};
+    std::vector<position>::const_iterator inc_begin {increments->begin()};
+    std::vector<position>::const_iterator inc_end {increments->end()};
+    std::vector<position>::const_iterator inc_it {};
     //TS: std::cout<<"Generating threats for "<<piece_to_char(abbreviation)<<" for player "<<owner<<std::endl;
           
     for (inc_it=inc_begin; inc_it<inc_end; ++inc_it){
         position move{*inc_it};
         position increment{*inc_it};
         //TS: std::cout<<piece_to_char(abbreviation)<<": "<<increment<<std::endl;
-        while ((current_position+move).is_valid() && occupied_squares.count(current_position+move)==0){
-            threats[owner].push_back(current_position+move);
+        while ((current_position+move).is_valid() && state->occupied_squares.count(current_position+move)==0){
+            state->threats[owner].push_back(current_position+move);
             move = move + increment;
         }
-        if (occupied_squares.count(current_position+move)==1){
-            if (occupied_squares[current_position+move]->get_owner()==owner){
-                defences[owner].push_back(current_position+move);
+        if (state->occupied_squares.count(current_position+move)==1){
+            if (state->occupied_squares[current_position+move]->get_owner()==owner){
+                state->defences[owner].push_back(current_position+move);
             } else {
-                threats[owner].push_back(current_position+move);
-                if ( (current_position+move+increment).is_valid() && occupied_squares.count(current_position+move+increment)==1){
-                    if (occupied_squares[current_position+move+increment]->get_owner()!=owner){
-                        pinners[owner].push_back( current_position + move + increment);
+                state->threats[owner].push_back(current_position+move);
+                if ( (current_position+move+increment).is_valid() && state->occupied_squares.count(current_position+move+increment)==1){
+                    if (state->occupied_squares[current_position+move+increment]->get_owner()!=owner){
+                        state->pinners[owner].push_back( current_position + move + increment);
                     }
                 }
             }
@@ -368,8 +440,8 @@ class pawn: public piece
         bool double_jumped{false};
     public:
         pawn() : piece{} {}
-        pawn(chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
-            piece{color, abbrev, start_location} 
+        pawn(position_state &board_state, chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
+            piece{board_state, color, abbrev, start_location} 
         {
             //Debug option: if starting board has a pawn starting in rank>2: set has_moved =true;
             if (owner==chess_vars::white){
@@ -399,41 +471,43 @@ class pawn: public piece
             pos_2 = position(current_position.x(),current_position.y() + 2*direction);
             
             // Check if pawn could move forward
-            if (pos_1.is_valid() && occupied_squares.count(pos_1)==0) {
+            if (pos_1.is_valid() && state->occupied_squares.count(pos_1)==0) {
                 allowed_moves.push_back(pos_1);
-                destinations[pos_1].push_back(this);            
-                if (has_moved==0 && occupied_squares.count(pos_2)==0){
+                state->destinations[pos_1].push_back(this);            
+                if (has_moved==0 && state->occupied_squares.count(pos_2)==0){
                     allowed_moves.push_back(pos_2);
-                    destinations[pos_2].push_back(this);
+                    state->destinations[pos_2].push_back(this);
                 }
             }
             // Now check if could capture neighbouring piece
             for (int d{}; d<2; d++){
                 pos_1 = position(current_position.x()-1 + 2*d, current_position.y()+direction); // Only select diagonal squares next to pawn
-                if (occupied_squares.count(pos_1) && pos_1.is_valid()){
-                    if (occupied_squares.at(pos_1)->get_owner()!=owner){
+                if (state->occupied_squares.count(pos_1) && pos_1.is_valid()){
+                    if (state->occupied_squares.at(pos_1)->get_owner()!=owner){
                         allowed_moves.push_back(pos_1);
 #ifdef DEBUGMODE
                         std::cout<<"Capture at "<<pos_1.x()<<":" << pos_1.y()<<" allowed -> added to legal moves for this pawn"<<std::endl;
 #endif
-                        destinations[pos_1].push_back(this);
+                        state->destinations[pos_1].push_back(this);
                     }
                 }        
             }
 
             // Now check if diagonal spaces are occupied
-            if (legal_en_passant){
+            if (state->legal_en_passant){
                 // Check if capture position is valid (sanity) + if more than 1 file over + if more than one rank over
-                if (!capture.is_valid() || abs(capture.x()-current_position.x())!=1 || (capture.y() != current_position.y())){
+                if (!state->capture.is_valid() || abs(state->capture.x()-current_position.x())!=1 || (state->capture.y() != current_position.y())){
                     // Error handling for incorrectly provided en-passant
                 } else {
                     int direction{1};
                     if (owner==chess_vars::black){
                         direction=-1;
                     }
-                    allowed_moves.push_back(capture + position(0,direction) );
+                    allowed_moves.push_back(state->capture + position(0,direction) );
+#ifdef DEBUGMODE
                     std::cout<<"En-passant legal -> added to legal moves for this pawn"<<std::endl;
-                    destinations[capture + position(0,direction)].push_back(this);
+#endif
+                    state->destinations[state->capture + position(0,direction)].push_back(this);
                 }
             }
             // Note: pawn promotion (i.e. converting P to another piece) will have to be handled in-game.
@@ -454,20 +528,20 @@ class pawn: public piece
             // Check if diagonal squares are in the board. If so, the pawn will threaten/defend them
             for (int d{}; d<2; d++){
                 pos = position(current_position.x()-1 + 2*d, current_position.y()+direction); // Only select diagonal squares next to pawn
-                if (occupied_squares.count(pos) && pos.is_valid()){
-                    if (occupied_squares.at(pos)->get_owner()==owner){
-                        defences[owner].push_back(pos);
+                if (state->occupied_squares.count(pos) && pos.is_valid()){
+                    if (state->occupied_squares.at(pos)->get_owner()==owner){
+                        state->defences[owner].push_back(pos);
                     } else {
-                        threats[owner].push_back(pos);
+                        state->threats[owner].push_back(pos);
                     }
                 }        
             }
             // Check for en_passant threat. TS: does the threat exist without the previous pawn move? As in, should the threat still be noted? Probably... TBD
-            if (legal_en_passant){
-                if (!capture.is_valid() || abs(capture.x()-current_position.x())!=1 || (capture.y()- direction*current_position.y())!=1){
+            if (state->legal_en_passant){
+                if (!state->capture.is_valid() || abs(state->capture.x()-current_position.x())!=1 || (state->capture.y()- direction*current_position.y())!=1){
                     // Error handling for inccorect en-passant capture
                 } else{
-                    threats[owner].push_back(capture);
+                    state->threats[owner].push_back(state->capture);
                 }
             }
         }
@@ -477,49 +551,50 @@ class knight: public piece
 {
     public:
         knight() : piece{} {}
-        knight(chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
-            piece{color, abbrev, start_location} 
+        knight(position_state &board_state, chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
+            piece{board_state, color, abbrev, start_location} 
         {
             can_jump=true;
-            increments = { position(1,2), position(1,-2), position(-1,2), position(-1,-2),
-                position(2,1), position(2,-1), position(-2,1), position(-2,-1)};
+            increments = &knight_increments;
         };
         void generate_allowed_moves()
         {
-            std::vector<position>::iterator inc_begin {increments.begin()};
-            std::vector<position>::iterator inc_end {increments.end()};
-            std::vector<position>::iterator inc_it {};
+            // First reset the allowed moves 
+            allowed_moves.clear();
+            std::vector<position>::const_iterator inc_begin {increments->begin()};
+            std::vector<position>::const_iterator inc_end {increments->end()};
+            std::vector<position>::const_iterator inc_it {};
             for (inc_it=inc_begin; inc_it<inc_end; ++inc_it){
                 position increment{*inc_it};
                 if ( (current_position+increment).is_valid()){
-                    if ( occupied_squares.count(current_position+increment)){
-                        if (occupied_squares[current_position + increment]->get_owner()==owner){
+                    if ( state->occupied_squares.count(current_position+increment)){
+                        if (state->occupied_squares[current_position + increment]->get_owner()==owner){
                             continue;
                         } else {
                             allowed_moves.push_back( current_position + increment);
-                            destinations[current_position+increment].push_back(this);
+                            state->destinations[current_position+increment].push_back(this);
                         }
                     } else{
                         allowed_moves.push_back( current_position + increment);
-                        destinations[current_position+increment].push_back(this);
+                        state->destinations[current_position+increment].push_back(this);
                     }
                 }
             }
         }
         void generate_threats()
         {
-            std::vector<position>::iterator inc_begin {increments.begin()};
-            std::vector<position>::iterator inc_end {increments.end()};
-            std::vector<position>::iterator inc_it {};
+            std::vector<position>::const_iterator inc_begin {increments->begin()};
+            std::vector<position>::const_iterator inc_end {increments->end()};
+            std::vector<position>::const_iterator inc_it {};
             for (inc_it=inc_begin; inc_it<inc_end; ++inc_it){
                 position increment{*inc_it};
                 if ( (current_position+increment).is_valid()){
-                    if (occupied_squares.count(current_position+increment)==0){
-                        threats[owner].push_back(current_position+increment);
-                    } else if (occupied_squares.at(current_position+increment)->get_owner()==owner){
-                        defences[owner].push_back(current_position+increment);
+                    if (state->occupied_squares.count(current_position+increment)==0){
+                        state->threats[owner].push_back(current_position+increment);
+                    } else if (state->occupied_squares.at(current_position+increment)->get_owner()==owner){
+                        state->defences[owner].push_back(current_position+increment);
                     } else{
-                        threats[owner].push_back(current_position+increment);
+                        state->threats[owner].push_back(current_position+increment);
                     }//TS: could keep the second if statement and append all other cases to threats
                 }
             } 
@@ -531,10 +606,10 @@ class bishop: public piece
 {
     public:
         bishop() : piece{} {}
-        bishop(chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
-            piece{color, abbrev, start_location} 
+        bishop(position_state &board_state, chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
+            piece{board_state, color, abbrev, start_location} 
         {
-            increments = {position(1,1), position(1,-1), position(-1,-1), position(-1,1)};    
+            increments = &diagonal_increments;
         }
         
 };
@@ -543,10 +618,10 @@ class rook: public piece
 {
     public:
         rook() : piece{} {}
-        rook(chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
-            piece{color, abbrev, start_location} 
+        rook(position_state &board_state, chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
+            piece{board_state, color, abbrev, start_location} 
         {
-            increments = {position(1,0), position(-1,0), position(0,1), position(0,-1)};
+            increments = &straight_increments;
         }
 
 };
@@ -556,11 +631,10 @@ class queen: public piece
     public:
         // TS: functionality should only be kept while debugging. Remove from final product
         queen() : piece{} {}
-        queen(chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
-            piece{color, abbrev, start_location} 
+        queen(position_state &board_state, chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
+            piece{board_state, color, abbrev, start_location} 
         {
-            increments = {position(1,1), position(1,-1), position(-1,-1), position(-1,1), //diagonal moves
-                position(1,0), position(-1,0), position(0,1), position(0,-1)}; // horizontal + vertical moves
+            increments = &all_increments;
         }
         
 };
@@ -574,11 +648,10 @@ class king: public piece
         chess_vars::castle legal_castle; //use enum to get the right integer: 0: no, 1: queen side, 2: king side, 3: both sides are legal
     public:
         king() : piece{} {}
-        king(chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
-            piece{color, abbrev, start_location}, is_in_check{false} 
+        king(position_state &board_state, chess_vars::player_color color, chess_vars::piece_type abbrev, position start_location) : 
+            piece{board_state, color, abbrev, start_location}, is_in_check{false}, has_castled{false}, legal_castle{chess_vars::no_castle} 
         {
-            increments = {position(1,1), position(1,-1), position(-1,-1), position(-1,1), //diagonal moves
-                position(1,0), position(-1,0), position(0,1), position(0,-1)}; // horizontal + vertical moves
+            increments = &all_increments;
         }
         void generate_allowed_moves()
         {
@@ -586,22 +659,22 @@ class king: public piece
             allowed_moves.clear();
             //TS: std::cout<<"Generating allowed moves for: "<<color_to_char(owner)<<" "<<piece_to_char(abbreviation)<<std::endl;
             
-            std::vector<position>::iterator inc_begin {increments.begin()};
-            std::vector<position>::iterator inc_end {increments.end()};
-            std::vector<position>::iterator inc_it {};
+            std::vector<position>::const_iterator inc_begin {increments->begin()};
+            std::vector<position>::const_iterator inc_end {increments->end()};
+            std::vector<position>::const_iterator inc_it {};
             for (inc_it=inc_begin; inc_it<inc_end; ++inc_it){
                 position increment{*inc_it};
                 if ( (current_position+increment).is_valid()){
-                    if ( occupied_squares.count(current_position+increment)){
-                        if (occupied_squares[current_position + increment]->get_owner()==owner){
+                    if ( state->occupied_squares.count(current_position+increment)){
+                        if (state->occupied_squares[current_position + increment]->get_owner()==owner){
                             continue;
                         } else {
                             allowed_moves.push_back( current_position + increment);
-                            destinations[current_position + increment].push_back(this);
+                            state->destinations[current_position + increment].push_back(this);
                         }
                     } else{
                         allowed_moves.push_back( current_position + increment);
-                        destinations[current_position + increment].push_back(this);
+                        state->destinations[current_position + increment].push_back(this);
                     }
                 }
             }
@@ -611,15 +684,15 @@ class king: public piece
             if (this->can_castle()>chess_vars::no_castle){
                 if (legal_castle==chess_vars::q_castle){
                     allowed_moves.push_back( position(3,current_position.y())); // Queen side
-                    destinations[position(3,current_position.y())].push_back(this);
+                    state->destinations[position(3,current_position.y())].push_back(this);
                 } else if (legal_castle==chess_vars::k_castle){
                     allowed_moves.push_back( position(7,current_position.y())); // King side
-                    destinations[position(7,current_position.y())].push_back(this);
+                    state->destinations[position(7,current_position.y())].push_back(this);
                 } else {
                     allowed_moves.push_back( position(3,current_position.y())); // Queen side
                     allowed_moves.push_back( position(7,current_position.y())); // King side
-                    destinations[position(3,current_position.y())].push_back(this);
-                    destinations[position(7,current_position.y())].push_back(this);
+                    state->destinations[position(3,current_position.y())].push_back(this);
+                    state->destinations[position(7,current_position.y())].push_back(this);
 
                 }
             }
@@ -635,19 +708,19 @@ class king: public piece
         }
         void generate_threats()
         {
-            std::vector<position>::iterator inc_begin {increments.begin()};
-            std::vector<position>::iterator inc_end {increments.end()};
-            std::vector<position>::iterator inc_it {};
+            std::vector<position>::const_iterator inc_begin {increments->begin()};
+            std::vector<position>::const_iterator inc_end {increments->end()};
+            std::vector<position>::const_iterator inc_it {};
             
             for (inc_it=inc_begin; inc_it<inc_end; ++inc_it){
                 position increment{*inc_it};
                 if ( (current_position+increment).is_valid()){
-                    if (occupied_squares.count(current_position+increment)==0){
-                        threats[owner].push_back(current_position+increment);
-                    } else if (occupied_squares.at(current_position+increment)->get_owner()==owner){
-                        defences[owner].push_back(current_position+increment);
+                    if (state->occupied_squares.count(current_position+increment)==0){
+                        state->threats[owner].push_back(current_position+increment);
+                    } else if (state->occupied_squares.at(current_position+increment)->get_owner()==owner){
+                        state->defences[owner].push_back(current_position+increment);
                     } else{
-                        threats[owner].push_back(current_position+increment);
+                        state->threats[owner].push_back(current_position+increment);
                     }//TS: could keep the second if statement and append all other cases to threats
                 }
             } 
@@ -677,18 +750,18 @@ class king: public piece
             bool test_1, test_2, test_3, test_4, test_5, test_6;
             bool space_1, space_2, space_3, threat_1, threat_2;
             // King side
-            if (occupied_squares.count(position(5,back_rank)) && occupied_squares.count(position(8,back_rank))){
-                test_1 = occupied_squares.at(position(5,back_rank))->get_owner()==owner;
-                test_2 = occupied_squares.at(position(5,back_rank))->get_abbrev()==chess_vars::king;
-                test_3 = occupied_squares.at(position(5,back_rank))->check_if_moved()==false;
-                test_4 = occupied_squares.at(position(8,back_rank))->get_owner()==owner;
-                test_5 = occupied_squares.at(position(8,back_rank))->get_abbrev()==chess_vars::rook;
-                test_6 = occupied_squares.at(position(8,back_rank))->check_if_moved()==false;
+            if (state->occupied_squares.count(position(5,back_rank)) && state->occupied_squares.count(position(8,back_rank))){
+                test_1 = state->occupied_squares.at(position(5,back_rank))->get_owner()==owner;
+                test_2 = state->occupied_squares.at(position(5,back_rank))->get_abbrev()==chess_vars::king;
+                test_3 = state->occupied_squares.at(position(5,back_rank))->check_if_moved()==false;
+                test_4 = state->occupied_squares.at(position(8,back_rank))->get_owner()==owner;
+                test_5 = state->occupied_squares.at(position(8,back_rank))->get_abbrev()==chess_vars::rook;
+                test_6 = state->occupied_squares.at(position(8,back_rank))->check_if_moved()==false;
                 // Now check empty spaces and threatened spaces
-                space_1 = occupied_squares.count(position(6, back_rank))==0;
-                space_2 = occupied_squares.count(position(7, back_rank))==0;    
-                threat_1 = is_in(threats[opponent], position(6, back_rank));
-                threat_2 = is_in(threats[opponent], position(7, back_rank));
+                space_1 = state->occupied_squares.count(position(6, back_rank))==0;
+                space_2 = state->occupied_squares.count(position(7, back_rank))==0;    
+                threat_1 = is_in(state->threats[opponent], position(6, back_rank));
+                threat_2 = is_in(state->threats[opponent], position(7, back_rank));
 
                 if ( ! (test_1 && test_2 && test_3 && test_4 && test_5 && test_6 )){
                     k_side_legal = false;
@@ -708,19 +781,19 @@ class king: public piece
             }
 
             // Queen side
-            if (occupied_squares.count(position(5,back_rank)) && occupied_squares.count(position(8,back_rank))){
-                test_1 = occupied_squares.at(position(5,back_rank))->get_owner()==owner;
-                test_2 = occupied_squares.at(position(5,back_rank))->get_abbrev()==chess_vars::king;
-                test_3 = occupied_squares.at(position(5,back_rank))->check_if_moved()==false;
-                test_4 = occupied_squares.at(position(1,back_rank))->get_owner()==owner;
-                test_5 = occupied_squares.at(position(1,back_rank))->get_abbrev()==chess_vars::rook;
-                test_6 = occupied_squares.at(position(1,back_rank))->check_if_moved()==false;
+            if (state->occupied_squares.count(position(5,back_rank)) && state->occupied_squares.count(position(1,back_rank))){
+                test_1 = state->occupied_squares.at(position(5,back_rank))->get_owner()==owner;
+                test_2 = state->occupied_squares.at(position(5,back_rank))->get_abbrev()==chess_vars::king;
+                test_3 = state->occupied_squares.at(position(5,back_rank))->check_if_moved()==false;
+                test_4 = state->occupied_squares.at(position(1,back_rank))->get_owner()==owner;
+                test_5 = state->occupied_squares.at(position(1,back_rank))->get_abbrev()==chess_vars::rook;
+                test_6 = state->occupied_squares.at(position(1,back_rank))->check_if_moved()==false;
                 // Now check empty spaces and threatened spaces
-                space_1 = occupied_squares.count(position(2, back_rank))==0;
-                space_2 = occupied_squares.count(position(3, back_rank))==0;    
-                space_3 = occupied_squares.count(position(4, back_rank))==0;    
-                threat_1 = is_in(threats[opponent], position(3, back_rank));
-                threat_2 = is_in(threats[opponent], position(4, back_rank));
+                space_1 = state->occupied_squares.count(position(2, back_rank))==0;
+                space_2 = state->occupied_squares.count(position(3, back_rank))==0;    
+                space_3 = state->occupied_squares.count(position(4, back_rank))==0;    
+                threat_1 = is_in(state->threats[opponent], position(3, back_rank));
+                threat_2 = is_in(state->threats[opponent], position(4, back_rank));
 
                 if ( ! (test_1 && test_2 && test_3 && test_4 && test_5 && test_6 )){
                     q_side_legal = false;
@@ -770,7 +843,7 @@ class king: public piece
             } else {
                 opponent = chess_vars::white;
             }
-            if ( is_in(threats[opponent], position_to_check) ){
+            if ( is_in(state->threats[opponent], position_to_check) ){
                 return true; 
             } else {
                 return false;
@@ -790,10 +863,10 @@ class king: public piece
             for ( auto it{ straights.begin()}; it < straights.end(); ++it){
                 position line_of_sight {current_position + (*it)};
                 while (line_of_sight.is_valid()){
-                    if (occupied_squares.count(line_of_sight)){
-                        test_opponent = occupied_squares.at(line_of_sight)->get_owner()!=owner;
-                        test_rook = occupied_squares.at(line_of_sight)->get_abbrev()==chess_vars::rook;
-                        test_queen = occupied_squares.at(line_of_sight)->get_abbrev()==chess_vars::queen;
+                    if (state->occupied_squares.count(line_of_sight)){
+                        test_opponent = state->occupied_squares.at(line_of_sight)->get_owner()!=owner;
+                        test_rook = state->occupied_squares.at(line_of_sight)->get_abbrev()==chess_vars::rook;
+                        test_queen = state->occupied_squares.at(line_of_sight)->get_abbrev()==chess_vars::queen;
                         if (test_opponent && (test_rook || test_queen)){
                             return true;                            
                         }
@@ -806,10 +879,10 @@ class king: public piece
             for ( auto it{ diagonals.begin()}; it < diagonals.end(); ++it){
                 position line_of_sight {current_position + (*it)};
                 while (line_of_sight.is_valid()){
-                    if (occupied_squares.count(line_of_sight)){
-                        test_opponent = occupied_squares.at(line_of_sight)->get_owner()!=owner;
-                        test_bishop = occupied_squares.at(line_of_sight)->get_abbrev()==chess_vars::bishop;
-                        test_queen = occupied_squares.at(line_of_sight)->get_abbrev()==chess_vars::queen;
+                    if (state->occupied_squares.count(line_of_sight)){
+                        test_opponent = state->occupied_squares.at(line_of_sight)->get_owner()!=owner;
+                        test_bishop = state->occupied_squares.at(line_of_sight)->get_abbrev()==chess_vars::bishop;
+                        test_queen = state->occupied_squares.at(line_of_sight)->get_abbrev()==chess_vars::queen;
                         if (test_opponent && (test_bishop || test_queen)){
                             return true;                            
                         }
@@ -827,8 +900,8 @@ class king: public piece
             std::vector<position> knight_threats  { position(1,2), position(1,-2), position(-1,2), position(-1,-2),
                 position(2,1), position(2,-1), position(-2,1), position(-2,-1)};
             for ( auto pos_it=knight_threats.begin(); pos_it<knight_threats.end(); ++pos_it){
-                if (occupied_squares.count(current_position + (*pos_it))){
-                    if ( occupied_squares.at(current_position + (*pos_it))->get_owner()!=owner && occupied_squares.at(current_position + (*pos_it))->get_abbrev()==chess_vars::knight){
+                if (state->occupied_squares.count(current_position + (*pos_it))){
+                    if ( state->occupied_squares.at(current_position + (*pos_it))->get_owner()!=owner && state->occupied_squares.at(current_position + (*pos_it))->get_abbrev()==chess_vars::knight){
                         return true;
                     }
                 }
@@ -841,8 +914,8 @@ class king: public piece
             position pawn_pos;
             for (int diag{}; diag<2; diag++){
                 pawn_pos.set( current_position.x()-1 + 2*diag, current_position.y()+direction);
-                if (occupied_squares.count(pawn_pos) && pawn_pos.is_valid()){
-                    if (occupied_squares.at(pawn_pos)->get_owner()!=owner && occupied_squares.at(pawn_pos)->get_abbrev()==chess_vars::pawn ){
+                if (state->occupied_squares.count(pawn_pos) && pawn_pos.is_valid()){
+                    if (state->occupied_squares.at(pawn_pos)->get_owner()!=owner && state->occupied_squares.at(pawn_pos)->get_abbrev()==chess_vars::pawn ){
                         return true;
                     }
                 }
@@ -861,7 +934,7 @@ class king: public piece
             bool allowed_moves_available {false};
             bool legal_moves_available {false};
             // Check first if allowed moves available
-            for (std::map<position, piece*>::iterator iter= occupied_squares.begin(); iter!= occupied_squares.end(); ++iter){
+            for (std::map<position, piece*>::iterator iter= state->occupied_squares.begin(); iter!= state->occupied_squares.end(); ++iter){
                 piece* temp {iter->second};
                 if ( temp->get_owner()==owner && temp->get_number_of_moves()>0){                    
                     allowed_moves_available = true;
@@ -882,7 +955,9 @@ class king: public piece
 
             position old_position;
             std::pair<bool, piece*> captured_piece_state;
-            for (std::map<position, piece*>::iterator iter= occupied_squares.begin(); iter!= occupied_squares.end(); ++iter){
+            // Trying a move erases and inserts squares of occupied_squares: loop over a copy of the map
+            std::map<position, piece*> pieces_to_test {state->occupied_squares};
+            for (std::map<position, piece*>::iterator iter= pieces_to_test.begin(); iter!= pieces_to_test.end(); ++iter){
                 //TS: std::cout<<"\t-> Pos: "<<(iter->first)<<std::endl;
                 if (!iter->first.is_valid()){
                     std::cerr<<"WARNING: skipping a piece in a non-valid position at "<<(iter->first)<<std::endl;    
@@ -895,8 +970,8 @@ class king: public piece
                         old_position = temp->location();
                         //TS: std::cout<<"\t\t--> Entered test loop"<<std::endl;
                         for (auto move_it = temp->get_allowed_iterators().first; move_it<temp->get_allowed_iterators().second; ++move_it){
-                            if ( occupied_squares.count(*move_it) ){
-                                if (occupied_squares.at(*move_it)->get_owner()==owner){
+                            if ( state->occupied_squares.count(*move_it) ){
+                                if (state->occupied_squares.at(*move_it)->get_owner()==owner){
                                     continue;
                                 }
                             }
@@ -72,8 +72,9 @@ std::ostream & operator<<(std::ostream &os, position pos)
     return os;            
 }
 // Require overload of operator< when using position as a key in a map. 
+// Rank first, then file: squares off the board (e.g. x=0 or x=9) must not compare equal to squares on it.
 bool operator<(const position &p1, const position &p2)
 {
-    return p1.x() + 8*p1.y() < p2.x() + 8*p2.y();
+    return p1.y() < p2.y() || (p1.y()==p2.y() && p1.x() < p2.x());
 }
 
@@ -0,0 +1,204 @@
+// Position sets, part of the C++ Chess Project.
+
+#include <fstream>
+#include <algorithm>
+
+#include "position_set.h"
+#include "game_archive.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+bool pack_position(const compact_board &board, archive_result result, uint8_t *out)
+{
+    std::fill(out, out + packed_position_size, uint8_t{0});
+    uint64_t occupied{};
+    int pieces{};
+    for (int sq{}; sq<64; sq++){
+        uint8_t code {board.at(sq)};
+        if (code==no_piece) continue;
+        if (pieces==32) return false;
+        occupied |= uint64_t{1} << sq;
+        out[8 + pieces/2] |= static_cast<uint8_t>(pieces%2==0 ? code << 4 : code);
+        pieces++;
+    }
+    for (int b{}; b<8; b++){
+        out[b] = static_cast<uint8_t>(occupied >> (56 - 8*b));
+    }
+    out[24] = static_cast<uint8_t>((board.side_to_move()==chess_vars::white ? 0x80 : 0) | board.castling_rights());
+    out[25] = board.en_passant_square()<0 ? 0xFF : static_cast<uint8_t>(board.en_passant_square());
+    out[26] = static_cast<uint8_t>(board.halfmoves());
+    out[27] = static_cast<uint8_t>(board.fullmoves() >> 8);
+    out[28] = static_cast<uint8_t>(board.fullmoves() & 0xFF);
+    out[29] = static_cast<uint8_t>(result);
+    return true;
+}
+
+bool unpack_position(const uint8_t *in, compact_board &board, archive_result &result)
+{
+    board = compact_board();
+    uint64_t occupied {read_be64(in)};
+    const uint8_t *codes {in + 8};
+    for (int n{}; occupied!=0; n++, occupied &= occupied - 1){
+        if (n==32) return false;
+        uint8_t code {static_cast<uint8_t>((codes[n/2] >> (n%2==0 ? 4 : 0)) & 0x0F)};
+        // Unsigned: type bits of 0 wrap around
+        if (static_cast<unsigned>((code & 7) - 1)>chess_vars::king) return false;
+        board.set(lowest_square(occupied), code);
+    }
+    // The same pieces as from_fen accepts: the move generators rely on them
+    if (!board.playable_pieces() || (in[25]>63 && in[25]!=0xFF)) return false;
+    board.set_side_to_move(in[24] & 0x80 ? chess_vars::white : chess_vars::black);
+    board.set_castling_rights(in[24] & 0x0F);
+    // Rights without their king and rook, or an en-passant square without a pawn to take, could only come from a
+    // damaged record: the moves generated from them would move pieces which are not there
+    if (board.possible_castling()!=board.castling_rights() || (in[25]!=0xFF && !board.possible_en_passant(in[25]))) return false;
+    board.set_en_passant_square(in[25]==0xFF ? -1 : in[25]);
+    board.set_halfmoves(in[26]);
+    board.set_fullmoves(std::max(read_be16(in + 27), uint16_t{1}));
+    result = static_cast<archive_result>(std::min<uint8_t>(in[29], archive_draw));
+    return true;
+}
+
+bool read_epd(std::string_view line, compact_board &board, archive_result &result)
+{
+    result = archive_unknown;
+    if (!compact_board::from_fen(line, board)) return false;
+
+    // Operations (opcode operand;) follow the four fields of the position. A full FEN keeps the clocks read by from_fen.
+    for (int field{}; field<4; field++) next_fen_field(line);
+    auto read_number = [](std::string_view digits){
+        int value{};
+        for (char c : digits){
+            if (c<'0' || c>'9') return -1;
+            value = std::min(value*10 + (c - '0'), 65535);
+        }
+        return digits.empty() ? -1 : value;
+    };
+    while (!line.empty()){
+        size_t end {std::min(line.find(';'), line.size())};
+        std::string_view operation {line.substr(0, end)};
+        line.remove_prefix(std::min(end + 1, line.size()));
+        std::string_view opcode {next_fen_field(operation)}, operand {next_fen_field(operation)};
+        if (opcode=="hmvc" && read_number(operand)>=0){
+            board.set_halfmoves(std::min(read_number(operand), 255));
+        } else if (opcode=="fmvn" && read_number(operand)>0){
+            board.set_fullmoves(read_number(operand));
+        } else if (opcode=="c9" && operand.size()>=2 && operand.front()=='"' && operand.back()=='"'){
+            result = result_code(operand.substr(1, operand.size() - 2));
+        }
+    }
+    return true;
+}
+
+bool position_set::load(std::string path)
+{
+    mapped_file file;
+    if (!file.open(path)){
+        std::cerr<<"WARNING: could not open "<<path<<std::endl;
+        return false;
+    }
+    if (file.size()>=position_header_size && std::equal(position_magic, position_magic+4, reinterpret_cast<const char*>(file.data()))){
+        return load_packed(file, path);
+    }
+    load_epd(std::string_view {reinterpret_cast<const char*>(file.data()), file.size()});
+    return true;
+}
+
+// Records are unpacked straight from the mapping into boards reserved once for the whole file
+bool position_set::load_packed(const mapped_file &file, const std::string &path)
+{
+    if (read_be32(file.data()+4)!=position_version){
+        std::cerr<<"WARNING: "<<path<<" is a packed position file of an unknown version"<<std::endl;
+        return false;
+    }
+    size_t count {static_cast<size_t>(std::min<uint64_t>(read_be64(file.data()+8), (file.size() - position_header_size)/packed_position_size))};
+    boards.reserve(boards.size() + count);
+    results.reserve(results.size() + count);
+    const uint8_t *record {file.data() + position_header_size};
+    archive_result result;
+    for (size_t n{}; n<count; n++, record += packed_position_size){
+        boards.emplace_back();
+        if (unpack_position(record, boards.back(), result)){
+            results.push_back(result);
+        } else {
+            boards.pop_back();
+            lines_skipped++;
+        }
+    }
+    return true;
+}
+
+// One position per line; blank lines and lines starting with # are not counted as skipped
+void position_set::load_epd(std::string_view text)
+{
+    std::vector<size_t> bounds {0};
+    for (unsigned t{1}; t<thread_count; t++){
+        bounds.push_back(std::max(bounds.back(), next_game_start(text, text.size()*t/thread_count, true)));
+    }
+    bounds.push_back(text.size());
+
+    std::vector<std::vector<compact_board>> worker_boards(thread_count);
+    std::vector<std::vector<archive_result>> worker_results(thread_count);
+    std::vector<size_t> worker_skipped(thread_count);
+    std::vector<std::thread> workers;
+    for (unsigned t{}; t<thread_count; t++){
+        workers.emplace_back([&, t]{
+            std::string_view part {text.substr(bounds[t], bounds[t+1] - bounds[t])};
+            compact_board board;
+            archive_result result;
+            while (!part.empty()){
+                size_t end {std::min(part.find('\n'), part.size())};
+                std::string_view line {part.substr(0, end)};
+                part.remove_prefix(std::min(end + 1, part.size()));
+                size_t first_char {line.find_first_not_of(" \t\r")};
+                if (first_char==std::string_view::npos || line[first_char]=='#') continue;
+                if (read_epd(line, board, result)){
+                    worker_boards[t].push_back(board);
+                    worker_results[t].push_back(result);
+                } else {
+                    worker_skipped[t]++;
+                }
+            }
+        });
+    }
+    for (auto &worker : workers) worker.join();
+
+    for (unsigned t{}; t<thread_count; t++){
+        boards.insert(boards.end(), worker_boards[t].begin(), worker_boards[t].end());
+        results.insert(results.end(), worker_results[t].begin(), worker_results[t].end());
+        lines_skipped += worker_skipped[t];
+    }
+}
+
+bool position_set::write_packed(std::string path) const
+{
+    std::ofstream packed_file(path, std::ios::binary);
+    if (!packed_file.is_open()){
+        std::cerr<<"WARNING: could not create "<<path<<std::endl;
+        return false;
+    }
+    // The number of positions is written once the records are
+    std::string header;
+    header.assign(position_magic, 4);
+    archive_put(header, position_version, 4);
+    archive_put(header, 0, 8);
+    packed_file.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+    uint8_t record[packed_position_size];
+    uint64_t written{};
+    for (size_t n{}; n<boards.size(); n++){
+        if (!pack_position(boards[n], results[n], record)){
+            std::cerr<<"WARNING: position "<<n+1<<" has more than 32 pieces: left out"<<std::endl;
+            continue;
+        }
+        packed_file.write(reinterpret_cast<const char*>(record), packed_position_size);
+        written++;
+    }
+    header.clear();
+    archive_put(header, written, 8);
+    packed_file.seekp(8);
+    packed_file.write(header.data(), static_cast<std::streamsize>(header.size()));
+    return packed_file.good();
+}
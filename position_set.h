@@ -0,0 +1,78 @@
+// Position sets, part of the C++ Chess Project.
+// Large sets of positions (engine tests, tuning data) are loaded straight into compact_board instances:
+// - packed files hold one 32-byte record per position and are read from a mapped file without any parsing
+// - EPD files (or FEN, one position per line) are split between threads at line boundaries
+// Packed record (big-endian, like the other binary files):
+// - occupancy bitboard (8), bit n for square n (a1=0, h8=63)
+// - piece codes (16): 4 bits each (see piece_code), high nibble first, in the order of the occupied squares
+// - side to move (bit 7) and castling rights (bits 0-3), en passant square (0xFF if none), halfmove clock
+// - fullmove number (2), result (1, see archive_result), 2 bytes left at zero
+// Packed file: magic "CPOS", version, number of positions (8), then the records.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+
+#include "compact_board.h"
+#include "mapped_file.h"
+#include "game_archive.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+const char position_magic[4] {'C', 'P', 'O', 'S'};
+const uint32_t position_version {1};
+const size_t position_header_size {16};
+const size_t packed_position_size {32};
+
+// Returns false if the board has more than 32 pieces, which leaves no room for their codes
+bool pack_position(const compact_board &board, archive_result result, uint8_t *out);
+// Returns false if the record is not a position: piece codes out of range, or not one king per side
+bool unpack_position(const uint8_t *in, compact_board &board, archive_result &result);
+
+// One EPD line: the first four fields of a FEN, then operations (hmvc, fmvn and the result in c9 are read).
+// A full FEN is read as well.
+bool read_epd(std::string_view line, compact_board &board, archive_result &result);
+
+class position_set
+{
+    private:
+        std::vector<compact_board> boards;
+        std::vector<archive_result> results;
+        size_t lines_skipped{0};
+        unsigned thread_count{1};
+
+        bool load_packed(const mapped_file &file, const std::string &path);
+        void load_epd(std::string_view text);
+    public:
+        position_set(unsigned threads=std::thread::hardware_concurrency()) : thread_count{threads>0 ? threads : 1} {}
+
+        // Adds the positions of a packed file (recognised by its magic) or of an EPD file
+        bool load(std::string path);
+        bool write_packed(std::string path) const;
+
+        size_t size() const
+        {
+            return boards.size();
+        }
+        size_t skipped() const
+        {
+            return lines_skipped;
+        }
+        const compact_board &operator[](size_t n) const
+        {
+            return boards[n];
+        }
+        archive_result result(size_t n) const
+        {
+            return results[n];
+        }
+        void clear()
+        {
+            boards.clear();
+            results.clear();
+            lines_skipped = 0;
+        }
+};
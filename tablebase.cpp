@@ -0,0 +1,911 @@
+// Syzygy tablebase probing, part of the C++ Chess Project.
+// The file format and the position indexing follow the description of the Syzygy tablebases:
+// - each file holds one or more sub-tables (per side to move and, with pawns, per file of the leading pawn)
+// - a position is mapped to an index using the symmetries of the board
+// - values are compressed with recursive pairing + canonical Huffman codes, in blocks
+
+#include <algorithm>
+#include <filesystem>
+
+#include "tablebase.h"
+#include "compact_board.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+// Magic numbers at the start of the files
+const uint8_t wdl_magic[4] {0x71, 0xE8, 0x23, 0x5D};
+const uint8_t dtz_magic[4] {0xD7, 0x66, 0x0C, 0xA5};
+
+// Rank of a win the fifty-move rule can't spoil (negated for a sure loss). Above any DTZ plus fifty-move counter, which
+// in 7-piece tables passes 1000, so that cursed wins stay above draws and blessed losses below them.
+const int tb_max_dtz {1 << 18};
+
+// Flags of a sub-table
+const uint8_t tb_flag_stm {1}, tb_flag_mapped {2}, tb_flag_win_plies {4}, tb_flag_loss_plies {8}, tb_flag_wide {16}, tb_flag_single_value {128};
+
+// Symbols of the recursive pairing are stored as two 12-bit children
+int btree_left(const uint8_t *btree, int sym)
+{
+    const uint8_t *lr {btree + 3*sym};
+    return ((lr[1] & 0xF) << 8) | lr[0];
+}
+int btree_right(const uint8_t *btree, int sym)
+{
+    const uint8_t *lr {btree + 3*sym};
+    return (lr[2] << 4) | (lr[1] >> 4);
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Indexing tables %%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+// Pieces inside the files use their own numbering: P=1, N=2, B=3, R=4, Q=5, K=6, plus 8 for black
+int tb_piece(uint8_t code)
+{
+    int type{};
+    switch (code_type(code))
+    {
+    case chess_vars::pawn:   type = 1; break;
+    case chess_vars::knight: type = 2; break;
+    case chess_vars::bishop: type = 3; break;
+    case chess_vars::rook:   type = 4; break;
+    case chess_vars::queen:  type = 5; break;
+    case chess_vars::king:   type = 6; break;
+    default: break;
+    }
+    return code_color(code)==chess_vars::black ? type + 8 : type;
+}
+
+// Distance from the a1-h8 diagonal: negative below, positive above
+int off_diagonal(int square)
+{
+    return square/8 - square%8;
+}
+
+struct tb_index_tables
+{
+    uint64_t binomial[7][64]{};      // binomial[k][n]: ways to choose k squares out of n
+    int map_pawns[64]{};             // Squares a2-h7 mapped to 0..47, highest for the leading pawn
+    int lead_pawn_idx[7][64]{};
+    int lead_pawns_size[7][4]{};
+    int map_b1h1h7[64]{};            // Squares below the a1-h8 diagonal mapped to 0..27
+    int map_a1d1d4[64]{};            // Squares of the a1-d1-d4 triangle mapped to 0..9
+    int map_kk[10][64]{};            // The 462 placements of two kings
+
+    tb_index_tables()
+    {
+        int code{};
+        for (int s{}; s<64; s++){
+            if (off_diagonal(s)<0) map_b1h1h7[s] = code++;
+        }
+
+        // Triangle, with the diagonal squares last
+        std::vector<int> diagonal;
+        code = 0;
+        for (int s : {0, 1, 2, 3, 9, 10, 11, 18, 19, 27}){
+            if (off_diagonal(s)<0){
+                map_a1d1d4[s] = code++;
+            } else if (off_diagonal(s)==0){
+                diagonal.push_back(s);
+            }
+        }
+        for (int s : diagonal){
+            map_a1d1d4[s] = code++;
+        }
+
+        // Two kings: first one in the triangle. If it is on the diagonal, the second one is not above it.
+        std::vector<std::pair<int,int>> both_on_diagonal;
+        code = 0;
+        for (int idx{}; idx<10; idx++){
+            for (int s1{}; s1<=27; s1++){
+                if (map_a1d1d4[s1]!=idx || (idx==0 && s1!=1)) continue; // b1 is mapped to 0
+                for (int s2{}; s2<64; s2++){
+                    if (abs(s1%8 - s2%8)<=1 && abs(s1/8 - s2/8)<=1){
+                        continue; // Kings on the same or neighbouring squares
+                    } else if (off_diagonal(s1)==0 && off_diagonal(s2)>0){
+                        continue;
+                    } else if (off_diagonal(s1)==0 && off_diagonal(s2)==0){
+                        both_on_diagonal.push_back(std::make_pair(idx, s2));
+                    } else {
+                        map_kk[idx][s2] = code++;
+                    }
+                }
+            }
+        }
+        for (auto &p : both_on_diagonal){
+            map_kk[p.first][p.second] = code++;
+        }
+
+        binomial[0][0] = 1;
+        for (int n{1}; n<64; n++){
+            for (int k{}; k<7 && k<=n; k++){
+                binomial[k][n] = (k>0 ? binomial[k-1][n-1] : 0) + (k<n ? binomial[k][n-1] : 0);
+            }
+        }
+
+        // Leading pawns: files a-d, ranks 2-7
+        int available {47};
+        for (int lead_count{1}; lead_count<=5; lead_count++){
+            for (int f{}; f<4; f++){
+                int idx{};
+                for (int r{1}; r<=6; r++){
+                    int sq {f + 8*r};
+                    if (lead_count==1){
+                        map_pawns[sq] = available--;
+                        map_pawns[sq ^ 7] = available--;
+                    }
+                    lead_pawn_idx[lead_count][sq] = idx;
+                    idx += binomial[lead_count-1][map_pawns[sq]];
+                }
+                lead_pawns_size[lead_count][f] = idx;
+            }
+        }
+    }
+};
+
+const tb_index_tables &index_tables()
+{
+    static const tb_index_tables tables;
+    return tables;
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Table setup %%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+// Material code of one side, e.g. "KRP", in the order used by the file names
+std::string material_string(const compact_board &board, chess_vars::player_color color)
+{
+    std::string text {"K"};
+    const chess_vars::piece_type order[5] {chess_vars::queen, chess_vars::rook, chess_vars::bishop, chess_vars::knight, chess_vars::pawn};
+    for (auto type : order){
+        text += std::string(board.count(color, type), piece_to_char(type));
+    }
+    return text;
+}
+
+// Fill the table description from its material code
+void describe_table(tb_table &table, const std::string &code, bool dtz)
+{
+    table.code = code;
+    table.is_dtz = dtz;
+    size_t split {code.find('v')};
+    std::string strong {code.substr(0, split)}, weak {code.substr(split+1)};
+    table.symmetric = (strong==weak);
+    table.piece_count = static_cast<int>(strong.size() + weak.size());
+
+    int pawns[2] { static_cast<int>(std::count(strong.begin(), strong.end(), 'P')), static_cast<int>(std::count(weak.begin(), weak.end(), 'P')) };
+    table.has_pawns = pawns[0]+pawns[1]>0;
+    table.has_unique_pieces = false;
+    for (const std::string &side : {strong, weak}){
+        for (char c : std::string("QRBNP")){
+            if (std::count(side.begin(), side.end(), c)==1) table.has_unique_pieces = true;
+        }
+    }
+    // Leading color: the side with fewer pawns, provided it has some
+    bool strong_leads { pawns[1]==0 || (pawns[0]>0 && pawns[1]>=pawns[0]) };
+    table.pawn_count[0] = strong_leads ? pawns[0] : pawns[1];
+    table.pawn_count[1] = strong_leads ? pawns[1] : pawns[0];
+}
+
+// Split the pieces in groups and compute the size of each group's index
+void set_groups(tb_table &table, tb_pairs &d, int order[2], int file)
+{
+    const tb_index_tables &t {index_tables()};
+    int n{};
+    int first_len { table.has_pawns ? 0 : (table.has_unique_pieces ? 3 : 2) };
+    d.group_len[n] = 1;
+    for (int i{1}; i<table.piece_count; i++){
+        if (--first_len>0 || d.pieces[i]==d.pieces[i-1]){
+            d.group_len[n]++;
+        } else {
+            d.group_len[++n] = 1;
+        }
+    }
+    d.group_len[++n] = 0;
+
+    bool pp { table.has_pawns && table.pawn_count[1]>0 };
+    int next { pp ? 2 : 1 };
+    int free_squares { 64 - d.group_len[0] - (pp ? d.group_len[1] : 0) };
+    uint64_t idx {1};
+
+    for (int k{}; next<n || k==order[0] || k==order[1]; k++){
+        if (k==order[0]){ // Leading pawns or pieces
+            d.group_idx[0] = idx;
+            idx *= table.has_pawns ? t.lead_pawns_size[d.group_len[0]][file] : (table.has_unique_pieces ? 31332 : 462);
+        } else if (k==order[1]){ // Remaining pawns
+            d.group_idx[1] = idx;
+            idx *= t.binomial[d.group_len[1]][48 - d.group_len[0]];
+        } else { // Remaining pieces
+            d.group_idx[next] = idx;
+            idx *= t.binomial[d.group_len[next]][free_squares];
+            free_squares -= d.group_len[next++];
+        }
+    }
+    d.group_idx[n] = idx;
+}
+
+int set_symlen(tb_pairs &d, int sym, std::vector<bool> &visited)
+{
+    visited[sym] = true;
+    int right {btree_right(d.btree, sym)};
+    if (right==0xFFF){
+        return 0;
+    }
+    int left {btree_left(d.btree, sym)};
+    if (!visited[left]) d.symlen[left] = static_cast<uint8_t>(set_symlen(d, left, visited));
+    if (!visited[right]) d.symlen[right] = static_cast<uint8_t>(set_symlen(d, right, visited));
+    return d.symlen[left] + d.symlen[right] + 1;
+}
+
+// Read the block layout and the Huffman code of a sub-table
+const uint8_t *set_sizes(tb_pairs &d, const uint8_t *data)
+{
+    d.flags = *data++;
+    if (d.flags & tb_flag_single_value){
+        d.num_blocks = 0;
+        d.span = 0;
+        d.block_length_size = 0;
+        d.sparse_index_size = 0;
+        d.min_sym_len = *data++; // The single value
+        return data;
+    }
+
+    int groups{};
+    while (d.group_len[groups]!=0) groups++;
+    uint64_t table_size {d.group_idx[groups]};
+
+    d.block_size = static_cast<size_t>(1) << *data++;
+    d.span = static_cast<size_t>(1) << *data++;
+    d.sparse_index_size = static_cast<size_t>((table_size + d.span - 1) / d.span);
+    uint8_t padding {*data++};
+    d.num_blocks = read_le32(data);
+    data += 4;
+    d.block_length_size = d.num_blocks + padding;
+    d.max_sym_len = *data++;
+    d.min_sym_len = *data++;
+    d.lowest_sym = data;
+
+    // Canonical Huffman: base64[l] is the lowest code of length (l + min_sym_len), left-aligned on 64 bits
+    d.base64.assign(d.max_sym_len - d.min_sym_len + 1, 0);
+    for (int i {static_cast<int>(d.base64.size()) - 2}; i>=0; i--){
+        d.base64[i] = (d.base64[i+1] + read_le16(d.lowest_sym + 2*i) - read_le16(d.lowest_sym + 2*(i+1))) / 2;
+    }
+    for (size_t i{}; i<d.base64.size(); i++){
+        d.base64[i] <<= 64 - i - d.min_sym_len;
+    }
+    data += d.base64.size() * 2;
+
+    d.symlen.assign(read_le16(data), 0);
+    data += 2;
+    d.btree = data;
+    std::vector<bool> visited(d.symlen.size());
+    for (size_t sym{}; sym<d.symlen.size(); sym++){
+        if (!visited[sym]) d.symlen[sym] = static_cast<uint8_t>(set_symlen(d, static_cast<int>(sym), visited));
+    }
+    return data + d.symlen.size()*3 + (d.symlen.size() & 1);
+}
+
+// DTZ files map the stored values to distances, separately for each WDL outcome
+const uint8_t *set_dtz_map(tb_table &table, const uint8_t *data, const uint8_t *base, int max_file)
+{
+    table.dtz_map = data;
+    for (int f{}; f<=max_file; f++){
+        tb_pairs *d {table.get(0, f)};
+        if (!(d->flags & tb_flag_mapped)) continue;
+        if (d->flags & tb_flag_wide){
+            data += (data - base) & 1;
+            for (int i{}; i<4; i++){
+                d->map_idx[i] = static_cast<uint16_t>((data - table.dtz_map)/2 + 1);
+                data += 2*read_le16(data) + 2;
+            }
+        } else {
+            for (int i{}; i<4; i++){
+                d->map_idx[i] = static_cast<uint16_t>(data - table.dtz_map + 1);
+                data += *data + 1;
+            }
+        }
+    }
+    return data + ((data - base) & 1);
+}
+
+// Map the file of a table and read its headers
+bool tablebase::map_table(tb_table &table)
+{
+    if (table.mapped) return true;
+    if (table.missing) return false;
+
+    const char *extension { table.is_dtz ? ".rtbz" : ".rtbw" };
+    for (const std::string &dir : directories){
+        if (table.file.open(dir + "/" + table.code + extension)) break;
+    }
+    const uint8_t *magic { table.is_dtz ? dtz_magic : wdl_magic };
+    if (!table.file.is_open() || table.file.size()<5 || !std::equal(magic, magic+4, table.file.data())){
+        if (table.file.is_open()){
+            std::cerr<<"WARNING: corrupted tablebase file for "<<table.code<<std::endl;
+            table.file.close();
+        }
+        table.missing = true;
+        return false;
+    }
+
+    const uint8_t *base {table.file.data()};
+    const uint8_t *data {base + 4};
+    bool split { (*data & 1)!=0 };
+    bool pawns_in_file { (*data & 2)!=0 };
+    if (pawns_in_file!=table.has_pawns || split==table.symmetric){
+        std::cerr<<"WARNING: tablebase file "<<table.code<<" does not match its name"<<std::endl;
+        table.file.close();
+        table.missing = true;
+        return false;
+    }
+    data++;
+
+    int sides { !table.is_dtz && !table.symmetric ? 2 : 1 };
+    int max_file { table.has_pawns ? 3 : 0 };
+    bool pp { table.has_pawns && table.pawn_count[1]>0 };
+
+    for (int f{}; f<=max_file; f++){
+        for (int i{}; i<sides; i++){
+            *table.get(i, f) = tb_pairs();
+        }
+        int order[2][2] { { *data & 0xF, pp ? (*(data+1) & 0xF) : 0xF },
+                          { *data >> 4, pp ? (*(data+1) >> 4) : 0xF } };
+        data += 1 + pp;
+        for (int k{}; k<table.piece_count; k++, data++){
+            for (int i{}; i<sides; i++){
+                table.get(i, f)->pieces[k] = static_cast<uint8_t>(i ? (*data >> 4) : (*data & 0xF));
+            }
+        }
+        for (int i{}; i<sides; i++){
+            set_groups(table, *table.get(i, f), order[i], f);
+        }
+    }
+    data += (data - base) & 1;
+
+    for (int f{}; f<=max_file; f++){
+        for (int i{}; i<sides; i++){
+            data = set_sizes(*table.get(i, f), data);
+        }
+    }
+    if (table.is_dtz){
+        data = set_dtz_map(table, data, base, max_file);
+    }
+    for (int f{}; f<=max_file; f++){
+        for (int i{}; i<sides; i++){
+            tb_pairs *d {table.get(i, f)};
+            d->sparse_index = data;
+            data += d->sparse_index_size * 6;
+        }
+    }
+    for (int f{}; f<=max_file; f++){
+        for (int i{}; i<sides; i++){
+            tb_pairs *d {table.get(i, f)};
+            d->block_length = data;
+            data += d->block_length_size * 2;
+        }
+    }
+    for (int f{}; f<=max_file; f++){
+        for (int i{}; i<sides; i++){
+            tb_pairs *d {table.get(i, f)};
+            data = base + ((data - base + 0x3F) & ~static_cast<ptrdiff_t>(0x3F)); // 64-byte alignment
+            d->data = data;
+            data += static_cast<size_t>(d->num_blocks) * d->block_size;
+        }
+    }
+    if (data > base + table.file.size()){
+        std::cerr<<"WARNING: tablebase file "<<table.code<<" is truncated"<<std::endl;
+        table.file.close();
+        table.missing = true;
+        return false;
+    }
+    table.mapped = true;
+    return true;
+}
+
+void tablebase::set_paths(std::string paths)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    directories.clear();
+    wdl_tables.clear();
+    dtz_tables.clear();
+    decoded_blocks.clear();
+    block_lookup.clear();
+    largest = 0;
+
+#ifdef _WIN32
+    const char separator {';'};
+#else
+    const char separator {':'};
+#endif
+    std::stringstream path_stream {paths};
+    std::string dir;
+    while (getline(path_stream, dir, separator)){
+        if (dir.empty() || !path_exists(dir)) continue;
+        directories.push_back(dir);
+        // Only the WDL files are needed to know which material combinations are covered
+        std::error_code error;
+        for (auto &entry : std::filesystem::directory_iterator(dir, error)){
+            std::string name {entry.path().filename().string()};
+            if (name.size()<=5 || name.substr(name.size()-5)!=".rtbw") continue;
+            int pieces {static_cast<int>(std::count_if(name.begin(), name.end()-5, [](char c){ return c!='v'; }))};
+            largest = std::max(largest, pieces);
+        }
+    }
+}
+
+// Find the table matching the material on the board. Tables are stored with the stronger side first:
+// if black holds that material, colors have to be swapped when indexing.
+tb_table *tablebase::find_table(const compact_board &board, bool dtz, bool &black_stronger)
+{
+    std::string white_side {material_string(board, chess_vars::white)};
+    std::string black_side {material_string(board, chess_vars::black)};
+    auto &tables { dtz ? dtz_tables : wdl_tables };
+
+    for (int attempt{}; attempt<2; attempt++){
+        std::string code { attempt==0 ? white_side + "v" + black_side : black_side + "v" + white_side };
+        auto iter {tables.find(code)};
+        if (iter==tables.end()){
+            std::unique_ptr<tb_table> table {new tb_table()};
+            describe_table(*table, code, dtz);
+            iter = tables.emplace(code, std::move(table)).first;
+        }
+        if (map_table(*iter->second)){
+            black_stronger = (attempt==1) && white_side!=black_side;
+            return iter->second.get();
+        }
+        if (white_side==black_side) break;
+    }
+    return nullptr;
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Decompression %%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+// Decode all the values of one block, or fetch them from the cache
+const std::vector<uint16_t> &tablebase::decoded_block(const tb_pairs &d, uint32_t block)
+{
+    block_key key {&d, block};
+    auto found {block_lookup.find(key)};
+    if (found!=block_lookup.end()){
+        decoded_blocks.splice(decoded_blocks.begin(), decoded_blocks, found->second);
+        return found->second->second;
+    }
+
+    std::vector<uint16_t> values;
+    size_t count { static_cast<size_t>(read_le16(d.block_length + 2*block)) + 1 };
+    values.reserve(count);
+
+    const uint8_t *ptr {d.data + static_cast<size_t>(block) * d.block_size};
+    const uint8_t *block_end {ptr + d.block_size};
+    uint64_t buf64 {read_be64(ptr)};
+    ptr += 8;
+    int buf64_size {64};
+    std::vector<int> pending; // Symbols left to expand, last one first
+
+    while (values.size()<count){
+        // Code length: codes of length l are not smaller than base64[l]
+        size_t len{};
+        while (len+1<d.base64.size() && buf64<d.base64[len]) len++;
+        int sym { static_cast<int>((buf64 - d.base64[len]) >> (64 - len - d.min_sym_len)) + read_le16(d.lowest_sym + 2*len) };
+
+        // Expand the symbol into its values
+        pending.push_back(sym);
+        while (!pending.empty() && values.size()<count){
+            int s {pending.back()};
+            pending.pop_back();
+            if (d.symlen[s]==0){
+                values.push_back(static_cast<uint16_t>(btree_left(d.btree, s)));
+            } else {
+                pending.push_back(btree_right(d.btree, s));
+                pending.push_back(btree_left(d.btree, s));
+            }
+        }
+        pending.clear();
+
+        int bits { static_cast<int>(len) + d.min_sym_len };
+        buf64 <<= bits;
+        buf64_size -= bits;
+        if (buf64_size<=32){
+            buf64_size += 32;
+            if (ptr+4<=block_end){
+                buf64 |= static_cast<uint64_t>(read_be32(ptr)) << (64 - buf64_size);
+            }
+            ptr += 4;
+        }
+    }
+
+    decoded_blocks.emplace_front(key, std::move(values));
+    block_lookup[key] = decoded_blocks.begin();
+    while (decoded_blocks.size()>block_capacity){
+        block_lookup.erase(decoded_blocks.back().first);
+        decoded_blocks.pop_back();
+    }
+    return decoded_blocks.front().second;
+}
+
+// Value stored at a given index of a sub-table
+int tablebase::decompress(const tb_pairs &d, uint64_t idx)
+{
+    if (d.flags & tb_flag_single_value){
+        return d.min_sym_len;
+    }
+
+    // The sparse index points close to the block holding the value
+    size_t k { static_cast<size_t>(idx / d.span) };
+    uint32_t block {read_le32(d.sparse_index + 6*k)};
+    int64_t offset {read_le16(d.sparse_index + 6*k + 4)};
+    offset += static_cast<int64_t>(idx % d.span) - static_cast<int64_t>(d.span / 2);
+
+    while (offset<0){
+        offset += read_le16(d.block_length + 2*(--block)) + 1;
+    }
+    while (offset>read_le16(d.block_length + 2*block)){
+        offset -= read_le16(d.block_length + 2*(block++)) + 1;
+    }
+    return decoded_block(d, block)[static_cast<size_t>(offset)];
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%% Probing %%%%%%%%%%%%%%%%%%%%%%%
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+// Convert a value read from a DTZ table to plies
+int map_dtz_score(tb_table &table, int file, int value, chess_vars::wdl_score wdl)
+{
+    const int wdl_map[5] {1, 3, 0, 2, 0};
+    tb_pairs *d {table.get(0, file)};
+    if (d->flags & tb_flag_mapped){
+        int idx {d->map_idx[wdl_map[wdl + 2]] + value};
+        value = (d->flags & tb_flag_wide) ? read_le16(table.dtz_map + 2*idx) : table.dtz_map[idx];
+    }
+    if ((wdl==chess_vars::tb_win && !(d->flags & tb_flag_win_plies))
+        || (wdl==chess_vars::tb_loss && !(d->flags & tb_flag_loss_plies))
+        || wdl==chess_vars::tb_cursed_win || wdl==chess_vars::tb_blessed_loss){
+        value *= 2;
+    }
+    return value + 1;
+}
+
+// Look up the raw table value of a position: WDL score (dtz=false) or distance to zeroing (dtz=true)
+int tablebase::probe_table(const compact_board &board, bool dtz, chess_vars::wdl_score wdl, chess_vars::probe_state &state)
+{
+    if (board.piece_total()==2){ // Two bare kings
+        return chess_vars::tb_draw;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    bool black_stronger{false};
+    tb_table *entry {find_table(board, dtz, black_stronger)};
+    if (!entry){
+        state = chess_vars::probe_fail;
+        return 0;
+    }
+    const tb_index_tables &t {index_tables()};
+
+    // Symmetric tables only store white to move: with black to move, swap colors and flip the board
+    bool black_to_move { board.side_to_move()==chess_vars::black };
+    bool flip { (entry->symmetric && black_to_move) || black_stronger };
+    int flip_color { flip ? 8 : 0 };
+    int flip_squares { flip ? 56 : 0 };
+    int stm { (flip ? 1 : 0) ^ (black_to_move ? 1 : 0) };
+
+    int squares[7]{}, pieces[7]{};
+    int size{}, lead_pawns_count{}, tb_file{};
+    bool is_lead_pawn[64]{};
+    auto pawns_comp = [&t](int a, int b){ return t.map_pawns[a] < t.map_pawns[b]; };
+
+    // The leading pawns (color of the first piece of the table) come first. The one closest to the edge leads.
+    if (entry->has_pawns){
+        int lead_piece { entry->get(0, 0)->pieces[0] ^ flip_color };
+        chess_vars::player_color lead_color { (lead_piece & 8) ? chess_vars::black : chess_vars::white };
+        for (int sq{}; sq<64; sq++){
+            if (board.at(sq)==piece_code(lead_color, chess_vars::pawn)){
+                squares[size++] = sq ^ flip_squares;
+                is_lead_pawn[sq] = true;
+            }
+        }
+        lead_pawns_count = size;
+        std::swap(squares[0], *std::max_element(squares, squares + lead_pawns_count, pawns_comp));
+        tb_file = std::min(squares[0]%8, 7 - squares[0]%8);
+    }
+
+    // DTZ tables only store one side to move
+    if (dtz){
+        uint8_t flags {entry->get(stm, tb_file)->flags};
+        if ((flags & tb_flag_stm)!=stm && !(entry->symmetric && !entry->has_pawns)){
+            state = chess_vars::probe_change_stm;
+            return 0;
+        }
+    }
+
+    for (int sq{}; sq<64; sq++){
+        if (board.at(sq)==no_piece || is_lead_pawn[sq]) continue;
+        squares[size] = sq ^ flip_squares;
+        pieces[size++] = tb_piece(board.at(sq)) ^ flip_color;
+    }
+
+    tb_pairs *d {entry->get(stm, tb_file)};
+
+    // Reorder the pieces as in the table
+    for (int i{lead_pawns_count}; i<size-1; i++){
+        for (int j{i+1}; j<size; j++){
+            if (d->pieces[i]==pieces[j]){
+                std::swap(pieces[i], pieces[j]);
+                std::swap(squares[i], squares[j]);
+                break;
+            }
+        }
+    }
+
+    // Mirror so that the leading piece is on files a-d
+    if (squares[0]%8 > 3){
+        for (int i{}; i<size; i++) squares[i] ^= 7;
+    }
+
+    uint64_t idx{};
+    if (entry->has_pawns){
+        idx = t.lead_pawn_idx[lead_pawns_count][squares[0]];
+        std::stable_sort(squares + 1, squares + lead_pawns_count, pawns_comp);
+        for (int i{1}; i<lead_pawns_count; i++){
+            idx += t.binomial[i][t.map_pawns[squares[i]]];
+        }
+    } else {
+        // Without pawns: also mirror to the lower half, then below the a1-h8 diagonal
+        if (squares[0]/8 > 3){
+            for (int i{}; i<size; i++) squares[i] ^= 56;
+        }
+        for (int i{}; i<d->group_len[0]; i++){
+            if (off_diagonal(squares[i])==0) continue;
+            if (off_diagonal(squares[i])>0){
+                for (int j{i}; j<size; j++){
+                    squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+                }
+            }
+            break;
+        }
+
+        if (entry->has_unique_pieces){
+            int adjust1 { squares[1]>squares[0] };
+            int adjust2 { (squares[2]>squares[0]) + (squares[2]>squares[1]) };
+            if (off_diagonal(squares[0])){
+                idx = (t.map_a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+            } else if (off_diagonal(squares[1])){
+                idx = (6*63 + (squares[0]/8) * 28 + t.map_b1h1h7[squares[1]]) * 62 + squares[2] - adjust2;
+            } else if (off_diagonal(squares[2])){
+                idx = 6*63*62 + 4*28*62 + (squares[0]/8) * 7*28 + (squares[1]/8 - adjust1) * 28 + t.map_b1h1h7[squares[2]];
+            } else {
+                idx = 6*63*62 + 4*28*62 + 4*7*28 + (squares[0]/8) * 7*6 + (squares[1]/8 - adjust1) * 6 + (squares[2]/8 - adjust2);
+            }
+        } else {
+            idx = t.map_kk[t.map_a1d1d4[squares[0]]][squares[1]];
+        }
+    }
+
+    // Remaining groups, each encoded as a combination of free squares
+    idx *= d->group_idx[0];
+    int *group_sq {squares + d->group_len[0]};
+    bool remaining_pawns { entry->has_pawns && entry->pawn_count[1]>0 };
+    int next{};
+    while (d->group_len[++next]){
+        std::stable_sort(group_sq, group_sq + d->group_len[next]);
+        uint64_t n{};
+        for (int i{}; i<d->group_len[next]; i++){
+            int adjust { static_cast<int>(std::count_if(squares, group_sq, [&](int s){ return group_sq[i] > s; })) };
+            n += t.binomial[i+1][group_sq[i] - adjust - 8*remaining_pawns];
+        }
+        remaining_pawns = false;
+        idx += n * d->group_idx[next];
+        group_sq += d->group_len[next];
+    }
+
+    int value {decompress(*d, idx)};
+    if (!dtz){
+        return value - 2;
+    }
+    return map_dtz_score(*entry, tb_file, value, wdl);
+}
+
+int dtz_before_zeroing(chess_vars::wdl_score wdl)
+{
+    switch (wdl)
+    {
+    case chess_vars::tb_win:          return 1;
+    case chess_vars::tb_cursed_win:   return 101;
+    case chess_vars::tb_blessed_loss: return -101;
+    case chess_vars::tb_loss:         return -1;
+    default:                          return 0;
+    }
+}
+
+int sign_of(int value)
+{
+    return (value>0) - (value<0);
+}
+
+// Tables may store a wrong value when the best move is a capture (or with en-passant rights):
+// resolve captures (and pawn moves if check_zeroing) by searching them first.
+chess_vars::wdl_score tablebase::search(const compact_board &board, bool check_zeroing, chess_vars::probe_state &state)
+{
+    chess_vars::wdl_score value, best_value {chess_vars::tb_loss};
+    std::vector<compact_move> moves;
+    board.generate_legal(moves);
+    size_t move_count{};
+
+    for (auto &m : moves){
+        if (!m.is_capture() && (!check_zeroing || code_type(board.at(m.from))!=chess_vars::pawn)){
+            continue;
+        }
+        move_count++;
+        compact_board after {board};
+        after.make_move(m);
+        value = static_cast<chess_vars::wdl_score>(-search(after, false, state));
+        if (state==chess_vars::probe_fail){
+            return chess_vars::tb_draw;
+        }
+        if (value>best_value){
+            best_value = value;
+            if (value>=chess_vars::tb_win){
+                state = chess_vars::probe_zeroing_best;
+                return value;
+            }
+        }
+    }
+
+    // All legal moves were searched: no need to trust the table
+    bool no_more_moves { move_count>0 && move_count==moves.size() };
+    if (no_more_moves){
+        value = best_value;
+    } else {
+        value = static_cast<chess_vars::wdl_score>(probe_table(board, false, chess_vars::tb_draw, state));
+        if (state==chess_vars::probe_fail){
+            return chess_vars::tb_draw;
+        }
+    }
+
+    if (best_value>=value){
+        state = (best_value>chess_vars::tb_draw || no_more_moves) ? chess_vars::probe_zeroing_best : chess_vars::probe_ok;
+        return best_value;
+    }
+    state = chess_vars::probe_ok;
+    return value;
+}
+
+bool tablebase::can_probe(const compact_board &board) const
+{
+    return available() && board.castling_rights()==0 && board.piece_total()<=largest;
+}
+
+chess_vars::wdl_score tablebase::probe_wdl(const compact_board &board, chess_vars::probe_state &state)
+{
+    state = chess_vars::probe_ok;
+    return search(board, false, state);
+}
+
+// Distance to zeroing (capture or pawn move) in plies, positive if the side to move wins.
+// Cursed wins and blessed losses are reported beyond 100.
+int tablebase::probe_dtz(const compact_board &board, chess_vars::probe_state &state)
+{
+    state = chess_vars::probe_ok;
+    chess_vars::wdl_score wdl {search(board, true, state)};
+    if (state==chess_vars::probe_fail || wdl==chess_vars::tb_draw){
+        return 0;
+    }
+    if (state==chess_vars::probe_zeroing_best){
+        return dtz_before_zeroing(wdl);
+    }
+
+    int dtz {probe_table(board, true, wdl, state)};
+    if (state==chess_vars::probe_fail){
+        return 0;
+    }
+    if (state!=chess_vars::probe_change_stm){
+        return (dtz + 100*(wdl==chess_vars::tb_blessed_loss || wdl==chess_vars::tb_cursed_win)) * sign_of(wdl);
+    }
+
+    // The table stores the other side to move: search one ply and keep the best DTZ
+    int min_dtz {0xFFFF};
+    std::vector<compact_move> moves;
+    board.generate_legal(moves);
+    for (auto &m : moves){
+        bool zeroing { m.is_capture() || code_type(board.at(m.from))==chess_vars::pawn };
+        compact_board after {board};
+        after.make_move(m);
+        dtz = zeroing ? -dtz_before_zeroing(search(after, false, state)) : -probe_dtz(after, state);
+
+        // A mating move gets a DTZ of 1
+        if (dtz==1 && after.in_check() && !after.has_legal_move()){
+            min_dtz = 1;
+        }
+        if (!zeroing){
+            dtz += sign_of(dtz);
+        }
+        if (dtz<min_dtz && sign_of(dtz)==sign_of(wdl)){
+            min_dtz = dtz;
+        }
+        if (state==chess_vars::probe_fail){
+            return 0;
+        }
+    }
+    return min_dtz==0xFFFF ? -1 : min_dtz;
+}
+
+// Score every legal move from the tables. Returns false if a table is missing.
+bool tablebase::rank_root_moves(const compact_board &board, std::vector<tb_root_move> &root_moves)
+{
+    root_moves.clear();
+    if (!can_probe(board)){
+        return false;
+    }
+    std::vector<compact_move> moves;
+    board.generate_legal(moves);
+    int count50 {board.halfmoves()};
+    chess_vars::probe_state state {chess_vars::probe_ok};
+
+    for (auto &m : moves){
+        compact_board after {board};
+        after.make_move(m);
+        int dtz{};
+        if (after.halfmoves()==0){ // Capture or pawn move
+            dtz = dtz_before_zeroing(static_cast<chess_vars::wdl_score>(-probe_wdl(after, state)));
+        } else if (after.halfmoves()>=100){
+            dtz = 0;
+        } else {
+            dtz = -probe_dtz(after, state);
+            dtz = dtz>0 ? dtz+1 : (dtz<0 ? dtz-1 : dtz);
+        }
+        if (after.in_check() && dtz==2 && !after.has_legal_move()){
+            dtz = 1;
+        }
+        if (state==chess_vars::probe_fail){
+            root_moves.clear();
+            return false;
+        }
+        // Wins which the fifty-move rule can't spoil are ranked equally, as are sure losses
+        tb_root_move root;
+        root.move = m;
+        root.dtz = dtz;
+        if (dtz>0){
+            root.rank = (dtz + count50<=99) ? tb_max_dtz : tb_max_dtz - (dtz + count50);
+        } else if (dtz<0){
+            root.rank = (-dtz*2 + count50<100) ? -tb_max_dtz : -tb_max_dtz + (-dtz + count50);
+        } else {
+            root.rank = 0;
+        }
+        root_moves.push_back(root);
+    }
+    return !root_moves.empty();
+}
+
+// Perfect endgame move: best rank; among equal wins the fastest conversion, among equal losses the longest resistance
+bool tablebase::best_move(const compact_board &board, tb_root_move &best)
+{
+    std::vector<tb_root_move> root_moves;
+    if (!rank_root_moves(board, root_moves)){
+        return false;
+    }
+    best = root_moves.front();
+    for (auto &root : root_moves){
+        bool better { root.rank>best.rank };
+        if (root.rank==best.rank && root.dtz>0 && root.dtz<best.dtz) better = true;
+        if (root.rank==best.rank && root.dtz<0 && root.dtz<best.dtz) better = true;
+        if (better) best = root;
+    }
+    return true;
+}
+
+std::string wdl_to_string(chess_vars::wdl_score wdl)
+{
+    switch (wdl)
+    {
+    case chess_vars::tb_win:          return "win";
+    case chess_vars::tb_cursed_win:   return "win, but drawn by the fifty-move rule";
+    case chess_vars::tb_draw:         return "draw";
+    case chess_vars::tb_blessed_loss: return "loss, but saved by the fifty-move rule";
+    case chess_vars::tb_loss:         return "loss";
+    default:                          return "unknown";
+    }
+}
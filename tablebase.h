@@ -0,0 +1,135 @@
+// Interface for the Syzygy endgame tablebases, part of the C++ Chess Project.
+// Probes WDL (.rtbw) and DTZ (.rtbz) files found in local directories:
+// - files are memory-mapped the first time a material combination is probed
+// - blocks of the compressed tables are decoded on demand and kept in a small LRU cache
+// - positions are probed through the compact_board representation
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "compact_board.h"
+#include "mapped_file.h"
+#include "utils.cpp"
+
+#pragma once
+
+namespace chess_vars {
+    // Win/draw/loss from the point of view of the side to move.
+    // Cursed wins and blessed losses are wins/losses which the fifty-move rule turns into draws.
+    enum wdl_score{
+        tb_loss = -2,
+        tb_blessed_loss = -1,
+        tb_draw = 0,
+        tb_cursed_win = 1,
+        tb_win = 2
+    };
+    enum probe_state{
+        probe_fail = 0,
+        probe_ok = 1,
+        probe_change_stm = -1, // DTZ table only stores the other side to move
+        probe_zeroing_best = 2 // Best move is a capture or pawn move
+    };
+};
+
+// Decoding data for one (side to move, leading file) sub-table of a tablebase file
+struct tb_pairs
+{
+    uint8_t flags{};
+    int max_sym_len{};
+    int min_sym_len{};
+    uint32_t num_blocks{};
+    size_t block_size{};
+    size_t span{};
+    const uint8_t *lowest_sym{};    // Lowest symbol of each code length (16-bit little-endian)
+    const uint8_t *btree{};         // Pair of child symbols for each symbol (2 x 12 bits)
+    const uint8_t *block_length{};  // Number of values (minus one) stored in each block (16-bit little-endian)
+    uint32_t block_length_size{};
+    const uint8_t *sparse_index{};  // Every 'span' values: first block and offset (6 bytes)
+    size_t sparse_index_size{};
+    const uint8_t *data{};          // Start of the Huffman-compressed blocks
+    std::vector<uint64_t> base64;   // Lowest code of each length, left-aligned on 64 bits
+    std::vector<uint8_t> symlen;    // Number of values (minus one) a symbol expands to
+    uint8_t pieces[7]{};            // Order of the pieces in the index
+    uint64_t group_idx[8]{};
+    int group_len[8]{};
+    uint16_t map_idx[4]{};          // DTZ only: offsets of the value maps
+};
+
+// One tablebase file, e.g. KRPvKR.rtbw
+struct tb_table
+{
+    std::string code;       // Material with the stronger side first, e.g. "KRPvKR"
+    bool is_dtz{false};
+    bool symmetric{false};  // Both sides have the same material
+    int piece_count{};
+    bool has_pawns{false};
+    bool has_unique_pieces{false};
+    int pawn_count[2]{};    // Pawns of the leading color, then of the other color
+    bool mapped{false};
+    bool missing{false};
+    mapped_file file;
+    const uint8_t *dtz_map{};
+    tb_pairs items[2][4];   // [side to move][leading pawn file a-d]
+
+    tb_pairs *get(int stm, int file)
+    {
+        return &items[is_dtz ? 0 : stm % 2][has_pawns ? file : 0];
+    }
+};
+
+// Tablebase evaluation of a legal root move
+struct tb_root_move
+{
+    compact_move move;
+    int dtz{};  // Distance to zeroing from the root, in plies (positive: win for the side to move)
+    int rank{}; // Higher is better
+};
+
+class tablebase
+{
+    private:
+        std::vector<std::string> directories;
+        int largest{0}; // Largest number of pieces among the files found
+        std::map<std::string, std::unique_ptr<tb_table>> wdl_tables, dtz_tables;
+
+        // Decoded blocks, most recently used at the front
+        typedef std::pair<const tb_pairs*, uint32_t> block_key;
+        struct block_key_hash
+        {
+            size_t operator()(const block_key &key) const
+            {
+                return std::hash<const void*>()(key.first) ^ (static_cast<size_t>(key.second) * 0x9E3779B97F4A7C15ULL);
+            }
+        };
+        typedef std::list<std::pair<block_key, std::vector<uint16_t>>> block_list;
+        block_list decoded_blocks;
+        std::unordered_map<block_key, block_list::iterator, block_key_hash> block_lookup;
+        size_t block_capacity{64};
+        std::mutex mutex; // Tables and block cache are shared by all callers
+
+        tb_table *find_table(const compact_board &board, bool dtz, bool &black_stronger);
+        bool map_table(tb_table &table);
+        const std::vector<uint16_t> &decoded_block(const tb_pairs &d, uint32_t block);
+        int decompress(const tb_pairs &d, uint64_t idx);
+        int probe_table(const compact_board &board, bool dtz, chess_vars::wdl_score wdl, chess_vars::probe_state &state);
+        chess_vars::wdl_score search(const compact_board &board, bool check_zeroing, chess_vars::probe_state &state);
+    public:
+        tablebase() = default;
+        tablebase(std::string paths){ set_paths(paths); }
+
+        void set_paths(std::string paths);
+        void set_block_capacity(size_t blocks){ block_capacity = blocks>0 ? blocks : 1; }
+        bool available() const { return largest>0; }
+        int max_pieces() const { return largest; }
+        bool can_probe(const compact_board &board) const;
+
+        chess_vars::wdl_score probe_wdl(const compact_board &board, chess_vars::probe_state &state);
+        int probe_dtz(const compact_board &board, chess_vars::probe_state &state);
+        bool rank_root_moves(const compact_board &board, std::vector<tb_root_move> &root_moves);
+        bool best_move(const compact_board &board, tb_root_move &best);
+};
@@ -0,0 +1,234 @@
+// Universal Chess Interface front end, part of the C++ Chess Project.
+// Moves are exchanged in coordinate notation (e2e4, e7e8q, e1g1 for castling), which is what move_to_string writes.
+
+#include <algorithm>
+
+#include "uci.h"
+#include "engine.cpp"
+#include "opening_book.cpp"
+#include "utils.cpp"
+
+#pragma once
+
+
+const int64_t move_overhead_ms {20}; // Kept aside for the GUI and the pipe, so that the clock never runs out
+const int default_moves_to_go {30};  // Moves left to plan for when the time control does not say
+
+// Score as sent to the GUI: centipawns, or moves to mate (negative when getting mated)
+std::string uci_score(int score)
+{
+    if (std::abs(score) > mate_score - max_search_depth){
+        int moves_to_mate { (mate_score - std::abs(score) + 1)/2 };
+        return "mate " + std::to_string(score<0 ? -moves_to_mate : moves_to_mate);
+    }
+    return "cp " + std::to_string(score);
+}
+
+void uci_session::send(const std::string &line)
+{
+    std::lock_guard<std::mutex> lock(output_mutex);
+    std::cout<<line<<'\n';
+    std::cout.flush();
+}
+
+// One info line per principal variation
+void uci_session::send_info(const search_result &result)
+{
+    int64_t time_ms {static_cast<int64_t>(result.seconds*1000)};
+    for (size_t k{}; k<result.lines.size(); k++){
+        std::string line {"info depth " + std::to_string(result.depth) + " multipv " + std::to_string(k+1)
+            + " score " + uci_score(result.lines[k].score) + " nodes " + std::to_string(result.nodes)
+            + " nps " + std::to_string(result.nodes_per_second()) + " time " + std::to_string(time_ms) + " pv"};
+        for (auto &m : result.lines[k].pv) line += " " + move_to_string(m);
+        send(line);
+    }
+}
+
+void uci_session::send_bestmove(const search_result &result)
+{
+    if (result.pv.empty()){ // Checkmate or stalemate: there is no move to play
+        send("bestmove 0000");
+        return;
+    }
+    std::string line {"bestmove " + move_to_string(result.best)};
+    if (result.pv.size()>1) line += " ponder " + move_to_string(result.pv[1]);
+    send(line);
+}
+
+// stop or ponderhit: the held bestmove goes out as soon as the search is over
+void uci_session::release_bestmove()
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    hold_bestmove = false;
+    if (bestmove_owed && search_finished){
+        bestmove_owed = false;
+        send_bestmove(final_result);
+    }
+}
+
+void uci_session::stop_search()
+{
+    release_bestmove();
+    searcher.stop();
+}
+
+// setoption name <name> value <value>. The name may contain spaces.
+void uci_session::set_option(std::stringstream &args)
+{
+    std::string word, name, value;
+    args>>word; // name
+    while (args>>word && word!="value") name += (name.empty() ? "" : " ") + word;
+    args>>value;
+    name = get_lower(name);
+
+    int number{};
+    std::stringstream(value)>>number;
+    if (name=="hash"){
+        searcher.set_hash_size(static_cast<size_t>(std::max(number, 1)));
+    } else if (name=="threads"){
+        searcher.set_threads(static_cast<unsigned>(std::max(number, 1)));
+    } else if (name=="multipv"){
+        multi_pv = std::max(number, 1);
+    } else if (name!="ponder"){ // Pondering is driven by go ponder, nothing to set
+        send("info string unknown option " + name);
+    }
+}
+
+// position [startpos | fen <fen>] [moves <move>...]
+void uci_session::set_position(std::stringstream &args)
+{
+    std::string word, fen;
+    args>>word;
+    compact_board start {compact_board::starting_position()};
+    if (word=="fen"){
+        while (args>>word && word!="moves") fen += (fen.empty() ? "" : " ") + word;
+        if (!compact_board::from_fen(fen, start)){
+            send("info string invalid fen " + fen);
+            return;
+        }
+    } else {
+        args>>word; // moves
+    }
+
+    board = start;
+    history.clear();
+    while (args>>word){
+        std::vector<compact_move> legal;
+        board.generate_legal(legal);
+        auto played {std::find_if(legal.begin(), legal.end(), [&word](const compact_move &m){ return move_to_string(m)==get_lower(word); })};
+        if (played==legal.end()){
+            send("info string illegal move " + word);
+            return;
+        }
+        history.push_back(polyglot_key(board));
+        board.make_move(*played);
+    }
+}
+
+// go [depth d] [nodes n] [movetime ms] [wtime ms btime ms winc ms binc ms movestogo m] [infinite] [ponder]
+void uci_session::go(std::stringstream &args)
+{
+    search_limits limits;
+    limits.multi_pv = multi_pv;
+    int64_t time_left[2]{}, increment[2]{}, moves_to_go{0};
+    bool infinite{false}, ponder{false};
+    std::string word;
+    while (args>>word){
+        if (word=="depth") args>>limits.depth;
+        else if (word=="nodes") args>>limits.nodes;
+        else if (word=="movetime") args>>limits.movetime_ms;
+        else if (word=="wtime") args>>time_left[chess_vars::white];
+        else if (word=="btime") args>>time_left[chess_vars::black];
+        else if (word=="winc") args>>increment[chess_vars::white];
+        else if (word=="binc") args>>increment[chess_vars::black];
+        else if (word=="movestogo") args>>moves_to_go;
+        else if (word=="infinite") infinite = true;
+        else if (word=="ponder") ponder = true;
+    }
+
+    // Clock: an even share of the time left plus most of the increment, never more than half of what is left
+    chess_vars::player_color player {board.side_to_move()};
+    if (time_left[player]>0 && limits.movetime_ms==0){
+        int64_t budget {time_left[player]/(moves_to_go>0 ? moves_to_go : default_moves_to_go) + increment[player]*3/4};
+        budget = std::min(budget, time_left[player]/2);
+        limits.movetime_ms = std::max<int64_t>(budget - move_overhead_ms, 1);
+    }
+    if (infinite){
+        limits = search_limits();
+        limits.multi_pv = multi_pv;
+    }
+    // Pondering searches without limits; ponderhit then gives it the time of the move
+    ponder_budget_ms = ponder ? limits.movetime_ms : 0;
+    if (ponder){
+        limits.depth = 0;
+        limits.nodes = 0;
+        limits.movetime_ms = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        bestmove_owed = true;
+        hold_bestmove = infinite || ponder;
+        search_finished = false;
+    }
+    searcher.set_history(history);
+    searcher.start(board, limits,
+        [this](const search_result &result){ send_info(result); },
+        [this](const search_result &result){
+            std::lock_guard<std::mutex> lock(state_mutex);
+            search_finished = true;
+            final_result = result;
+            if (bestmove_owed && !hold_bestmove){
+                bestmove_owed = false;
+                send_bestmove(result);
+            }
+        });
+}
+
+int uci_session::run(std::istream &input)
+{
+    std::ios::sync_with_stdio(false);
+    input.tie(nullptr); // Output is only flushed by send(), under its lock
+    std::string line;
+    while (std::getline(input, line)){
+        std::stringstream args {line};
+        std::string command;
+        if (!(args>>command)) continue;
+
+        if (command=="uci"){
+            send("id name CMD-Chess");
+            send("id author James Lockwood");
+            send("option name Hash type spin default 16 min 1 max 4096");
+            send("option name Threads type spin default 1 min 1 max 64");
+            send("option name MultiPV type spin default 1 min 1 max 64");
+            send("option name Ponder type check default false");
+            send("uciok");
+        } else if (command=="isready"){
+            send("readyok");
+        } else if (command=="ucinewgame"){
+            stop_search();
+            searcher.clear_hash();
+        } else if (command=="setoption"){
+            stop_search();
+            set_option(args);
+        } else if (command=="position"){
+            stop_search();
+            set_position(args);
+        } else if (command=="go"){
+            stop_search();
+            go(args);
+        } else if (command=="stop"){
+            stop_search();
+        } else if (command=="ponderhit"){
+            // The move pondered on was played: the search goes on with the time of the move, counted from now
+            if (ponder_budget_ms>0) searcher.set_movetime(searcher.elapsed_ms() + ponder_budget_ms);
+            release_bestmove();
+        } else if (command=="quit"){
+            break;
+        } else {
+            send("info string unknown command " + command);
+        }
+    }
+    stop_search();
+    return EXIT_SUCCESS;
+}
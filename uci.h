@@ -0,0 +1,53 @@
+// Universal Chess Interface front end, part of the C++ Chess Project.
+// Started with --uci: the program then talks to a chess GUI over standard input and output instead of drawing the board.
+// - commands are read on the main thread while the engine searches on its own thread, so isready and stop answer at once
+// - every output line goes through one writer, flushed once per line
+// Supported: uci, isready, ucinewgame, setoption (Hash, Threads, MultiPV, Ponder), position, go, stop, ponderhit, quit
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <mutex>
+#include <iostream>
+
+#include "compact_board.h"
+#include "engine.h"
+#include "utils.cpp"
+
+#pragma once
+
+
+class uci_session
+{
+    private:
+        engine searcher;
+        compact_board board {compact_board::starting_position()};
+        std::vector<uint64_t> history; // Keys of the positions before the current one, for repetitions
+        int multi_pv{1};
+
+        std::mutex output_mutex;
+        // bestmove is owed for every go. In infinite and ponder mode it is held back until stop or ponderhit.
+        std::mutex state_mutex;
+        bool bestmove_owed{false};
+        bool hold_bestmove{false};
+        bool search_finished{false};
+        search_result final_result;
+        int64_t ponder_budget_ms{0}; // Search time to use once the ponder move is played
+
+        void send(const std::string &line);
+        void send_info(const search_result &result);
+        void send_bestmove(const search_result &result);
+        void release_bestmove();
+        void stop_search();
+
+        void set_option(std::stringstream &args);
+        void set_position(std::stringstream &args);
+        void go(std::stringstream &args);
+    public:
+        uci_session() = default;
+
+        // Reads commands until quit or the end of the input
+        int run(std::istream &input);
+};
+
+std::string uci_score(int score);
@@ -181,6 +181,9 @@ namespace chess_vars {
         black_won = 1,
         draw_by_stalemate = 2,
         draw_by_offer = 3,
+        draw_by_repetition,
+        draw_by_move_rule, // Fifty moves claimed, or seventy-five, without a capture or a pawn move
+        draw_by_material,
 		ongoing
     };
     enum game_option{
@@ -195,7 +198,8 @@ namespace chess_vars {
 		nominal = 0,
 		check,
 		checkmate,
-		stalemate
+		stalemate,
+		draw
 	};
     enum player_color{
         black = 0,
@@ -210,6 +214,8 @@ namespace chess_vars {
         resign,
         quit_game,
         menu,
+		analyse,
+		redo,
 		invalid_request
     };
     enum setup{